@@ -0,0 +1,360 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2024 Analog Devices, Inc.
+ */
+
+/* For MAP_ANONYMOUS and syscall() */
+#define _DEFAULT_SOURCE
+
+#include "iio-private.h"
+
+#include <errno.h>
+#include <iio/iio-backend.h>
+#include <iio/iio-lock.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+/* Max. number of free blocks kept around for reuse */
+#define IIO_BLOCK_POOL_SIZE	16
+
+#define IIO_BLOCK_ALIGN		64
+#define IIO_HUGEPAGE_SIZE	(2 * 1024 * 1024)
+
+#define MPOL_PREFERRED		1
+
+struct iio_block_mem {
+	struct iio_block_mem *next;
+	void *ptr;
+	size_t size, map_size;
+	bool mapped, locked;
+};
+
+struct iio_block_allocator {
+	struct iio_mutex *lock;
+	unsigned int flags;
+
+	/* Memory handed out, and free memory available for reuse */
+	struct iio_block_mem *used, *pool;
+	unsigned int nb_pooled;
+
+	/* Allocations in progress, with the flags they were started with */
+	unsigned int nb_pending;
+
+	/* mlock() failed; only warn once */
+	bool lock_failed;
+};
+
+static size_t round_up(size_t size, size_t align)
+{
+	return (size + align - 1) & ~(align - 1);
+}
+
+static void iio_block_mem_release(struct iio_block_mem *mem)
+{
+#ifndef _WIN32
+	if (mem->locked)
+		munlock(mem->ptr, mem->map_size);
+
+	if (mem->mapped) {
+		munmap(mem->ptr, mem->map_size);
+		free(mem);
+		return;
+	}
+
+	free(mem->ptr);
+#else
+	_aligned_free(mem->ptr);
+#endif
+	free(mem);
+}
+
+#ifndef _WIN32
+static void * iio_block_mem_map(struct iio_block_mem *mem, unsigned int flags)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	void *ptr = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+	if (flags & IIO_BLOCK_ALLOC_HUGEPAGES) {
+		mem->map_size = round_up(mem->size, IIO_HUGEPAGE_SIZE);
+		ptr = mmap(NULL, mem->map_size, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	}
+#endif
+
+	if (ptr == MAP_FAILED) {
+		/* No huge pages reserved; fall back to regular pages, which
+		 * can still be merged into transparent huge pages. */
+		if (page_size <= 0)
+			page_size = 4096;
+
+		mem->map_size = round_up(mem->size, (size_t) page_size);
+		ptr = mmap(NULL, mem->map_size, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (ptr == MAP_FAILED)
+			return NULL;
+
+#ifdef MADV_HUGEPAGE
+		if (flags & IIO_BLOCK_ALLOC_HUGEPAGES)
+			madvise(ptr, mem->map_size, MADV_HUGEPAGE);
+#endif
+	}
+
+#if defined(__linux__) && defined(SYS_mbind) && defined(SYS_getcpu)
+	if (flags & IIO_BLOCK_ALLOC_NUMA_LOCAL) {
+		unsigned int cpu, node;
+		unsigned long nodemask;
+
+		/* Prefer the memory node of the thread creating the block,
+		 * which is normally the one consuming its samples. */
+		if (!syscall(SYS_getcpu, &cpu, &node, NULL)
+		    && node < 8 * sizeof(nodemask)) {
+			nodemask = 1ul << node;
+			syscall(SYS_mbind, ptr, mem->map_size, MPOL_PREFERRED,
+				&nodemask, 8 * sizeof(nodemask), 0);
+		}
+	}
+#endif
+
+	mem->mapped = true;
+
+	return ptr;
+}
+#endif
+
+static struct iio_block_mem *
+iio_block_mem_create(size_t size, unsigned int flags)
+{
+	struct iio_block_mem *mem;
+	int err = -ENOMEM;
+
+	mem = zalloc(sizeof(*mem));
+	if (!mem)
+		return iio_ptr(-ENOMEM);
+
+	mem->size = size;
+	mem->map_size = round_up(size, IIO_BLOCK_ALIGN);
+
+#ifdef _WIN32
+	if (flags) {
+		free(mem);
+		return iio_ptr(-ENOSYS);
+	}
+
+	mem->ptr = _aligned_malloc(mem->map_size, IIO_BLOCK_ALIGN);
+	if (!mem->ptr)
+		goto err_free_mem;
+#else
+	/* Locked memory must not share its pages with other allocations,
+	 * as unlocking it would also unlock them. */
+	if (flags & (IIO_BLOCK_ALLOC_HUGEPAGES | IIO_BLOCK_ALLOC_NUMA_LOCAL
+		     | IIO_BLOCK_ALLOC_LOCKED)) {
+		mem->ptr = iio_block_mem_map(mem, flags);
+	} else {
+		err = -posix_memalign(&mem->ptr, IIO_BLOCK_ALIGN, mem->map_size);
+		if (err)
+			mem->ptr = NULL;
+	}
+
+	if (!mem->ptr)
+		goto err_free_mem;
+
+	/* Also faults the pages in, so that the first transfer does not pay
+	 * for it. Without the privilege or the budget to lock the memory
+	 * (RLIMIT_MEMLOCK), the memory is used unlocked; the caller checks
+	 * mem->locked. */
+	if ((flags & IIO_BLOCK_ALLOC_LOCKED)
+	    && !mlock(mem->ptr, mem->map_size))
+		mem->locked = true;
+#endif
+
+	return mem;
+
+err_free_mem:
+	free(mem);
+	return iio_ptr(err);
+}
+
+static void iio_block_allocator_drain(struct iio_block_allocator *alloc)
+{
+	struct iio_block_mem *mem;
+
+	while (alloc->pool) {
+		mem = alloc->pool;
+		alloc->pool = mem->next;
+		iio_block_mem_release(mem);
+	}
+
+	alloc->nb_pooled = 0;
+}
+
+struct iio_block_allocator * iio_block_allocator_create(void)
+{
+	struct iio_block_allocator *alloc;
+	int err;
+
+	alloc = zalloc(sizeof(*alloc));
+	if (!alloc)
+		return iio_ptr(-ENOMEM);
+
+	alloc->lock = iio_mutex_create();
+	err = iio_err(alloc->lock);
+	if (err) {
+		free(alloc);
+		return iio_ptr(err);
+	}
+
+	return alloc;
+}
+
+void iio_block_allocator_destroy(struct iio_block_allocator *alloc)
+{
+	struct iio_block_mem *mem;
+
+	iio_block_allocator_drain(alloc);
+
+	/* Blocks still alive at this point are leaked by the application;
+	 * release their memory anyway. */
+	while (alloc->used) {
+		mem = alloc->used;
+		alloc->used = mem->next;
+		iio_block_mem_release(mem);
+	}
+
+	iio_mutex_destroy(alloc->lock);
+	free(alloc);
+}
+
+int iio_block_allocator_set_flags(struct iio_block_allocator *alloc,
+				  unsigned int flags)
+{
+	int ret = 0;
+
+#ifdef _WIN32
+	if (flags)
+		return -ENOSYS;
+#endif
+
+	iio_mutex_lock(alloc->lock);
+
+	if (alloc->used || alloc->nb_pending) {
+		ret = -EBUSY;
+	} else if (flags != alloc->flags) {
+		iio_block_allocator_drain(alloc);
+		alloc->flags = flags;
+		alloc->lock_failed = false;
+	}
+
+	iio_mutex_unlock(alloc->lock);
+
+	return ret;
+}
+
+void * iio_block_allocator_alloc(struct iio_block_allocator *alloc,
+				 size_t size)
+{
+	struct iio_block_mem *mem, **ptr;
+	unsigned int flags;
+
+	if (!alloc)
+		return malloc(size);
+
+	iio_mutex_lock(alloc->lock);
+
+	for (ptr = &alloc->pool; *ptr; ptr = &(*ptr)->next) {
+		if ((*ptr)->size == size)
+			break;
+	}
+
+	mem = *ptr;
+	if (mem) {
+		*ptr = mem->next;
+		alloc->nb_pooled--;
+
+		mem->next = alloc->used;
+		alloc->used = mem;
+
+		iio_mutex_unlock(alloc->lock);
+
+		return mem->ptr;
+	}
+
+	/* The flags cannot change until the new memory is linked in */
+	flags = alloc->flags;
+	alloc->nb_pending++;
+
+	iio_mutex_unlock(alloc->lock);
+
+	mem = iio_block_mem_create(size, flags);
+
+	iio_mutex_lock(alloc->lock);
+	alloc->nb_pending--;
+
+	if (iio_err(mem)) {
+		iio_mutex_unlock(alloc->lock);
+		return NULL;
+	}
+
+	if ((flags & IIO_BLOCK_ALLOC_LOCKED) && !mem->locked
+	    && !alloc->lock_failed) {
+		alloc->lock_failed = true;
+		prm_warn(NULL, "Unable to lock block memory in RAM, "
+			 "using unlocked memory\n");
+	}
+
+	mem->next = alloc->used;
+	alloc->used = mem;
+	iio_mutex_unlock(alloc->lock);
+
+	return mem->ptr;
+}
+
+void iio_block_allocator_free(struct iio_block_allocator *alloc, void *data)
+{
+	struct iio_block_mem *mem, **ptr;
+
+	if (!alloc) {
+		free(data);
+		return;
+	}
+
+	if (!data)
+		return;
+
+	iio_mutex_lock(alloc->lock);
+
+	for (ptr = &alloc->used; *ptr; ptr = &(*ptr)->next) {
+		if ((*ptr)->ptr == data)
+			break;
+	}
+
+	mem = *ptr;
+	if (mem) {
+		*ptr = mem->next;
+
+		if (alloc->nb_pooled < IIO_BLOCK_POOL_SIZE) {
+			mem->next = alloc->pool;
+			alloc->pool = mem;
+			alloc->nb_pooled++;
+			mem = NULL;
+		}
+	}
+
+	iio_mutex_unlock(alloc->lock);
+
+	if (mem)
+		iio_block_mem_release(mem);
+}
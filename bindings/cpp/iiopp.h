@@ -374,6 +374,7 @@ public:
 
     void enqueue(size_t bytes_used, bool cyclic) {impl::check(iio_block_enqueue(p, bytes_used, cyclic), "iio_block_enqueue");}
     void dequeue(bool nonblock) {impl::check(iio_block_dequeue(p, nonblock), "iio_block_dequeue");}
+    int dmabuf_fd() {int fd = iio_block_get_dmabuf_fd(p); if (fd < 0) impl::err(-fd, "iio_block_get_dmabuf_fd"); return fd;}
     Buffer buffer();
 };
 
@@ -438,6 +439,7 @@ public:
     operator iio_stream * () const {return p;}
 
     Block next_block() {return const_cast<iio_block *>(impl::check(iio_stream_get_next_block(p), "iio_stream_get_next_block")); }
+    iio_stream_latency_stats latency_stats() const {iio_stream_latency_stats stats; impl::check(iio_stream_get_latency_stats(p, &stats), "iio_stream_get_latency_stats"); return stats;}
 };
 
 typedef Ptr<Stream, iio_stream, iio_stream_destroy> StreamPtr;
@@ -464,6 +466,8 @@ public:
     operator iio_event_stream * () const {return p;}
 
     Event read(bool nonblock) {iio_event ev; impl::check(iio_event_stream_read(p, &ev, nonblock), "iio_event_stream_read"); return static_cast<Event&>(ev);} // Flawfinder: ignore
+    size_t read_many(iio_event * events, size_t nb, bool nonblock) {ssize_t ret = iio_event_stream_read_many(p, events, nb, nonblock); if (ret < 0) impl::err(static_cast<int>(-ret), "iio_event_stream_read_many"); return static_cast<size_t>(ret);}
+    uint64_t overflows() const {return iio_event_stream_get_overflows(p);}
 };
 
 typedef Ptr<EventStream, iio_event_stream, iio_event_stream_destroy> EventStreamPtr;
@@ -502,7 +506,10 @@ public:
     void disable() {impl::check(iio_buffer_disable(p), "iio_buffer_disable");}
     ChannelsMask channels_mask() {return iio_buffer_get_channels_mask(p);}
     BlockPtr create_block(size_t size) { return BlockPtr{impl::check(iio_buffer_create_block(p, size), "iio_buffer_create_block")}; }
+    BlockPtr create_block_from_memory(void * ptr, size_t size) { return BlockPtr{impl::check(iio_buffer_create_block_from_memory(p, ptr, size), "iio_buffer_create_block_from_memory")}; }
+    BlockPtr create_block_from_dmabuf(int fd, size_t size) { return BlockPtr{impl::check(iio_buffer_create_block_from_dmabuf(p, fd, size), "iio_buffer_create_block_from_dmabuf")}; }
     StreamPtr create_stream(size_t nb_blocks, size_t sample_count) { return StreamPtr{impl::check(iio_buffer_create_stream(p, nb_blocks, sample_count), "iio_buffer_create_stream")}; }
+    StreamPtr create_low_latency_stream(uint64_t latency_us, double sample_rate = 0.0) { return StreamPtr{impl::check(iio_buffer_create_low_latency_stream(p, latency_us, sample_rate), "iio_buffer_create_low_latency_stream")}; }
 };
 
 typedef Ptr<Buffer, iio_buffer, iio_buffer_destroy> BufferPtr;
@@ -21,6 +21,9 @@ struct iio_block {
 
 	struct iio_task_token *token;
 	size_t bytes_used;
+
+	/* Set if the data belongs to the application */
+	bool user_memory;
 };
 
 struct iio_block *
@@ -51,7 +54,7 @@ iio_buffer_create_block(struct iio_buffer *buf, size_t size)
 	}
 
 	if (!block->pdata) {
-		block->data = malloc(size);
+		block->data = iio_block_allocator_alloc(buf->allocator, size);
 		if (!block->data) {
 			ret = -ENOMEM;
 			goto err_free_block;
@@ -77,6 +80,99 @@ err_free_block:
 	return iio_ptr(ret);
 }
 
+struct iio_block *
+iio_buffer_create_block_from_dmabuf(struct iio_buffer *buf, int fd, size_t size)
+{
+	const struct iio_device *dev = buf->dev;
+	const struct iio_backend_ops *ops = dev->ctx->ops;
+	struct iio_block_pdata *pdata;
+	size_t sample_size;
+	struct iio_block *block;
+	int ret;
+
+	sample_size = iio_device_get_sample_size(dev, buf->mask);
+	if (sample_size == 0 || size < sample_size || fd < 0)
+		return iio_ptr(-EINVAL);
+
+	if (!ops->create_block_from_dmabuf)
+		return iio_ptr(-ENOSYS);
+
+	block = zalloc(sizeof(*block));
+	if (!block)
+		return iio_ptr(-ENOMEM);
+
+	pdata = ops->create_block_from_dmabuf(buf->pdata, fd, size,
+					      &block->data);
+	ret = iio_err(pdata);
+	if (ret) {
+		free(block);
+		return iio_ptr(ret);
+	}
+
+	block->pdata = pdata;
+	block->buffer = buf;
+	block->size = size;
+
+	iio_mutex_lock(buf->lock);
+	buf->nb_blocks++;
+	iio_mutex_unlock(buf->lock);
+
+	return block;
+}
+
+struct iio_block *
+iio_buffer_create_block_from_memory(struct iio_buffer *buf,
+				    void *ptr, size_t size)
+{
+	const struct iio_device *dev = buf->dev;
+	const struct iio_backend_ops *ops = dev->ctx->ops;
+	struct iio_block_pdata *pdata;
+	size_t sample_size;
+	struct iio_block *block;
+	int ret;
+
+	sample_size = iio_device_get_sample_size(dev, buf->mask);
+	if (sample_size == 0 || size < sample_size || !ptr)
+		return iio_ptr(-EINVAL);
+
+	block = zalloc(sizeof(*block));
+	if (!block)
+		return iio_ptr(-ENOMEM);
+
+	if (ops->create_block_from_memory) {
+		pdata = ops->create_block_from_memory(buf->pdata, ptr, size);
+		ret = iio_err(pdata);
+		if (!ret)
+			block->pdata = pdata;
+		else if (ret != -ENOSYS)
+			goto err_free_block;
+	}
+
+	if (!block->pdata) {
+		/* Transfers go through readbuf / writebuf, straight to or
+		 * from the application's memory. */
+		if (size > buf->length)
+		      buf->length = size;
+
+		buf->block_size = size;
+	}
+
+	block->buffer = buf;
+	block->data = ptr;
+	block->size = size;
+	block->user_memory = true;
+
+	iio_mutex_lock(buf->lock);
+	buf->nb_blocks++;
+	iio_mutex_unlock(buf->lock);
+
+	return block;
+
+err_free_block:
+	free(block);
+	return iio_ptr(ret);
+}
+
 void iio_block_destroy(struct iio_block *block)
 {
 	struct iio_buffer *buf = block->buffer;
@@ -88,8 +184,8 @@ void iio_block_destroy(struct iio_block *block)
 	}
 	if (ops->free_block && block->pdata)
 		ops->free_block(block->pdata);
-	else
-		free(block->data);
+	else if (!block->user_memory)
+		iio_block_allocator_free(buf->allocator, block->data);
 	free(block);
 
 	iio_mutex_lock(buf->lock);
@@ -193,6 +289,10 @@ void *iio_block_start(const struct iio_block *block)
 
 void *iio_block_end(const struct iio_block *block)
 {
+	/* Blocks backed by a DMABUF that cannot be mapped */
+	if (!block->data)
+		return NULL;
+
 	return (void *) ((uintptr_t) block->data + block->size);
 }
 
@@ -206,6 +306,9 @@ void *iio_block_first(const struct iio_block *block,
 	unsigned int i;
 	size_t len;
 
+	if (!block->data)
+		return NULL;
+
 	/* Test if the block has samples for this channel */
 	if (!iio_channels_mask_test_bit(buf->mask, chn->number))
 		return iio_block_end(block);
@@ -251,6 +354,9 @@ iio_block_foreach_sample(const struct iio_block *block,
 	size_t sample_size;
 	ssize_t processed = 0;
 
+	if (!block->data)
+		return -ENOSYS;
+
 	sample_size = iio_device_get_sample_size(dev, buf->mask);
 	if (sample_size == 0)
 		return -EINVAL;
@@ -295,3 +401,13 @@ struct iio_buffer * iio_block_get_buffer(const struct iio_block *block)
 {
 	return block->buffer;
 }
+
+int iio_block_get_dmabuf_fd(const struct iio_block *block)
+{
+	const struct iio_backend_ops *ops = block->buffer->dev->ctx->ops;
+
+	if (!ops->get_dmabuf_fd || !block->pdata)
+		return -EINVAL;
+
+	return ops->get_dmabuf_fd(block->pdata);
+}
@@ -34,11 +34,12 @@ void iio_buffer_cancel(struct iio_buffer *buf)
 {
 	const struct iio_backend_ops *ops = buf->dev->ctx->ops;
 
-	iio_task_stop(buf->worker);
-
+	/* Abort the transfer in progress first, as stopping the worker waits
+	 * for it to complete. */
 	if (ops->cancel_buffer)
 		ops->cancel_buffer(buf->pdata);
 
+	iio_task_stop(buf->worker);
 	iio_task_flush(buf->worker);
 }
 
@@ -161,13 +162,23 @@ iio_device_create_buffer(const struct iio_device *dev, unsigned int idx,
 	if (err < 0)
 		goto err_free_mutex;
 
+	buf->allocator = iio_block_allocator_create();
+	err = iio_err(buf->allocator);
+	if (err < 0)
+		goto err_destroy_worker;
+
 	buf->pdata = ops->create_buffer(dev, idx, buf->mask);
 	err = iio_err(buf->pdata);
 	if (err < 0)
-		goto err_destroy_worker;
+		goto err_destroy_allocator;
+
+	if (ops->set_block_allocator)
+		ops->set_block_allocator(buf->pdata, buf->allocator);
 
 	return buf;
 
+err_destroy_allocator:
+	iio_block_allocator_destroy(buf->allocator);
 err_destroy_worker:
 	iio_task_destroy(buf->worker);
 err_free_mutex:
@@ -192,6 +203,7 @@ void iio_buffer_destroy(struct iio_buffer *buf)
 	if (ops->free_buffer)
 		ops->free_buffer(buf->pdata);
 
+	iio_block_allocator_destroy(buf->allocator);
 	iio_task_destroy(buf->worker);
 	iio_mutex_destroy(buf->lock);
 	iio_channels_mask_destroy(buf->mask);
@@ -199,6 +211,11 @@ void iio_buffer_destroy(struct iio_buffer *buf)
 	free(buf);
 }
 
+int iio_buffer_set_block_alloc_flags(struct iio_buffer *buf, unsigned int flags)
+{
+	return iio_block_allocator_set_flags(buf->allocator, flags);
+}
+
 const struct iio_channels_mask *
 iio_buffer_get_channels_mask(const struct iio_buffer *buf)
 {
@@ -242,27 +242,39 @@ static ssize_t iio_snprintf_chan_attr_xml(const struct iio_attr *attr,
 }
 
 static ssize_t iio_snprintf_scan_element_xml(char *str, ssize_t len,
-					     const struct iio_channel *chn)
+					     const struct iio_channel *chn,
+					     const struct iio_scale_offset *so)
 {
 	char processed = (chn->format.is_fully_defined ? 'A' - 'a' : 0);
-	char repeat[12] = "", scale[48] = "";
+	char repeat[12] = "", scale[48] = "", offset[48] = "";
 
 	if (chn->format.repeat > 1)
 		iio_snprintf(repeat, sizeof(repeat), "X%u", chn->format.repeat);
 
-	if (chn->format.with_scale)
-		iio_snprintf(scale, sizeof(scale), "scale=\"%f\" ", chn->format.scale);
+	if (so->known) {
+		/* Clients use these values as-is instead of reading the
+		 * attributes, so print them with full precision. */
+		if (so->with_scale)
+			iio_snprintf(scale, sizeof(scale), "scale=\"%.17g\" ",
+				     so->scale);
+
+		iio_snprintf(offset, sizeof(offset), "offset=\"%.17g\" ",
+			     so->offset);
+	} else if (so->with_scale) {
+		iio_snprintf(scale, sizeof(scale), "scale=\"%f\" ", so->scale);
+	}
 
 	return iio_snprintf(str, len,
-			"<scan-element index=\"%li\" format=\"%ce:%c%u/%u%s&gt;&gt;%u\" %s/>",
+			"<scan-element index=\"%li\" format=\"%ce:%c%u/%u%s&gt;&gt;%u\" %s%s/>",
 			chn->index, chn->format.is_be ? 'b' : 'l',
 			chn->format.is_signed ? 's' + processed : 'u' + processed,
 			chn->format.bits, chn->format.length, repeat,
-			chn->format.shift, scale);
+			chn->format.shift, scale, offset);
 }
 
 ssize_t iio_snprintf_channel_xml(char *ptr, ssize_t len,
-				 const struct iio_channel *chn)
+				 const struct iio_channel *chn,
+				 const struct iio_scale_offset *so)
 {
 	ssize_t ret, alen = 0;
 	unsigned int i;
@@ -281,13 +293,32 @@ ssize_t iio_snprintf_channel_xml(char *ptr, ssize_t len,
 		iio_update_xml_indexes(ret, &ptr, &len, &alen);
 	}
 
+	/* Channels which are not scan elements carry their scale and offset
+	 * in the <channel> element itself */
+	if (!chn->is_scan_element && so->known
+	    && (so->with_scale || iio_channel_find_attr(chn, "offset"))) {
+		if (so->with_scale) {
+			ret = iio_snprintf(ptr, len, " scale=\"%.17g\"",
+					   so->scale);
+			if (ret < 0)
+				return ret;
+			iio_update_xml_indexes(ret, &ptr, &len, &alen);
+		}
+
+		ret = iio_snprintf(ptr, len, " offset=\"%.17g\"",
+				   so->offset);
+		if (ret < 0)
+			return ret;
+		iio_update_xml_indexes(ret, &ptr, &len, &alen);
+	}
+
 	ret = iio_snprintf(ptr, len, " type=\"%s\" >", chn->is_output ? "output" : "input");
 	if (ret < 0)
 		return ret;
 	iio_update_xml_indexes(ret, &ptr, &len, &alen);
 
 	if (chn->is_scan_element) {
-		ret = iio_snprintf_scan_element_xml(ptr, len, chn);
+		ret = iio_snprintf_scan_element_xml(ptr, len, chn, so);
 		if (ret < 0)
 			return ret;
 		iio_update_xml_indexes(ret, &ptr, &len, &alen);
@@ -675,3 +706,9 @@ void iio_channel_set_pdata(struct iio_channel *chn, struct iio_channel_pdata *d)
 {
 	chn->pdata = d;
 }
+
+void iio_channel_set_scale_offset_known(struct iio_channel *chn)
+{
+	chn->scale_offset_known = true;
+	chn->scale_offset_from_desc = true;
+}
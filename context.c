@@ -14,6 +14,7 @@
 #include <iio/iio-debug.h>
 
 #include <errno.h>
+#include <stddef.h>
 #include <string.h>
 
 static const char xml_header[] = "<?xml version=\"1.0\" encoding=\"utf-8\"?>"
@@ -30,13 +31,19 @@ static const char xml_header[] = "<?xml version=\"1.0\" encoding=\"utf-8\"?>"
 "version-minor CDATA #REQUIRED version-git CDATA #REQUIRED description CDATA #IMPLIED>"
 "<!ATTLIST context-attribute name CDATA #REQUIRED value CDATA #REQUIRED>"
 "<!ATTLIST device id CDATA #REQUIRED name CDATA #IMPLIED label CDATA #IMPLIED>"
-"<!ATTLIST channel id CDATA #REQUIRED type (input|output) #REQUIRED name CDATA #IMPLIED>"
-"<!ATTLIST scan-element index CDATA #REQUIRED format CDATA #REQUIRED scale CDATA #IMPLIED>"
+"<!ATTLIST channel id CDATA #REQUIRED type (input|output) #REQUIRED name CDATA #IMPLIED scale CDATA #IMPLIED offset CDATA #IMPLIED>"
+"<!ATTLIST scan-element index CDATA #REQUIRED format CDATA #REQUIRED scale CDATA #IMPLIED offset CDATA #IMPLIED>"
 "<!ATTLIST attribute name CDATA #REQUIRED filename CDATA #IMPLIED>"
 "<!ATTLIST debug-attribute name CDATA #REQUIRED>"
 "<!ATTLIST buffer-attribute name CDATA #REQUIRED>"
 "]>";
 
+/* New fields of iio_context_params are taken from the reserved space, so that
+ * the size of the structure never changes. */
+_Static_assert(sizeof(struct iio_context_params) ==
+	       offsetof(struct iio_context_params, cache_dir) + 32,
+	       "struct iio_context_params changed size");
+
 static const struct iio_context_params default_params = {
 	.timeout_ms = 0,
 
@@ -116,7 +123,8 @@ ssize_t iio_xml_print_and_sanitized_param(char *ptr, ssize_t len,
 }
 
 static ssize_t iio_snprintf_context_xml(char *ptr, ssize_t len,
-					const struct iio_context *ctx)
+					const struct iio_context *ctx,
+					const struct iio_scale_offset *so)
 {
 	ssize_t ret, alen = 0;
 	unsigned int i;
@@ -166,11 +174,12 @@ static ssize_t iio_snprintf_context_xml(char *ptr, ssize_t len,
 	}
 
 	for (i = 0; i < ctx->nb_devices; i++) {
-		ret = iio_snprintf_device_xml(ptr, len, ctx->devices[i]);
+		ret = iio_snprintf_device_xml(ptr, len, ctx->devices[i], so);
 		if (ret < 0)
 			return ret;
 
 		iio_update_xml_indexes(ret, &ptr, &len, &alen);
+		so += ctx->devices[i]->nb_channels;
 	}
 
 	ret = iio_snprintf(ptr, len, "</context>");
@@ -180,27 +189,75 @@ static ssize_t iio_snprintf_context_xml(char *ptr, ssize_t len,
 	return alen + ret;
 }
 
+static void iio_channel_get_scale_offset(const struct iio_channel *chn,
+					 struct iio_scale_offset *so)
+{
+	const struct iio_attr *attr;
+	double value;
+
+	so->scale = chn->format.scale;
+	so->offset = chn->format.offset;
+	so->with_scale = chn->format.with_scale;
+	so->known = chn->scale_offset_known;
+
+	/* Values read from the attributes may have changed since; read them
+	 * again, without updating the channel, as it may be in use. */
+	if (!chn->scale_offset_known || chn->scale_offset_from_desc)
+		return;
+
+	attr = iio_channel_find_attr(chn, "scale");
+	if (attr && !iio_attr_read_double(attr, &value)) {
+		so->scale = value;
+		so->with_scale = true;
+	}
+
+	attr = iio_channel_find_attr(chn, "offset");
+	if (attr && !iio_attr_read_double(attr, &value))
+		so->offset = value;
+}
+
 /* Returns a string containing the XML representation of this context */
 char * iio_context_get_xml(const struct iio_context *ctx)
 {
+	struct iio_scale_offset *so;
+	unsigned int i, j, nb = 0;
 	ssize_t len;
 	char *str;
 
-	len = iio_snprintf_context_xml(NULL, 0, ctx);
-	if (len < 0)
-		return iio_ptr((int) len);
+	for (i = 0; i < ctx->nb_devices; i++)
+		nb += ctx->devices[i]->nb_channels;
+
+	so = calloc(nb ? nb : 1, sizeof(*so));
+	if (!so)
+		return iio_ptr(-ENOMEM);
+
+	for (i = 0, nb = 0; i < ctx->nb_devices; i++) {
+		for (j = 0; j < ctx->devices[i]->nb_channels; j++)
+			iio_channel_get_scale_offset(ctx->devices[i]->channels[j],
+						     &so[nb++]);
+	}
+
+	len = iio_snprintf_context_xml(NULL, 0, ctx, so);
+	if (len < 0) {
+		str = iio_ptr((int) len);
+		goto out_free_so;
+	}
 
 	len++; /* room for terminating NULL */
 	str = malloc(len);
-	if (!str)
-		return iio_ptr(-ENOMEM);
+	if (!str) {
+		str = iio_ptr(-ENOMEM);
+		goto out_free_so;
+	}
 
-	len = iio_snprintf_context_xml(str, len, ctx);
+	len = iio_snprintf_context_xml(str, len, ctx, so);
 	if (len < 0) {
 		free(str);
-		return iio_ptr((int) len);
+		str = iio_ptr((int) len);
 	}
 
+out_free_so:
+	free(so);
 	return str;
 }
 
@@ -399,6 +456,8 @@ const struct iio_backend * const iio_backends[] = {
 	IF_ENABLED(WITH_USB_BACKEND && !WITH_USB_BACKEND_DYNAMIC,
 		   &iio_usb_backend),
 	IF_ENABLED(WITH_XML_BACKEND, &iio_xml_backend),
+	IF_ENABLED(WITH_REPLAY_BACKEND, &iio_replay_backend),
+	IF_ENABLED(WITH_SIGGEN_BACKEND, &iio_siggen_backend),
 	IF_ENABLED(WITH_EXTERNAL_BACKEND, &iio_external_backend),
 };
 const unsigned int iio_backends_size = ARRAY_SIZE(iio_backends);
@@ -420,6 +479,10 @@ static int iio_context_update_scale_offset(struct iio_context *ctx)
 		for (j = 0; j < dev->nb_channels; j++) {
 			chn = dev->channels[j];
 
+			/* Already provided by the context description */
+			if (chn->scale_offset_known)
+				continue;
+
 			attr = iio_channel_find_attr(chn, "scale");
 			if (attr) {
 				err = iio_attr_read_double(attr,
@@ -441,6 +504,8 @@ static int iio_context_update_scale_offset(struct iio_context *ctx)
 					return err;
 				}
 			}
+
+			chn->scale_offset_known = true;
 		}
 	}
 
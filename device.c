@@ -39,7 +39,8 @@ static ssize_t iio_snprintf_xml_attr(const struct iio_attr *attr,
 }
 
 ssize_t iio_snprintf_device_xml(char *ptr, ssize_t len,
-				const struct iio_device *dev)
+				const struct iio_device *dev,
+				const struct iio_scale_offset *so)
 {
 	const struct iio_attr *attrs;
 	ssize_t ret, alen = 0;
@@ -74,7 +75,8 @@ ssize_t iio_snprintf_device_xml(char *ptr, ssize_t len,
 	iio_update_xml_indexes(ret, &ptr, &len, &alen);
 
 	for (i = 0; i < dev->nb_channels; i++) {
-		ret = iio_snprintf_channel_xml(ptr, len, dev->channels[i]);
+		ret = iio_snprintf_channel_xml(ptr, len, dev->channels[i],
+					       &so[i]);
 		if (ret < 0)
 			return ret;
 
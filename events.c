@@ -142,3 +142,43 @@ int iio_event_stream_read(struct iio_event_stream *stream,
 
 	return stream->dev->ctx->ops->read_ev(stream->pdata, out_event, nonblock);
 }
+
+ssize_t iio_event_stream_read_many(struct iio_event_stream *stream,
+				   struct iio_event *events, size_t nb,
+				   bool nonblock)
+{
+	const struct iio_backend_ops *ops = stream->dev->ctx->ops;
+	size_t i;
+	int ret;
+
+	if (!events || !nb)
+		return -EINVAL;
+
+	if (ops->read_ev_many)
+		return ops->read_ev_many(stream->pdata, events, nb, nonblock);
+
+	if (!ops->read_ev)
+		return -ENOSYS;
+
+	ret = ops->read_ev(stream->pdata, &events[0], nonblock);
+	if (ret < 0)
+		return ret;
+
+	/* Only get the events that are already available */
+	for (i = 1; i < nb; i++) {
+		if (ops->read_ev(stream->pdata, &events[i], true) < 0)
+			break;
+	}
+
+	return (ssize_t) i;
+}
+
+uint64_t iio_event_stream_get_overflows(const struct iio_event_stream *stream)
+{
+	const struct iio_backend_ops *ops = stream->dev->ctx->ops;
+
+	if (!ops->get_ev_overflows)
+		return 0;
+
+	return ops->get_ev_overflows(stream->pdata);
+}
@@ -117,6 +117,19 @@ struct iio_channel {
 	struct iio_attr_list attrlist;
 
 	unsigned int number;
+
+	/* The scale and offset of the format are up to date */
+	bool scale_offset_known;
+
+	/* The scale and offset were provided by the backend, and not read
+	 * from the attributes */
+	bool scale_offset_from_desc;
+};
+
+/* Scale and offset of a channel, as printed in the XML description */
+struct iio_scale_offset {
+	double scale, offset;
+	bool with_scale, known;
 };
 
 struct iio_device {
@@ -154,6 +167,8 @@ struct iio_buffer {
 	/* Mutex to protect nb_blocks. Should really be an atomic... */
 	struct iio_mutex *lock;
 	unsigned int nb_blocks;
+
+	struct iio_block_allocator *allocator;
 };
 
 struct iio_context_info {
@@ -198,9 +213,11 @@ void free_channel(struct iio_channel *chn);
 void free_device(struct iio_device *dev);
 
 ssize_t iio_snprintf_channel_xml(char *str, ssize_t slen,
-				 const struct iio_channel *chn);
+				 const struct iio_channel *chn,
+				 const struct iio_scale_offset *so);
 ssize_t iio_snprintf_device_xml(char *str, ssize_t slen,
-				const struct iio_device *dev);
+				const struct iio_device *dev,
+				const struct iio_scale_offset *so);
 
 int iio_context_init(struct iio_context *ctx);
 
@@ -225,11 +242,23 @@ char *iio_strtok_r(char *str, const char *delim, char **saveptr);
 char * iio_getenv (char * envvar);
 uint64_t iio_read_counter_us(void);
 
+struct iio_block_allocator * iio_block_allocator_create(void);
+void iio_block_allocator_destroy(struct iio_block_allocator *alloc);
+int iio_block_allocator_set_flags(struct iio_block_allocator *alloc,
+				  unsigned int flags);
+
+struct iio_pacer * iio_pacer_create(void);
+void iio_pacer_destroy(struct iio_pacer *pacer);
+void iio_pacer_cancel(struct iio_pacer *pacer);
+int iio_pacer_wait(struct iio_pacer *pacer, uint64_t deadline);
+
 __cnst const struct iio_context_params *get_default_params(void);
 
 extern const struct iio_backend iio_ip_backend;
 extern const struct iio_backend iio_local_backend;
+extern const struct iio_backend iio_replay_backend;
 extern const struct iio_backend iio_serial_backend;
+extern const struct iio_backend iio_siggen_backend;
 extern const struct iio_backend iio_usb_backend;
 extern const struct iio_backend iio_xml_backend;
 
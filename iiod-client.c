@@ -27,10 +27,15 @@ struct iiod_client {
 	const struct iio_context_params *params;
 	struct iiod_client_pdata *desc;
 	const struct iiod_client_ops *ops;
+	unsigned int flags;
 	struct iio_mutex *lock;
 
 	struct iiod_responder *responder;
 
+	/* I/O of the IIOD_OP_SET_FEATURES command, whose response is only
+	 * collected once the next command completed */
+	struct iiod_io *features_io;
+
 	/* TODO: atomic? */
 	uint16_t next_evstream_idx;
 };
@@ -57,11 +62,21 @@ struct iiod_client_buffer_pdata {
 
 	/* TODO: atomic? */
 	uint16_t next_block_idx;
+
+	/* Clients over which the blocks are spread */
+	struct iiod_client *stripes[IIOD_CLIENT_MAX_STRIPES];
+	unsigned int nb_stripes;
+
+	struct iio_block_allocator *allocator;
 };
 
 struct iio_block_pdata {
 	struct iiod_client_buffer_pdata *buffer;
-	struct iiod_io *io;
+
+	/* "io" receives the responses, on the connection the block was
+	 * created on; "cmd_io" sends the commands, on the buffer's one.
+	 * They are the same unless the buffer is striped. */
+	struct iiod_io *io, *cmd_io;
 
 	struct iio_mutex *lock;
 
@@ -72,14 +87,34 @@ struct iio_block_pdata {
 	void *data;
 	bool enqueued;
 	bool retry_dequeue;
+
+	/* Set if the data belongs to the application */
+	bool user_memory;
 };
 
+/* Max. number of events pushed by the server that are kept until read */
+#define IIOD_EVENT_QUEUE_SIZE 1024
+
 struct iio_event_stream_pdata {
 	struct iiod_client *client;
 	const struct iio_device *dev;
-	struct iio_event event;
 	struct iiod_io *io;
 	uint16_t idx;
+
+	/* Events received from the server, not yet read by the application */
+	struct iio_event events[IIOD_READ_EVENTS_MAX];
+	unsigned int nb_events, next_event;
+
+	/* Subscribed streams: the events pushed by the server are moved from
+	 * the array above to this queue, protected by the lock. The events
+	 * that do not fit are dropped and counted. */
+	bool push, subscribed;
+	struct iio_mutex *lock;
+	struct iio_cond *cond;
+	struct iio_event *queue;
+	unsigned int q_first, q_count;
+	uint64_t overflows;
+	int err;
 };
 
 void iiod_client_mutex_lock(struct iiod_client *client)
@@ -250,15 +285,77 @@ static ssize_t iiod_client_read_all(struct iiod_client *client,
 	return (ssize_t) (ptr - (uintptr_t) dst);
 }
 
+static int iiod_client_set_features(struct iiod_client *client)
+{
+	struct iiod_command cmd = { .op = IIOD_OP_SET_FEATURES };
+	struct iiod_io *io;
+	int ret;
+
+	/* Only servers that advertised optional features know about
+	 * the IIOD_OP_SET_FEATURES opcode. */
+	if (!iiod_client_uses_binary_interface(client)
+	    || !iiod_responder_get_features(client->responder))
+		return 0;
+
+	cmd.code = IIOD_FEATURES_SUPPORTED;
+
+	/* The server answers on the default I/O (ID 0). Responses with the
+	 * same ID are matched to the waiting I/Os in order, so using a second
+	 * I/O with that ID allows the next command to be sent right away,
+	 * without waiting for this one's response. */
+	io = iiod_responder_create_io(client->responder, 0);
+	ret = iio_err(io);
+	if (ret)
+		return ret;
+
+	ret = iiod_io_get_response_async(io, NULL, 0);
+	if (ret < 0)
+		goto err_unref_io;
+
+	ret = iiod_io_send_command(io, &cmd, NULL, 0);
+	if (ret < 0) {
+		iiod_io_cancel(io);
+		goto err_unref_io;
+	}
+
+	client->features_io = io;
+
+	return 0;
+
+err_unref_io:
+	iiod_io_unref(io);
+	return ret;
+}
+
+static void iiod_client_put_features_io(struct iiod_client *client)
+{
+	int ret;
+
+	if (!client->features_io)
+		return;
+
+	if (iiod_io_has_response(client->features_io)) {
+		ret = iiod_io_wait_for_response(client->features_io);
+		if (ret < 0)
+			prm_perror(client->params, ret, "Unable to set features");
+	} else {
+		iiod_io_cancel(client->features_io);
+	}
+
+	iiod_io_unref(client->features_io);
+	client->features_io = NULL;
+}
+
 static void iiod_client_cancel(struct iiod_client *client)
 {
 	if (client->ops->cancel)
 		client->ops->cancel(client->desc);
 }
 
-struct iiod_client * iiod_client_new(const struct iio_context_params *params,
-				     struct iiod_client_pdata *desc,
-				     const struct iiod_client_ops *ops)
+struct iiod_client *
+iiod_client_new_flags(const struct iio_context_params *params,
+		      struct iiod_client_pdata *desc,
+		      const struct iiod_client_ops *ops, unsigned int flags)
 {
 	struct iiod_client *client;
 	int err;
@@ -274,8 +371,10 @@ struct iiod_client * iiod_client_new(const struct iio_context_params *params,
 
 	client->params = params;
 	client->ops = ops;
+	client->flags = flags;
 	client->desc = desc;
 	client->responder = NULL;
+	client->features_io = NULL;
 	client->next_evstream_idx = (uint16_t)-1;
 
 	err = iiod_client_enable_binary(client);
@@ -286,10 +385,15 @@ struct iiod_client * iiod_client_new(const struct iio_context_params *params,
 	if (err)
 		goto err_free_responder;
 
+	err = iiod_client_set_features(client);
+	if (err)
+		goto err_free_responder;
+
 	return client;
 
 err_free_responder:
 	if (client->responder) {
+		iiod_client_put_features_io(client);
 		iiod_client_cancel(client);
 		iiod_responder_destroy(client->responder);
 	}
@@ -300,9 +404,17 @@ err_free_client:
 	return iio_ptr(err);
 }
 
+struct iiod_client * iiod_client_new(const struct iio_context_params *params,
+				     struct iiod_client_pdata *desc,
+				     const struct iiod_client_ops *ops)
+{
+	return iiod_client_new_flags(params, desc, ops, 0);
+}
+
 void iiod_client_destroy(struct iiod_client *client)
 {
 	if (client->responder) {
+		iiod_client_put_features_io(client);
 		iiod_client_cancel(client);
 		iiod_responder_destroy(client->responder);
 	}
@@ -460,10 +572,18 @@ int iiod_client_set_timeout(struct iiod_client *client, unsigned int timeout)
 		iiod_responder_set_timeout(client->responder, timeout);
 
 		cmd.op = IIOD_OP_TIMEOUT;
+		cmd.dev = 0;
 		cmd.code = remote_timeout;
 
 		io = iiod_responder_get_default_io(client->responder);
 		ret = iiod_io_exec_simple_command(io, &cmd);
+
+		/* The server advertises its optional features in the
+		 * response; older servers leave the field to zero. */
+		if (ret >= 0) {
+			iiod_responder_set_features(client->responder,
+						    iiod_io_get_response_flags(io));
+		}
 	} else {
 		char buf[1024];
 
@@ -865,13 +985,31 @@ iiod_client_read_cb(void *d, const struct iiod_buf *buf, size_t nb)
 	return count;
 }
 
+/* Up to this many bytes of consecutive small buffers are gathered into a
+ * single write, on transports that are byte streams. */
+#define IIOD_CLIENT_GATHER_SIZE 4096
+
 static ssize_t
 iiod_client_write_cb(void *d, const struct iiod_buf *buf, size_t nb)
 {
 	struct iiod_client *client = d;
+	char gather[IIOD_CLIENT_GATHER_SIZE];
 	ssize_t ret, count = 0;
+	size_t len = 0;
 	unsigned int i;
 
+	/* Transports that support partial reads have no message boundaries,
+	 * so the buffers can be merged without the remote noticing. */
+	if (nb > 1 && (client->flags & IIOD_CLIENT_READ_PARTIAL)) {
+		for (i = 0; i < nb && len + buf[i].size <= sizeof(gather); i++) {
+			memcpy(gather + len, buf[i].ptr, buf[i].size);
+			len += buf[i].size;
+		}
+
+		if (i > 1)
+			return iiod_client_write_all(client, gather, len);
+	}
+
 	for (i = 0; i < nb; i++) {
 		ret = iiod_client_write_all(client, buf[i].ptr, buf[i].size);
 		if (ret <= 0)
@@ -896,6 +1034,18 @@ static ssize_t iiod_client_discard_cb(void *d, size_t bytes)
 	return bytes;
 }
 
+static ssize_t iiod_client_read_partial_cb(void *d, const struct iiod_buf *buf)
+{
+	struct iiod_client *client = d;
+	ssize_t ret;
+
+	do {
+		ret = client->ops->read(client->desc, buf->ptr, buf->size, 0);
+	} while (ret == -EINTR);
+
+	return ret ? ret : -EPIPE;
+}
+
 static const struct iiod_responder_ops iiod_client_ops = {
 	.cmd		= iiod_client_cmd,
 	.read		= iiod_client_read_cb,
@@ -903,8 +1053,17 @@ static const struct iiod_responder_ops iiod_client_ops = {
 	.discard	= iiod_client_discard_cb,
 };
 
+static const struct iiod_responder_ops iiod_client_readahead_ops = {
+	.cmd		= iiod_client_cmd,
+	.read		= iiod_client_read_cb,
+	.write		= iiod_client_write_cb,
+	.discard	= iiod_client_discard_cb,
+	.read_partial	= iiod_client_read_partial_cb,
+};
+
 static int iiod_client_enable_binary(struct iiod_client *client)
 {
+	const struct iiod_responder_ops *ops;
 	int ret;
 
 	ret = iiod_client_exec_command(client, "BINARY\r\n");
@@ -913,7 +1072,12 @@ static int iiod_client_enable_binary(struct iiod_client *client)
 	if (ret != 0)
 		return 0;
 
-	client->responder = iiod_responder_create(&iiod_client_ops, client);
+	if (client->flags & IIOD_CLIENT_READ_PARTIAL)
+		ops = &iiod_client_readahead_ops;
+	else
+		ops = &iiod_client_ops;
+
+	client->responder = iiod_responder_create(ops, client);
 	if (!client->responder) {
 		prm_err(client->params, "Unable to create responder\n");
 		return -ENOMEM;
@@ -933,22 +1097,15 @@ static int iiod_client_send_print(struct iiod_client *client,
 	return iiod_io_exec_command(io, &cmd, NULL, &iiod_buf);
 }
 
-static struct iio_context *
-iiod_client_create_context_private_new(struct iiod_client *client,
-				       const struct iio_backend *backend,
-				       const char *description,
-				       const char **ctx_attrs,
-				       const char **ctx_values,
-				       unsigned int nb_ctx_attrs)
+static char * iiod_client_fetch_xml(struct iiod_client *client)
 {
 	size_t xml_len = 0x10000, uri_len = sizeof("xml:") - 1;
-	struct iio_context *ctx = NULL;
 	unsigned long long len;
 	char *xml_zstd, *xml;
 	bool is_zstd;
 	int ret;
 
-	xml = malloc(xml_len + uri_len);
+	xml = malloc(xml_len + uri_len + 1);
 	if (!xml)
 		return iio_ptr(-ENOMEM);
 
@@ -969,37 +1126,207 @@ iiod_client_create_context_private_new(struct iiod_client *client,
 	else
 		prm_dbg(client->params, "Received uncompressed XML string.\n");
 
-	if (is_zstd) {
-		len = ZSTD_getFrameContentSize(&xml[uri_len], xml_len);
-		if (len == ZSTD_CONTENTSIZE_UNKNOWN ||
-		    len == ZSTD_CONTENTSIZE_ERROR) {
-			ret = -EIO;
-			goto out_free_xml;
-		}
+	if (!is_zstd) {
+		xml[uri_len + xml_len] = '\0';
+		return xml;
+	}
 
-		xml_zstd = malloc(uri_len + len + 1);
-		if (!xml_zstd) {
-			ret = -ENOMEM;
-			goto out_free_xml;
-		}
+	len = ZSTD_getFrameContentSize(&xml[uri_len], xml_len);
+	if (len == ZSTD_CONTENTSIZE_UNKNOWN ||
+	    len == ZSTD_CONTENTSIZE_ERROR) {
+		ret = -EIO;
+		goto out_free_xml;
+	}
 
-		xml_len = ZSTD_decompress(&xml_zstd[uri_len], len, &xml[uri_len], xml_len);
-		if (ZSTD_isError(xml_len)) {
-			prm_err(client->params, "Unable to decompress ZSTD data: %s\n",
-				ZSTD_getErrorName(xml_len));
-			ret = -EIO;
-			free(xml_zstd);
-			goto out_free_xml;
+	xml_zstd = malloc(uri_len + len + 1);
+	if (!xml_zstd) {
+		ret = -ENOMEM;
+		goto out_free_xml;
+	}
+
+	xml_len = ZSTD_decompress(&xml_zstd[uri_len], len, &xml[uri_len], xml_len);
+	if (ZSTD_isError(xml_len)) {
+		prm_err(client->params, "Unable to decompress ZSTD data: %s\n",
+			ZSTD_getErrorName(xml_len));
+		ret = -EIO;
+		free(xml_zstd);
+		goto out_free_xml;
+	}
+
+	memcpy(xml_zstd, "xml:", uri_len);
+	xml_zstd[uri_len + xml_len] = '\0';
+
+	/* Free compressed data, return uncompressed data */
+	free(xml);
+	return xml_zstd;
+
+out_free_xml:
+	free(xml);
+	return iio_ptr(ret);
+}
+
+/* Get the path of the cache file for the current context description, based
+ * on the hash advertised by the server and the URI of the context. Returns
+ * NULL if the cache cannot be used. */
+static char *
+iiod_client_get_cache_path(struct iiod_client *client,
+			   const char **ctx_attrs, const char **ctx_values,
+			   unsigned int nb_ctx_attrs)
+{
+	const char *cache_dir = client->params->cache_dir;
+	struct iiod_io *io = iiod_responder_get_default_io(client->responder);
+	struct iiod_command cmd = { .op = IIOD_OP_PRINT_HASH };
+	char hash[17], *path;
+	struct iiod_buf buf = { .ptr = hash, .size = sizeof(hash) - 1 };
+	const char *uri = "";
+	unsigned int i;
+	size_t len;
+	int ret;
+
+	if (!cache_dir || !(iiod_responder_get_features(client->responder)
+			    & IIOD_FEATURE_CONTEXT_HASH))
+		return NULL;
+
+	ret = iiod_io_exec_command(io, &cmd, NULL, &buf);
+	if (ret != (int) sizeof(hash) - 1) {
+		prm_dbg(client->params, "Unable to get context hash: %d\n", ret);
+		return NULL;
+	}
+
+	hash[sizeof(hash) - 1] = '\0';
+	if (strspn(hash, "0123456789abcdef") != sizeof(hash) - 1)
+		return NULL;
+
+	for (i = 0; i < nb_ctx_attrs; i++) {
+		if (!strcmp(ctx_attrs[i], "uri")) {
+			uri = ctx_values[i];
+			break;
 		}
+	}
 
-		memcpy(xml_zstd, "xml:", uri_len);
-		xml_zstd[uri_len + xml_len] = '\0';
+	len = strlen(cache_dir) + sizeof("/-.xml") + 2 * (sizeof(hash) - 1);
+	path = malloc(len);
+	if (!path)
+		return NULL;
 
-		/* Free compressed data, make "xml" point to uncompressed data */
+	iio_snprintf(path, len, "%s/%s-%016llx.xml", cache_dir, hash,
+		     (unsigned long long) iiod_responder_hash(uri, strlen(uri)));
+
+	return path;
+}
+
+/* Cache files start with a header line containing the length and hash of
+ * the XML string that follows, to detect truncated or corrupted files. */
+static char * iiod_client_cache_load(struct iiod_client *client,
+				     const char *path)
+{
+	size_t uri_len = sizeof("xml:") - 1;
+	unsigned long long len, hash;
+	char *xml = NULL;
+	FILE *f;
+
+	f = fopen(path, "rb");
+	if (!f)
+		return NULL;
+
+	if (fscanf(f, "IIOCACHE1 %llu %llx\n", &len, &hash) != 2
+	    || !len || len > SIZE_MAX - uri_len - 1)
+		goto out_fclose;
+
+	xml = malloc(uri_len + len + 1);
+	if (!xml)
+		goto out_fclose;
+
+	memcpy(xml, "xml:", uri_len);
+
+	if (fread(&xml[uri_len], 1, len, f) != len
+	    || iiod_responder_hash(&xml[uri_len], len) != hash) {
+		prm_warn(client->params, "Ignoring invalid cache file %s\n", path);
 		free(xml);
-		xml = xml_zstd;
+		xml = NULL;
+		goto out_fclose;
 	}
 
+	xml[uri_len + len] = '\0';
+
+	prm_dbg(client->params, "Loaded context description from %s\n", path);
+
+out_fclose:
+	fclose(f);
+	return xml;
+}
+
+static void iiod_client_cache_store(struct iiod_client *client,
+				    const char *path, const char *xml)
+{
+	size_t len = strlen(xml), path_len = strlen(path) + sizeof(".tmp");
+	bool ok;
+	char *tmp;
+	FILE *f;
+
+	tmp = malloc(path_len);
+	if (!tmp)
+		return;
+
+	/* Write to a temporary file then rename it, so that concurrent
+	 * readers never see a partially written file. */
+	iio_snprintf(tmp, path_len, "%s.tmp", path);
+
+	f = fopen(tmp, "wb");
+	if (!f) {
+		prm_dbg(client->params, "Unable to create cache file %s\n", tmp);
+		goto out_free_tmp;
+	}
+
+	ok = fprintf(f, "IIOCACHE1 %llu %016llx\n", (unsigned long long) len,
+		     (unsigned long long) iiod_responder_hash(xml, len)) > 0
+		&& fwrite(xml, 1, len, f) == len;
+	ok = !fclose(f) && ok;
+
+	if (!ok || rename(tmp, path)) {
+		prm_dbg(client->params, "Unable to write cache file %s\n", path);
+		remove(tmp);
+	}
+
+out_free_tmp:
+	free(tmp);
+}
+
+static struct iio_context *
+iiod_client_create_context_private_new(struct iiod_client *client,
+				       const struct iio_backend *backend,
+				       const char *description,
+				       const char **ctx_attrs,
+				       const char **ctx_values,
+				       unsigned int nb_ctx_attrs)
+{
+	size_t uri_len = sizeof("xml:") - 1;
+	struct iio_context *ctx = NULL;
+	char *xml = NULL, *path;
+	int ret;
+
+	path = iiod_client_get_cache_path(client, ctx_attrs,
+					  ctx_values, nb_ctx_attrs);
+	if (path)
+		xml = iiod_client_cache_load(client, path);
+
+	if (!xml) {
+		xml = iiod_client_fetch_xml(client);
+		ret = iio_err(xml);
+		if (ret) {
+			free(path);
+			return iio_ptr(ret);
+		}
+
+		if (path)
+			iiod_client_cache_store(client, path, &xml[uri_len]);
+	}
+
+	free(path);
+
+	/* The response to IIOD_OP_SET_FEATURES came before this one */
+	iiod_client_put_features_io(client);
+
 	prm_dbg(client->params, "Creating context\n");
 
 	ctx = iio_create_context_from_xml(client->params, xml,
@@ -1018,7 +1345,6 @@ iiod_client_create_context_private_new(struct iiod_client *client,
 	if (ctx)
 		prm_dbg(client->params, "Context created.\n");
 
-out_free_xml:
 	free(xml);
 	return ctx ? ctx : iio_ptr(ret);
 }
@@ -1524,9 +1850,30 @@ int iiod_client_enable_buffer(struct iiod_client_buffer_pdata *pdata,
 	return iiod_io_exec_simple_command(io, &cmd);
 }
 
-struct iio_block_pdata *
-iiod_client_create_block(struct iiod_client_buffer_pdata *pdata,
-			 size_t size, void **data)
+void iiod_client_set_block_allocator(struct iiod_client_buffer_pdata *pdata,
+				     struct iio_block_allocator *alloc)
+{
+	pdata->allocator = alloc;
+}
+
+int iiod_client_buffer_add_stripe(struct iiod_client_buffer_pdata *pdata,
+				  struct iiod_client *client)
+{
+	if (iio_device_is_tx(pdata->dev)
+	    || !iiod_client_uses_binary_interface(client))
+		return -ENOSYS;
+
+	if (pdata->nb_stripes == ARRAY_SIZE(pdata->stripes))
+		return -ENOSPC;
+
+	pdata->stripes[pdata->nb_stripes++] = client;
+
+	return 0;
+}
+
+static struct iio_block_pdata *
+iiod_client_do_create_block(struct iiod_client_buffer_pdata *pdata,
+			    size_t size, void *user_data, void **data)
 {
 	struct iiod_client *client = pdata->client;
 	struct iio_block_pdata *block;
@@ -1550,24 +1897,44 @@ iiod_client_create_block(struct iiod_client_buffer_pdata *pdata,
 	if (ret)
 		goto err_free_block;
 
-	block->data = malloc(size);
-	if (!block->data)
-		goto err_free_mutex;
+	if (user_data) {
+		block->data = user_data;
+		block->user_memory = true;
+	} else {
+		block->data = iio_block_allocator_alloc(pdata->allocator, size);
+		if (!block->data)
+			goto err_free_mutex;
+	}
 
 	block->idx = pdata->next_block_idx++;
 
+	/* Round-robin between the buffer's client and its stripes */
+	if (block->idx % (pdata->nb_stripes + 1))
+		client = pdata->stripes[block->idx % (pdata->nb_stripes + 1) - 1];
+
 	block->io = iiod_responder_create_io(client->responder, block->idx + 1);
 	ret = iio_err(block->io);
 	if (ret)
 		goto err_free_data;
 
+	if (client == pdata->client) {
+		block->cmd_io = block->io;
+		iiod_io_ref(block->cmd_io);
+	} else {
+		block->cmd_io = iiod_responder_create_io(pdata->client->responder,
+							 block->idx + 1);
+		ret = iio_err(block->cmd_io);
+		if (ret)
+			goto err_free_io;
+	}
+
 	cmd.op = IIOD_OP_CREATE_BLOCK;
 	cmd.dev = (uint8_t) iio_device_get_index(pdata->dev);
 	cmd.code = pdata->idx | (block->idx << 16);
 
 	ret = iiod_io_exec_command(block->io, &cmd, &buf, NULL);
 	if (ret < 0)
-		goto err_free_io;
+		goto err_free_cmd_io;
 
 	*data = block->data;
 
@@ -1576,10 +1943,13 @@ iiod_client_create_block(struct iiod_client_buffer_pdata *pdata,
 
 	return block;
 
+err_free_cmd_io:
+	iiod_io_unref(block->cmd_io);
 err_free_io:
 	iiod_io_unref(block->io);
 err_free_data:
-	free(block->data);
+	if (!block->user_memory)
+		iio_block_allocator_free(pdata->allocator, block->data);
 err_free_mutex:
 	iio_mutex_destroy(block->lock);
 err_free_block:
@@ -1587,6 +1957,22 @@ err_free_block:
 	return iio_ptr(ret);
 }
 
+struct iio_block_pdata *
+iiod_client_create_block(struct iiod_client_buffer_pdata *pdata,
+			 size_t size, void **data)
+{
+	return iiod_client_do_create_block(pdata, size, NULL, data);
+}
+
+struct iio_block_pdata *
+iiod_client_create_block_from_memory(struct iiod_client_buffer_pdata *pdata,
+				     void *ptr, size_t size)
+{
+	void *data;
+
+	return iiod_client_do_create_block(pdata, size, ptr, &data);
+}
+
 void iiod_client_free_block(struct iio_block_pdata *block)
 {
 	struct iiod_client *client = block->buffer->client_fb;
@@ -1604,13 +1990,16 @@ void iiod_client_free_block(struct iio_block_pdata *block)
 	/* Cancel any I/O going on. This means we must send the block free
 	 * command through the main I/O as the block's I/O stream is
 	 * disrupted. */
+	iiod_io_cancel(block->cmd_io);
+	iiod_io_unref(block->cmd_io);
 	iiod_io_cancel(block->io);
 	iiod_io_unref(block->io);
 
 	io = iiod_responder_get_default_io(client->responder);
 	iiod_io_exec_simple_command(io, &cmd);
 
-	free(block->data);
+	if (!block->user_memory)
+		iio_block_allocator_free(pdata->allocator, block->data);
 	iio_mutex_destroy(block->lock);
 	free(block);
 }
@@ -1644,7 +2033,7 @@ int iiod_client_enqueue_block(struct iio_block_pdata *block,
 
 	iiod_io_get_response_async(block->io, &buf[1], is_rx);
 
-	ret = iiod_io_send_command_async(block->io, &cmd, buf, nb_buf);
+	ret = iiod_io_send_command_async(block->cmd_io, &cmd, buf, nb_buf);
 	if (ret < 0) {
 		iiod_io_cancel_response(block->io);
 		goto out_unlock;
@@ -1684,7 +2073,7 @@ int iiod_client_dequeue_block(struct iio_block_pdata *block, bool nonblock)
 		is_rx = !iio_device_is_tx(pdata->dev);
 		iiod_io_get_response_async(block->io, &buf, is_rx);
 
-		ret = iiod_io_send_command_async(block->io, &cmd, NULL, 0);
+		ret = iiod_io_send_command_async(block->cmd_io, &cmd, NULL, 0);
 		if (ret < 0) {
 			iiod_io_cancel_response(block->io);
 			goto out_unlock;
@@ -1693,12 +2082,12 @@ int iiod_client_dequeue_block(struct iio_block_pdata *block, bool nonblock)
 		block->retry_dequeue = false;
 	}
 
-	if (nonblock && !iiod_io_command_is_done(block->io)) {
+	if (nonblock && !iiod_io_command_is_done(block->cmd_io)) {
 		ret = -EBUSY;
 		goto out_unlock;
 	}
 
-	ret = iiod_io_wait_for_command_done(block->io);
+	ret = iiod_io_wait_for_command_done(block->cmd_io);
 	if (ret)
 		goto out_unlock;
 
@@ -1744,11 +2133,19 @@ static int iiod_client_request_event_read(struct iio_event_stream_pdata *pdata)
 		.dev = (uint8_t) iio_device_get_index(pdata->dev),
 	};
 	struct iiod_buf buf = {
-		.ptr = &pdata->event,
-		.size = sizeof(pdata->event),
+		.ptr = pdata->events,
+		.size = sizeof(pdata->events[0]),
 	};
 	int err;
 
+	/* Get all the events queued on the server in one response */
+	if (iiod_responder_get_features(pdata->client->responder)
+	    & IIOD_FEATURE_READ_EVENTS) {
+		cmd.op = IIOD_OP_READ_EVENTS;
+		cmd.code = IIOD_READ_EVENTS_MAX;
+		buf.size = sizeof(pdata->events);
+	}
+
 	err = iiod_io_get_response_async(pdata->io, &buf, 1);
 	if (err)
 		return err;
@@ -1760,6 +2157,96 @@ static int iiod_client_request_event_read(struct iio_event_stream_pdata *pdata)
 	return 0;
 }
 
+/* Called from the responder's thread for every response of a subscribed
+ * stream. The first one is the response to IIOD_OP_CREATE_EVSTREAM. */
+static void iiod_client_push_events(void *d, int32_t code)
+{
+	struct iio_event_stream_pdata *pdata = d;
+	unsigned int i, nb;
+
+	iio_mutex_lock(pdata->lock);
+
+	if (!pdata->subscribed || code < 0) {
+		pdata->subscribed = true;
+		pdata->err = code < 0 ? code : 0;
+	} else {
+		nb = (unsigned int) code / sizeof(*pdata->events);
+		if (nb > IIOD_READ_EVENTS_MAX)
+			nb = IIOD_READ_EVENTS_MAX;
+
+		for (i = 0; i < nb && pdata->q_count < IIOD_EVENT_QUEUE_SIZE; i++) {
+			pdata->queue[(pdata->q_first + pdata->q_count++)
+				     % IIOD_EVENT_QUEUE_SIZE] = pdata->events[i];
+		}
+
+		pdata->overflows += nb - i;
+	}
+
+	iio_cond_signal(pdata->cond);
+	iio_mutex_unlock(pdata->lock);
+}
+
+static int iiod_client_subscribe_events(struct iio_event_stream_pdata *pdata,
+					const struct iiod_command *cmd)
+{
+	unsigned int timeout_ms = pdata->client->params->timeout_ms;
+	struct iiod_buf buf = {
+		.ptr = pdata->events,
+		.size = sizeof(pdata->events),
+	};
+	int err;
+
+	pdata->queue = calloc(IIOD_EVENT_QUEUE_SIZE, sizeof(*pdata->queue));
+	if (!pdata->queue)
+		return -ENOMEM;
+
+	pdata->lock = iio_mutex_create();
+	err = iio_err(pdata->lock);
+	if (err)
+		return err;
+
+	pdata->cond = iio_cond_create();
+	err = iio_err(pdata->cond);
+	if (err)
+		return err;
+
+	/* Register for the responses before sending the command, as the
+	 * server sends the events right after its response. */
+	err = iiod_io_get_responses_cb(pdata->io, &buf, 1,
+				       iiod_client_push_events, pdata);
+	if (err)
+		return err;
+
+	err = iiod_io_send_command(pdata->io, cmd, NULL, 0);
+	if (err)
+		return err;
+
+	iio_mutex_lock(pdata->lock);
+
+	while (!pdata->subscribed && !err)
+		err = iio_cond_wait(pdata->cond, pdata->lock, timeout_ms);
+	if (!err)
+		err = pdata->err;
+
+	iio_mutex_unlock(pdata->lock);
+
+	return err;
+}
+
+static void iiod_client_free_event_stream(struct iio_event_stream_pdata *pdata)
+{
+	iiod_io_cancel(pdata->io);
+	iiod_io_unref(pdata->io);
+
+	if (pdata->cond && !iio_err(pdata->cond))
+		iio_cond_destroy(pdata->cond);
+	if (pdata->lock && !iio_err(pdata->lock))
+		iio_mutex_destroy(pdata->lock);
+
+	free(pdata->queue);
+	free(pdata);
+}
+
 struct iio_event_stream_pdata *
 iiod_client_open_event_stream(struct iiod_client *client,
 			      const struct iio_device *dev)
@@ -1788,6 +2275,25 @@ iiod_client_open_event_stream(struct iiod_client *client,
 	if (err)
 		goto err_free_pdata;
 
+	/* Have the server send the events as they arrive, if it can */
+	if (iiod_responder_get_features(client->responder)
+	    & IIOD_FEATURE_EVENT_PUSH) {
+		cmd.code = IIOD_EVSTREAM_PUSH;
+		pdata->push = true;
+
+		err = iiod_client_subscribe_events(pdata, &cmd);
+		if (err == -ETIMEDOUT) {
+			/* The server may have created the stream anyway;
+			 * have it freed. */
+			iiod_client_close_event_stream(pdata);
+			return iio_ptr(err);
+		}
+		if (err)
+			goto err_free_stream;
+
+		return pdata;
+	}
+
 	err = iiod_io_exec_simple_command(pdata->io, &cmd);
 	if (err)
 		goto err_destroy_io;
@@ -1807,6 +2313,9 @@ iiod_client_open_event_stream(struct iiod_client *client,
 
 	return pdata;
 
+err_free_stream:
+	iiod_client_free_event_stream(pdata);
+	return iio_ptr(err);
 err_destroy_io:
 	iiod_io_cancel(pdata->io);
 	iiod_io_unref(pdata->io);
@@ -1824,6 +2333,19 @@ void iiod_client_close_event_stream(struct iio_event_stream_pdata *pdata)
 	};
 	struct iiod_io *io;
 
+	/* Stop receiving into pdata->events first: events may still be on
+	 * their way until the server processes the command below. This also
+	 * waits for a read into the buffer in progress. */
+	iiod_io_cancel(pdata->io);
+
+	if (pdata->push) {
+		/* Wake up any blocking reader */
+		iio_mutex_lock(pdata->lock);
+		pdata->err = -EINTR;
+		iio_cond_signal(pdata->cond);
+		iio_mutex_unlock(pdata->lock);
+	}
+
 	/* Close the event stream using the default I/O, since there may
 	 * be a blocking event read operation pending on the I/O pipe dedicated
 	 * to this event stream. */
@@ -1831,37 +2353,123 @@ void iiod_client_close_event_stream(struct iio_event_stream_pdata *pdata)
 
 	iiod_io_exec_simple_command(io, &cmd);
 
-	iiod_io_cancel(pdata->io);
-	iiod_io_unref(pdata->io);
-	free(pdata);
+	iiod_client_free_event_stream(pdata);
 }
 
-int iiod_client_read_event(struct iio_event_stream_pdata *pdata,
-			   struct iio_event *out_event,
-			   bool nonblock)
+static ssize_t
+iiod_client_read_pushed_events(struct iio_event_stream_pdata *pdata,
+			       struct iio_event *events, size_t nb,
+			       bool nonblock)
+{
+	size_t i, count;
+	ssize_t ret;
+
+	iio_mutex_lock(pdata->lock);
+
+	while (!nonblock && !pdata->q_count && !pdata->err)
+		iio_cond_wait(pdata->cond, pdata->lock, 0);
+
+	count = pdata->q_count < nb ? pdata->q_count : nb;
+
+	for (i = 0; i < count; i++) {
+		events[i] = pdata->queue[pdata->q_first];
+		pdata->q_first = (pdata->q_first + 1) % IIOD_EVENT_QUEUE_SIZE;
+	}
+
+	pdata->q_count -= (unsigned int) count;
+
+	if (count)
+		ret = (ssize_t) count;
+	else if (pdata->err)
+		ret = pdata->err;
+	else
+		ret = -EAGAIN;
+
+	iio_mutex_unlock(pdata->lock);
+
+	return ret;
+}
+
+ssize_t iiod_client_read_events(struct iio_event_stream_pdata *pdata,
+				struct iio_event *events, size_t nb,
+				bool nonblock)
 {
 	struct iiod_io *io = pdata->io;
-	int ret = 0;
+	ssize_t ret = 0;
+	size_t count;
+
+	if (pdata->push)
+		return iiod_client_read_pushed_events(pdata, events, nb,
+						      nonblock);
 
 	/* Get a reference to the I/O stream, so that it's not freed while
 	 * we're using it */
 	iiod_io_ref(io);
 
-	if (!nonblock)
-		ret = (int)iiod_io_wait_for_response(io);
-	else if (!iiod_io_has_response(io))
-		ret = -EAGAIN;
+	if (pdata->next_event == pdata->nb_events) {
+		if (!nonblock)
+			ret = iiod_io_wait_for_response(io);
+		else if (!iiod_io_has_response(io))
+			ret = -EAGAIN;
+
+		if (ret < 0)
+			goto out_unref_io;
+
+		/* We have a response from the last command. */
+		pdata->nb_events = (unsigned int) ret / sizeof(*events);
+		pdata->next_event = 0;
 
-	if (ret >= 0) {
-		/* We have a response from the last command.
-		 * Copy the event to the output buffer. */
-		*out_event = pdata->event;
+		if (!pdata->nb_events) {
+			ret = iiod_client_request_event_read(pdata);
+			if (!ret)
+				ret = -EIO;
+			goto out_unref_io;
+		}
+	}
+
+	count = pdata->nb_events - pdata->next_event;
+	if (count > nb)
+		count = nb;
 
-		/* Request a new event. */
+	memcpy(events, &pdata->events[pdata->next_event], /* Flawfinder: ignore */
+	       count * sizeof(*events));
+	pdata->next_event += (unsigned int) count;
+	ret = (ssize_t) count;
+
+	/* Request new events once all the received ones have been read. */
+	if (pdata->next_event == pdata->nb_events) {
 		ret = iiod_client_request_event_read(pdata);
+		if (!ret)
+			ret = (ssize_t) count;
 	}
 
+out_unref_io:
 	iiod_io_unref(io);
 
 	return ret;
 }
+
+uint64_t iiod_client_get_event_overflows(struct iio_event_stream_pdata *pdata)
+{
+	uint64_t overflows;
+
+	if (!pdata->push)
+		return 0;
+
+	iio_mutex_lock(pdata->lock);
+	overflows = pdata->overflows;
+	iio_mutex_unlock(pdata->lock);
+
+	return overflows;
+}
+
+int iiod_client_read_event(struct iio_event_stream_pdata *pdata,
+			   struct iio_event *out_event,
+			   bool nonblock)
+{
+	ssize_t ret;
+
+	ret = iiod_client_read_events(pdata, out_event, 1, nonblock);
+
+	return ret < 0 ? (int) ret : 0;
+}
@@ -22,6 +22,19 @@
 
 #define NB_BUFS_MAX 2
 
+/* Payloads bigger than this are sent by the data lane writer, split in
+ * fragments of this size, if the remote supports it. This bounds the time a
+ * control message can be stuck behind a block transfer to the time it takes
+ * to transfer one fragment. */
+#define IIOD_FRAGMENT_SIZE (64 * 1024)
+
+/* Maximum number of control messages gathered into a single write */
+#define IIOD_WRITE_BATCH_MAX 16
+
+/* Size of the read-ahead buffer. Reads of this size or more go straight to
+ * their destination buffer. */
+#define IIOD_READ_AHEAD_SIZE (16 * 1024)
+
 static void iiod_io_ref_unlocked(struct iiod_io *io);
 static void iiod_io_unref_unlocked(struct iiod_io *io);
 
@@ -36,6 +49,13 @@ struct iiod_client_data {
 	struct iiod_buf buf[NB_BUFS_MAX];
 	size_t nb_buf;
 
+	/* If non-zero, the payload is sent from this DMABUF instead */
+	size_t dmabuf_len;
+	int dmabuf_fd;
+
+	/* Set if the command is counted in the data lane's per-device count */
+	bool ordered;
+
 	/* Value representing the time at which the command was sent. */
 	uint64_t start_time;
 };
@@ -53,6 +73,11 @@ struct iiod_io {
 	/* Set to true when the response has been read */
 	bool r_done;
 
+	/* If set, the iiod_io stays registered for responses, which are
+	 * passed to this callback instead of waking up a reader. */
+	void (*r_cb)(void *d, int32_t code);
+	void *r_cb_d;
+
 	/* Reference counter */
 	unsigned int refcnt;
 
@@ -74,7 +99,55 @@ struct iiod_responder {
 
 	struct iio_mutex *lock;
 	struct iio_thrd *read_thrd;
-	struct iio_task *write_task;
+
+	/* Control lane and data lane writers */
+	struct iio_task *write_task, *data_write_task;
+
+	/* Serializes the messages and fragments written by the two lanes */
+	struct iio_mutex *write_lock;
+
+	/* The data lane waits on lane_cond until no control message is
+	 * being written. */
+	struct iio_mutex *lane_lock;
+	struct iio_cond *lane_cond;
+	unsigned int nb_ctrl_writers;
+
+	/* Number of commands queued to the data lane, per device. While
+	 * non-zero, the following commands for that device are queued behind
+	 * them, so that they reach the remote in order. */
+	unsigned int nb_data_cmds[UINT8_MAX + 1];
+
+	/* Protocol features supported by the remote */
+	uint8_t features;
+
+	/* Scratch array used by the control lane writer */
+	struct iiod_buf *write_bufs;
+
+	/* Read-ahead buffer, only used by the reader thread */
+	char *rbuf;
+	size_t rbuf_pos, rbuf_len;
+
+	/* iiod_io whose response data is being read by the reader thread.
+	 * iiod_io_cancel() waits on read_cond until the read is done, as the
+	 * caller may free the buffers right after. */
+	struct iiod_io *reading_io;
+	struct iio_cond *read_cond;
+
+	/* Fragmented response being received */
+	struct iiod_command frag_hdr;
+	struct iiod_io *frag_io;
+	size_t frag_offset;
+	bool frag_pending;
+
+	/* Fragmented command being processed */
+	size_t frag_left;
+	bool frag_cmd, frag_last;
+	uint8_t frag_dev;
+
+	/* Commands for its device received in between its fragments, run
+	 * once it is done */
+	struct iiod_command *deferred;
+	size_t nb_deferred, deferred_size;
 
 	bool thrd_stop;
 	int thrd_err_code;
@@ -108,6 +181,19 @@ uint64_t iiod_responder_read_counter_us(void)
 	return read_counter_us();
 }
 
+uint64_t iiod_responder_hash(const void *data, size_t len)
+{
+	const unsigned char *ptr = data;
+	uint64_t hash = 0xcbf29ce484222325ull;
+
+	while (len--) {
+		hash ^= *ptr++;
+		hash *= 0x100000001b3ull;
+	}
+
+	return hash;
+}
+
 static void __iiod_io_cancel_unlocked(struct iiod_io *io)
 {
 	struct iiod_responder *priv = io->responder;
@@ -126,27 +212,14 @@ static void __iiod_io_cancel_unlocked(struct iiod_io *io)
 	}
 }
 
-static ssize_t iiod_rw_all(struct iiod_responder *priv,
-			   const struct iiod_buf *cmd_buf,
-			   const struct iiod_buf *buf, size_t nb,
-			   size_t bytes, bool is_read)
+/* Same as iiod_rw_all, but the buffers array is updated in place. If not NULL,
+ * 'done' receives the number of bytes transferred, even on error. */
+static ssize_t iiod_rw_bufs(struct iiod_responder *priv,
+			    struct iiod_buf *bufs, size_t nb,
+			    size_t bytes, bool is_read, size_t *done)
 {
+	struct iiod_buf *curr = &bufs[0];
 	ssize_t ret, count = 0;
-	struct iiod_buf bufs[32], *curr = &bufs[0];
-
-	if (cmd_buf)
-		nb++;
-
-	if (nb == 0 || nb > ARRAY_SIZE(bufs))
-		return EINVAL;
-
-	if (cmd_buf) {
-		bufs[0] = *cmd_buf;
-		if (buf)
-			memcpy(&bufs[1], buf, (nb - 1) * sizeof(*buf));
-	} else {
-		memcpy(bufs, buf, nb * sizeof(*buf));
-	}
 
 	while (true) {
 		if (is_read && bytes - count <= curr->size) {
@@ -158,8 +231,11 @@ static ssize_t iiod_rw_all(struct iiod_responder *priv,
 			ret = priv->ops->read(priv->d, curr, nb);
 		else
 			ret = priv->ops->write(priv->d, curr, nb);
-		if (ret <= 0)
+		if (ret <= 0) {
+			if (done)
+				*done = (size_t) count;
 			return ret;
+		}
 
 		while (ret && (size_t) ret >= curr->size) {
 			ret -= curr->size;
@@ -176,13 +252,151 @@ static ssize_t iiod_rw_all(struct iiod_responder *priv,
 		curr->size -= ret;
 	}
 
+	if (done)
+		*done = (size_t) count;
+
 	return count;
 }
 
+static ssize_t iiod_rw_all(struct iiod_responder *priv,
+			   const struct iiod_buf *cmd_buf,
+			   const struct iiod_buf *buf, size_t nb,
+			   size_t bytes, bool is_read)
+{
+	struct iiod_buf bufs[32];
+
+	if (cmd_buf)
+		nb++;
+
+	if (nb == 0 || nb > ARRAY_SIZE(bufs))
+		return EINVAL;
+
+	if (cmd_buf) {
+		bufs[0] = *cmd_buf;
+		if (buf)
+			memcpy(&bufs[1], buf, (nb - 1) * sizeof(*buf));
+	} else {
+		memcpy(bufs, buf, nb * sizeof(*buf));
+	}
+
+	return iiod_rw_bufs(priv, bufs, nb, bytes, is_read, NULL);
+}
+
+static size_t iiod_buf_size(const struct iiod_buf *buf, size_t nb)
+{
+	size_t i, size = 0;
+
+	for (i = 0; i < nb; i++)
+		size += buf[i].size;
+
+	return size;
+}
+
+/* Fill "dst" with the buffers describing "len" bytes of "src", starting
+ * from byte "offset". Returns the number of buffers used. */
+static size_t iiod_buf_slice(struct iiod_buf *dst, const struct iiod_buf *src,
+			     size_t nb, size_t offset, size_t len)
+{
+	size_t i, nb_dst = 0;
+
+	for (i = 0; i < nb && len; i++) {
+		if (offset >= src[i].size) {
+			offset -= src[i].size;
+			continue;
+		}
+
+		dst[nb_dst].ptr = (char *) src[i].ptr + offset;
+		dst[nb_dst].size = src[i].size - offset;
+		if (dst[nb_dst].size > len)
+			dst[nb_dst].size = len;
+
+		len -= dst[nb_dst].size;
+		offset = 0;
+		nb_dst++;
+	}
+
+	return nb_dst;
+}
+
+/* Read "bytes" bytes into the given buffers. Small reads are served from the
+ * read-ahead buffer, which is refilled with whatever the transport has
+ * available, so that several small messages can be received with a single
+ * system call. */
+static ssize_t iiod_responder_read(struct iiod_responder *priv,
+				   const struct iiod_buf *buf, size_t nb,
+				   size_t bytes)
+{
+	struct iiod_buf bufs[NB_BUFS_MAX + 1], rbuf;
+	size_t i, len, nb_slices, count = 0, size = iiod_buf_size(buf, nb);
+	ssize_t ret;
+
+	if (bytes > size)
+		bytes = size;
+
+	if (!priv->rbuf)
+		return iiod_rw_all(priv, NULL, buf, nb, bytes, true);
+
+	while (count < bytes) {
+		len = priv->rbuf_len - priv->rbuf_pos;
+
+		if (!len) {
+			priv->rbuf_pos = 0;
+			priv->rbuf_len = 0;
+
+			if (bytes - count >= IIOD_READ_AHEAD_SIZE)
+				break;
+
+			rbuf.ptr = priv->rbuf;
+			rbuf.size = IIOD_READ_AHEAD_SIZE;
+
+			ret = priv->ops->read_partial(priv->d, &rbuf);
+			if (ret <= 0)
+				return ret;
+
+			priv->rbuf_len = (size_t) ret;
+			continue;
+		}
+
+		if (len > bytes - count)
+			len = bytes - count;
+
+		nb_slices = iiod_buf_slice(bufs, buf, nb, count, len);
+		for (i = 0; i < nb_slices; i++) {
+			memcpy(bufs[i].ptr, priv->rbuf + priv->rbuf_pos,
+			       bufs[i].size);
+			priv->rbuf_pos += bufs[i].size;
+		}
+
+		count += len;
+	}
+
+	if (count < bytes) {
+		/* Big payload: read it directly into its destination */
+		nb_slices = iiod_buf_slice(bufs, buf, nb, count, bytes - count);
+
+		ret = iiod_rw_all(priv, NULL, bufs, nb_slices,
+				  bytes - count, true);
+		if (ret <= 0)
+			return ret;
+
+		count += (size_t) ret;
+	}
+
+	return (ssize_t) count;
+}
+
 static int iiod_discard_data(struct iiod_responder *priv, size_t bytes)
 {
+	size_t len = priv->rbuf_len - priv->rbuf_pos;
 	ssize_t ret;
 
+	/* Drop the read-ahead data first */
+	if (len > bytes)
+		len = bytes;
+
+	priv->rbuf_pos += len;
+	bytes -= len;
+
 	while (bytes) {
 		ret = priv->ops->discard(priv->d, bytes);
 		if (ret < 0)
@@ -194,31 +408,197 @@ static int iiod_discard_data(struct iiod_responder *priv, size_t bytes)
 	return 0;
 }
 
+static ssize_t iiod_run_command(struct iiod_responder *priv,
+				struct iiod_command *cmd)
+{
+	return priv->ops->cmd(cmd, (struct iiod_command_data *) priv, priv->d);
+}
+
+static int iiod_responder_process(struct iiod_responder *priv,
+				  const struct iiod_command *cmd);
+
+static int iiod_responder_defer(struct iiod_responder *priv,
+				const struct iiod_command *cmd)
+{
+	struct iiod_command *deferred;
+	size_t size;
+
+	if (priv->nb_deferred == priv->deferred_size) {
+		size = priv->deferred_size ? priv->deferred_size * 2 : 8;
+
+		deferred = realloc(priv->deferred, size * sizeof(*deferred));
+		if (!deferred)
+			return -ENOMEM;
+
+		priv->deferred = deferred;
+		priv->deferred_size = size;
+	}
+
+	priv->deferred[priv->nb_deferred++] = *cmd;
+
+	return 0;
+}
+
+static int iiod_responder_run_deferred(struct iiod_responder *priv)
+{
+	size_t i;
+	int ret = 0;
+
+	for (i = 0; ret >= 0 && i < priv->nb_deferred; i++)
+		ret = (int) iiod_run_command(priv, &priv->deferred[i]);
+
+	priv->nb_deferred = 0;
+
+	return ret;
+}
+
+/* Called while processing a fragmented command, to get the header of its next
+ * fragment. The messages sent by the remote's control lane in between the
+ * fragments are processed here. */
+static int iiod_responder_next_fragment(struct iiod_responder *priv)
+{
+	struct iiod_command cmd;
+	struct iiod_buf cmd_buf;
+	ssize_t ret;
+
+	cmd_buf.ptr = &cmd;
+	cmd_buf.size = sizeof(cmd);
+
+	for (;;) {
+		ret = iiod_responder_read(priv, &cmd_buf, 1, sizeof(cmd));
+		if (ret <= 0)
+			return ret ? (int) ret : -EIO;
+
+		if (cmd.op == IIOD_OP_FRAGMENT)
+			break;
+
+		/* The commands for the device of the fragmented one must run
+		 * after it; they are deferred until it is done, in the order
+		 * they arrived. The remote queues them behind the fragmented
+		 * command, so none should arrive here, and none would carry
+		 * data. The other messages are processed as they arrive. */
+		if (cmd.op != IIOD_OP_RESPONSE && cmd.dev == priv->frag_dev) {
+			ret = iiod_responder_defer(priv, &cmd);
+			if (ret < 0)
+				return (int) ret;
+
+			continue;
+		}
+
+		/* Interleaved messages are never fragmented themselves, so
+		 * their data is read straight from the stream. */
+		priv->frag_cmd = false;
+		ret = iiod_responder_process(priv, &cmd);
+		priv->frag_cmd = true;
+		if (ret < 0)
+			return (int) ret;
+	}
+
+	if (cmd.code < 0)
+		return -EIO;
+
+	priv->frag_left = (size_t) cmd.code;
+	priv->frag_last = cmd.dev & IIOD_FRAGMENT_LAST;
+
+	return 0;
+}
+
 int iiod_command_data_read(struct iiod_command_data *data,
 			   const struct iiod_buf *buf)
 {
 	struct iiod_responder *priv = (struct iiod_responder *) data;
+	struct iiod_buf tmp;
+	size_t done = 0;
 	ssize_t ret;
 
-	ret = iiod_rw_all(priv, NULL, buf, 1, buf->size, true);
+	if (!priv->frag_cmd) {
+		ret = iiod_responder_read(priv, buf, 1, buf->size);
+		if (ret < 0)
+			return (int) ret;
+		if (ret != (ssize_t) buf->size)
+			return -EIO;
+
+		return 0;
+	}
+
+	while (done < buf->size) {
+		if (!priv->frag_left) {
+			if (priv->frag_last)
+				return -EIO;
+
+			ret = iiod_responder_next_fragment(priv);
+			if (ret < 0)
+				return (int) ret;
+
+			continue;
+		}
+
+		tmp.ptr = (char *) buf->ptr + done;
+		tmp.size = buf->size - done;
+		if (tmp.size > priv->frag_left)
+			tmp.size = priv->frag_left;
+
+		ret = iiod_responder_read(priv, &tmp, 1, tmp.size);
+		if (ret < 0)
+			return (int) ret;
+		if ((size_t) ret != tmp.size)
+			return -EIO;
+
+		priv->frag_left -= tmp.size;
+		done += tmp.size;
+	}
+
+	return 0;
+}
+
+int iiod_command_data_read_dmabuf(struct iiod_command_data *data,
+				  int fd, size_t len)
+{
+	struct iiod_responder *priv = (struct iiod_responder *) data;
+	ssize_t ret;
+
+	/* The DMABUF can only be filled straight from the transport */
+	if (!priv->ops->read_dmabuf || priv->frag_cmd
+	    || priv->rbuf_len > priv->rbuf_pos)
+		return -ENOSYS;
+
+	ret = priv->ops->read_dmabuf(priv->d, fd, len);
 	if (ret < 0)
 		return (int) ret;
-	if (ret != buf->size)
+	if ((size_t) ret != len)
 		return -EIO;
 
 	return 0;
 }
 
-static ssize_t iiod_run_command(struct iiod_responder *priv,
-				struct iiod_command *cmd)
+/* Drop the fragments of the current command that its handler did not read */
+static int iiod_responder_discard_fragments(struct iiod_responder *priv)
 {
-	return priv->ops->cmd(cmd, (struct iiod_command_data *) priv, priv->d);
+	int ret;
+
+	while (priv->frag_left || !priv->frag_last) {
+		if (priv->frag_left)
+			ret = iiod_discard_data(priv, priv->frag_left);
+		else
+			ret = iiod_responder_next_fragment(priv);
+		if (ret < 0)
+			return ret;
+
+		priv->frag_left = 0;
+	}
+
+	return 0;
 }
 
 static void iiod_responder_signal_io(struct iiod_io *io, int32_t code)
 {
 	io->r_io.cmd.code = code;
 
+	if (io->r_cb) {
+		io->r_cb(io->r_cb_d, code);
+		return;
+	}
+
 	/* Wake up the reader */
 	iio_mutex_lock(io->lock);
 	io->r_done = true;
@@ -226,6 +606,18 @@ static void iiod_responder_signal_io(struct iiod_io *io, int32_t code)
 	iio_mutex_unlock(io->lock);
 }
 
+static void iiod_responder_complete_io(struct iiod_responder *priv,
+				       struct iiod_io *io,
+				       uint8_t flags, int32_t code)
+{
+	io->r_io.cmd.dev = flags;
+
+	iio_mutex_lock(priv->lock);
+	iiod_responder_signal_io(io, code);
+	iiod_io_unref_unlocked(io);
+	iio_mutex_unlock(priv->lock);
+}
+
 static void iiod_responder_cancel_responses(struct iiod_responder *priv)
 {
 	struct iiod_io *io, *next;
@@ -235,13 +627,207 @@ static void iiod_responder_cancel_responses(struct iiod_responder *priv)
 		next = io->r_next;
 		iiod_responder_signal_io(io, priv->thrd_err_code);
 	}
+
+	if (priv->frag_io) {
+		iiod_responder_signal_io(priv->frag_io, priv->thrd_err_code);
+		iiod_io_unref_unlocked(priv->frag_io);
+		priv->frag_io = NULL;
+	}
+}
+
+/* Read "len" bytes of response data into the buffers of the iiod_io, starting
+ * at the given offset. What does not fit is discarded. */
+static ssize_t iiod_io_read_response_data(struct iiod_responder *priv,
+					  struct iiod_io *io,
+					  size_t offset, size_t len)
+{
+	struct iiod_buf bufs[NB_BUFS_MAX];
+	size_t nb, size;
+	ssize_t ret;
+	int err;
+
+	nb = iiod_buf_slice(bufs, io->r_io.buf, io->r_io.nb_buf, offset, len);
+	size = iiod_buf_size(bufs, nb);
+
+	if (size) {
+		ret = iiod_responder_read(priv, bufs, nb, size);
+		if (ret <= 0)
+			return ret;
+	}
+
+	if (len > size) {
+		err = iiod_discard_data(priv, len - size);
+		if (err < 0)
+			return err;
+	}
+
+	return (ssize_t) len;
+}
+
+static void iiod_responder_read_done(struct iiod_responder *priv)
+{
+	iio_mutex_lock(priv->lock);
+	priv->reading_io = NULL;
+	iio_cond_signal(priv->read_cond);
+	iio_mutex_unlock(priv->lock);
+}
+
+static int iiod_responder_read_fragment(struct iiod_responder *priv,
+					const struct iiod_command *cmd)
+{
+	bool last = cmd->dev & IIOD_FRAGMENT_LAST, complete = false;
+	struct iiod_io *io;
+	ssize_t ret;
+
+	if (!priv->frag_pending || cmd->code < 0)
+		return -EIO;
+
+	iio_mutex_lock(priv->lock);
+	io = priv->frag_io;
+	if (io) {
+		iiod_io_ref_unlocked(io);
+		priv->reading_io = io;
+	}
+	iio_mutex_unlock(priv->lock);
+
+	if (io) {
+		ret = iiod_io_read_response_data(priv, io, priv->frag_offset,
+						 (size_t) cmd->code);
+		iiod_responder_read_done(priv);
+	} else {
+		/* The response was cancelled */
+		ret = iiod_discard_data(priv, (size_t) cmd->code);
+	}
+
+	priv->frag_offset += (size_t) cmd->code;
+
+	iio_mutex_lock(priv->lock);
+	if (ret < 0 || last) {
+		/* Drop the reference held by the fragmented response, unless
+		 * it was cancelled in the meantime. */
+		complete = io && priv->frag_io == io;
+		if (complete)
+			iiod_io_unref_unlocked(io);
+
+		priv->frag_io = NULL;
+		priv->frag_pending = false;
+	}
+	iio_mutex_unlock(priv->lock);
+
+	if (complete) {
+		iiod_responder_complete_io(priv, io, priv->frag_hdr.dev,
+					   ret < 0 ? (int32_t) ret
+					   : priv->frag_hdr.code);
+	} else if (io) {
+		iiod_io_unref(io);
+	}
+
+	return ret < 0 ? (int) ret : 0;
+}
+
+static int iiod_responder_process(struct iiod_responder *priv,
+				  const struct iiod_command *cmd)
+{
+	bool fragmented = cmd->op & IIOD_OP_FLAG_FRAGMENTED;
+	struct iiod_command tmp = *cmd;
+	struct iiod_io *io;
+	ssize_t ret;
+
+	if (cmd->op == IIOD_OP_FRAGMENT)
+		return iiod_responder_read_fragment(priv, cmd);
+
+	tmp.op &= ~IIOD_OP_FLAG_FRAGMENTED;
+
+	if (tmp.op != IIOD_OP_RESPONSE) {
+		if (!fragmented)
+			return (int) iiod_run_command(priv, &tmp);
+
+		/* The handler reads the command's data from the fragments
+		 * that follow. */
+		priv->frag_cmd = true;
+		priv->frag_left = 0;
+		priv->frag_last = false;
+		priv->frag_dev = tmp.dev;
+
+		ret = iiod_run_command(priv, &tmp);
+		if (ret >= 0)
+			ret = iiod_responder_discard_fragments(priv);
+
+		priv->frag_cmd = false;
+
+		if (ret >= 0)
+			ret = iiod_responder_run_deferred(priv);
+		else
+			priv->nb_deferred = 0;
+
+		return (int) ret;
+	}
+
+	iio_mutex_lock(priv->lock);
+
+	/* Find the client for the given ID in the readers list */
+	for (io = priv->readers; io; io = io->r_next) {
+		if (io->client_id == cmd->client_id)
+			break;
+	}
+
+	if (io) {
+		iiod_io_ref_unlocked(io);
+
+		/* Discard the entry from the readers list, unless it wants
+		 * all the responses sent to it */
+		if (!io->r_cb)
+			__iiod_io_cancel_unlocked(io);
+
+		if (!fragmented && cmd->code > 0)
+			priv->reading_io = io;
+	}
+
+	if (fragmented) {
+		/* The data will follow in IIOD_OP_FRAGMENT messages; if we
+		 * have no client waiting for it, it will be dropped. */
+		priv->frag_hdr = tmp;
+		priv->frag_io = io;
+		priv->frag_offset = 0;
+		priv->frag_pending = true;
+		iio_mutex_unlock(priv->lock);
+
+		return 0;
+	}
+
+	iio_mutex_unlock(priv->lock);
+
+	if (!io) {
+		/* We received a response, but have no client waiting
+		 * for it, so drop it. */
+		if (cmd->code > 0)
+			return iiod_discard_data(priv, cmd->code);
+
+		return 0;
+	}
+
+	if (cmd->code > 0) {
+		ret = iiod_io_read_response_data(priv, io, 0, cmd->code);
+		iiod_responder_read_done(priv);
+		if (ret <= 0) {
+			if (!ret)
+				ret = -EIO;
+
+			iiod_responder_complete_io(priv, io, 0, (int32_t) ret);
+			return (int) ret;
+		}
+	}
+
+	/* Wake up the reader */
+	iiod_responder_complete_io(priv, io, cmd->dev, cmd->code);
+
+	return 0;
 }
 
 static int iiod_responder_reader_worker(struct iiod_responder *priv)
 {
 	struct iiod_command cmd;
 	struct iiod_buf cmd_buf, ok_buf;
-	struct iiod_io *io;
 	ssize_t ret = 0;
 
 	cmd_buf.ptr = &cmd;
@@ -254,7 +840,7 @@ static int iiod_responder_reader_worker(struct iiod_responder *priv)
 	while (!priv->thrd_stop) {
 		iio_mutex_unlock(priv->lock);
 
-		ret = iiod_rw_all(priv, NULL, &cmd_buf, 1, sizeof(cmd), true);
+		ret = iiod_responder_read(priv, &cmd_buf, 1, sizeof(cmd));
 
 		if (!strncmp((char *)&cmd, "BINARY\r\n", 8)) {
 			/* If we receive again the "BINARY\r\n" string, send a
@@ -265,110 +851,235 @@ static int iiod_responder_reader_worker(struct iiod_responder *priv)
 			 * the size of a iio_command. */
 
 			iiod_rw_all(priv, NULL, &ok_buf, 1, ok_buf.size, false);
+			iio_mutex_lock(priv->lock);
 			continue;
 		}
 
+		if (ret <= 0) {
+			iio_mutex_lock(priv->lock);
+			break;
+		}
+
+		ret = iiod_responder_process(priv, &cmd);
+
 		iio_mutex_lock(priv->lock);
-		if (ret <= 0)
+		if (ret < 0)
 			break;
+	}
 
-		if (cmd.op != IIOD_OP_RESPONSE) {
-			iio_mutex_unlock(priv->lock);
+	priv->thrd_err_code = priv->thrd_stop ? -EINTR : (int) ret;
+	priv->thrd_stop = true;
 
-			ret = iiod_run_command(priv, &cmd);
+	iiod_responder_cancel_responses(priv);
+	iio_task_stop(priv->write_task);
+	iio_task_stop(priv->data_write_task);
+	iio_task_flush(priv->write_task);
+	iio_task_flush(priv->data_write_task);
 
-			iio_mutex_lock(priv->lock);
-			if (ret < 0)
-				break;
+	iio_mutex_unlock(priv->lock);
 
-			continue;
-		}
+	return (int) ret;
+}
 
-		/* Find the client for the given ID in the readers list */
-		for (io = priv->readers; io; io = io->r_next) {
-			if (io->client_id == cmd.client_id)
-				break;
-		}
+static int iiod_responder_reader_thrd(void *d)
+{
+	return iiod_responder_reader_worker(d);
+}
 
-		if (!io) {
-			/* We received a response, but have no client waiting
-			 * for it, so drop it. */
-			iio_mutex_unlock(priv->lock);
-			iiod_discard_data(priv, cmd.code);
-			iio_mutex_lock(priv->lock);
-			continue;
+static void iiod_responder_write(void *p, void **elms,
+				 int *rets, unsigned int nb)
+{
+	struct iiod_responder *priv = p;
+	struct iiod_buf *bufs = priv->write_bufs;
+	struct iiod_io *writer;
+	unsigned int i, j;
+	size_t nb_bufs = 0, done, len;
+	ssize_t ret;
+
+	/* Gather all the queued messages, so that they are sent with a
+	 * single vectored write. */
+	for (i = 0; i < nb; i++) {
+		writer = elms[i];
+
+		bufs[nb_bufs].ptr = &writer->w_io.cmd;
+		bufs[nb_bufs++].size = sizeof(writer->w_io.cmd);
+
+		for (j = 0; j < writer->w_io.nb_buf; j++) {
+			if (writer->w_io.buf[j].size)
+				bufs[nb_bufs++] = writer->w_io.buf[j];
 		}
+	}
 
-		iiod_io_ref_unlocked(io);
+	iio_mutex_lock(priv->lane_lock);
+	priv->nb_ctrl_writers++;
+	iio_mutex_unlock(priv->lane_lock);
 
-		/* Discard the entry from the readers list */
-		__iiod_io_cancel_unlocked(io);
+	iio_mutex_lock(priv->write_lock);
+	ret = iiod_rw_bufs(priv, bufs, nb_bufs, 0, false, &done);
+	iio_mutex_unlock(priv->write_lock);
 
-		iio_mutex_unlock(priv->lock);
+	iio_mutex_lock(priv->lane_lock);
+	if (--priv->nb_ctrl_writers == 0)
+		iio_cond_signal(priv->lane_cond);
+	iio_mutex_unlock(priv->lane_lock);
 
-		if (io->r_io.nb_buf && cmd.code > 0) {
-			ret = iiod_rw_all(priv, NULL, io->r_io.buf,
-					  io->r_io.nb_buf, cmd.code, true);
+	/* Messages fully sent before an error still succeeded */
+	for (i = 0; i < nb; i++) {
+		writer = elms[i];
+		len = sizeof(writer->w_io.cmd)
+			+ iiod_buf_size(writer->w_io.buf, writer->w_io.nb_buf);
 
-			if (ret > 0 && (size_t) ret < (size_t) cmd.code)
-				iiod_discard_data(priv, cmd.code - ret);
+		if (ret > 0 || done >= len)
+			writer->w_io.cmd.code = (int32_t) len;
+		else
+			writer->w_io.cmd.code = ret ? (int32_t) ret : -EPIPE;
 
-			iio_mutex_lock(priv->lock);
+		done = done > len ? done - len : 0;
+		rets[i] = writer->w_io.cmd.code < 0 ? writer->w_io.cmd.code : 0;
+	}
+}
 
-			if (ret <= 0) {
-				iiod_responder_signal_io(io, (int32_t) ret);
-				iiod_io_unref_unlocked(io);
-				break;
-			}
-		} else {
-			iio_mutex_lock(priv->lock);
-		}
+static void iiod_responder_wait_ctrl_lane(struct iiod_responder *priv)
+{
+	iio_mutex_lock(priv->lane_lock);
+	while (priv->nb_ctrl_writers)
+		iio_cond_wait(priv->lane_cond, priv->lane_lock, 0);
+	iio_mutex_unlock(priv->lane_lock);
+}
 
-		/* Wake up the reader */
-		iiod_responder_signal_io(io, cmd.code);
-		iiod_io_unref_unlocked(io);
+static void iiod_responder_write_dmabuf(struct iiod_responder *priv,
+					struct iiod_io *writer)
+{
+	struct iiod_buf buf = {
+		.ptr = &writer->w_io.cmd,
+		.size = sizeof(writer->w_io.cmd),
+	};
+	ssize_t ret;
+
+	iiod_responder_wait_ctrl_lane(priv);
+
+	/* The payload must directly follow the header */
+	iio_mutex_lock(priv->write_lock);
+	ret = iiod_rw_all(priv, NULL, &buf, 1, 0, false);
+	if (ret > 0) {
+		ret = priv->ops->write_dmabuf(priv->d, writer->w_io.dmabuf_fd,
+					      writer->w_io.dmabuf_len);
 	}
+	iio_mutex_unlock(priv->write_lock);
 
-	priv->thrd_err_code = priv->thrd_stop ? -EINTR : (int) ret;
-	priv->thrd_stop = true;
+	writer->w_io.cmd.code = (int32_t) ret;
+}
 
-	iiod_responder_cancel_responses(priv);
-	iio_task_stop(priv->write_task);
-	iio_task_flush(priv->write_task);
+/* Called once the data lane is done with the command, or once the command
+ * was removed from the queue without being written. */
+static void iiod_responder_release_order(struct iiod_responder *priv,
+					 struct iiod_io *writer)
+{
+	if (!writer->w_io.ordered)
+		return;
 
+	iio_mutex_lock(priv->lock);
+	priv->nb_data_cmds[writer->w_io.cmd.dev]--;
 	iio_mutex_unlock(priv->lock);
 
-	return (int) ret;
+	writer->w_io.ordered = false;
 }
 
-static int iiod_responder_reader_thrd(void *d)
+static void iiod_responder_write_unfragmented(struct iiod_responder *priv,
+					      struct iiod_io *writer)
 {
-	return iiod_responder_reader_worker(d);
+	struct iiod_buf bufs[NB_BUFS_MAX + 1];
+	size_t nb;
+	ssize_t ret;
+
+	bufs[0].ptr = &writer->w_io.cmd;
+	bufs[0].size = sizeof(writer->w_io.cmd);
+	nb = 1 + iiod_buf_slice(&bufs[1], writer->w_io.buf, writer->w_io.nb_buf,
+				0, iiod_buf_size(writer->w_io.buf,
+						 writer->w_io.nb_buf));
+
+	iiod_responder_wait_ctrl_lane(priv);
+
+	iio_mutex_lock(priv->write_lock);
+	ret = iiod_rw_all(priv, NULL, bufs, nb, 0, false);
+	iio_mutex_unlock(priv->write_lock);
+
+	writer->w_io.cmd.code = (int32_t) ret;
+	iiod_responder_release_order(priv, writer);
 }
 
-static int iiod_responder_write(void *p, void *elm)
+static int iiod_responder_write_data(void *p, void *elm)
 {
 	struct iiod_responder *priv = p;
 	struct iiod_io *writer = elm;
-	struct iiod_command cmd;
-	struct iiod_buf cmd_buf;
-	ssize_t ret;
+	struct iiod_command cmd = writer->w_io.cmd, frag;
+	struct iiod_buf bufs[NB_BUFS_MAX + 2];
+	size_t nb, len, offset = 0, size;
+	ssize_t ret = 0;
 
-	cmd_buf.ptr = &writer->w_io.cmd;
-	cmd_buf.size = sizeof(cmd);
+	if (writer->w_io.dmabuf_len) {
+		iiod_responder_write_dmabuf(priv, writer);
+		return 0;
+	}
+
+	size = iiod_buf_size(writer->w_io.buf, writer->w_io.nb_buf);
+
+	if (size <= IIOD_FRAGMENT_SIZE) {
+		/* Only queued here to stay behind an earlier transfer */
+		iiod_responder_write_unfragmented(priv, writer);
+		return 0;
+	}
+
+	/* The header goes first; the payload follows as fragments. */
+	cmd.op |= IIOD_OP_FLAG_FRAGMENTED;
+	frag.client_id = cmd.client_id;
+	frag.op = IIOD_OP_FRAGMENT;
+
+	while (offset < size) {
+		len = size - offset;
+		if (len > IIOD_FRAGMENT_SIZE)
+			len = IIOD_FRAGMENT_SIZE;
+
+		frag.dev = offset + len == size ? IIOD_FRAGMENT_LAST : 0;
+		frag.code = (int32_t) len;
+
+		nb = 0;
+		if (!offset) {
+			bufs[nb].ptr = &cmd;
+			bufs[nb++].size = sizeof(cmd);
+		}
+
+		bufs[nb].ptr = &frag;
+		bufs[nb++].size = sizeof(frag);
+
+		nb += iiod_buf_slice(&bufs[nb], writer->w_io.buf,
+				     writer->w_io.nb_buf, offset, len);
+
+		/* Give way to the control lane */
+		iiod_responder_wait_ctrl_lane(priv);
+
+		iio_mutex_lock(priv->write_lock);
+		ret = iiod_rw_all(priv, NULL, bufs, nb, 0, false);
+		iio_mutex_unlock(priv->write_lock);
+		if (ret <= 0)
+			break;
+
+		offset += len;
+	}
 
-	ret = iiod_rw_all(priv, &cmd_buf, writer->w_io.buf,
-			  writer->w_io.nb_buf, 0, false);
 	writer->w_io.cmd.code = (int32_t) ret;
+	iiod_responder_release_order(priv, writer);
 
 	return 0;
 }
 
-static int iiod_enqueue_command(struct iiod_io *writer, uint8_t op,
-				uint8_t dev, int32_t code,
-				const struct iiod_buf *buf, size_t nb)
+static int __iiod_enqueue_command(struct iiod_io *writer, uint8_t op,
+				  uint8_t dev, int32_t code,
+				  const struct iiod_buf *buf, size_t nb,
+				  int dmabuf_fd, size_t dmabuf_len)
 {
 	struct iiod_responder *priv = writer->responder;
+	struct iio_task *task = priv->write_task;
 
 	if (nb > NB_BUFS_MAX)
 		return -EINVAL;
@@ -381,6 +1092,8 @@ static int iiod_enqueue_command(struct iiod_io *writer, uint8_t op,
 	if (nb)
 		memcpy(writer->w_io.buf, buf, sizeof(*buf) * nb);
 	writer->w_io.nb_buf = nb;
+	writer->w_io.dmabuf_fd = dmabuf_fd;
+	writer->w_io.dmabuf_len = dmabuf_len;
 
 	if (writer->write_token)
 	      return -EIO;
@@ -391,12 +1104,37 @@ static int iiod_enqueue_command(struct iiod_io *writer, uint8_t op,
 		return priv->thrd_err_code;
 	}
 
-	writer->write_token = iio_task_enqueue(priv->write_task, writer);
+	/* Big payloads are sent by the data lane, so that they don't delay
+	 * the control messages. The commands addressing a device which has
+	 * commands pending in the data lane follow them there, as the remote
+	 * processes a device's commands in the order they arrive. */
+	if (dmabuf_len || ((priv->features & IIOD_FEATURE_FRAGMENTS)
+			   && iiod_buf_size(buf, nb) > IIOD_FRAGMENT_SIZE)
+	    || (op != IIOD_OP_RESPONSE && priv->nb_data_cmds[dev]))
+		task = priv->data_write_task;
+
+	writer->w_io.ordered = task == priv->data_write_task
+		&& op != IIOD_OP_RESPONSE;
+	if (writer->w_io.ordered)
+		priv->nb_data_cmds[dev]++;
+
+	writer->write_token = iio_task_enqueue(task, writer);
+	if (iio_err(writer->write_token) && writer->w_io.ordered) {
+		priv->nb_data_cmds[dev]--;
+		writer->w_io.ordered = false;
+	}
 	iio_mutex_unlock(priv->lock);
 
 	return iio_err(writer->write_token);
 }
 
+static int iiod_enqueue_command(struct iiod_io *writer, uint8_t op,
+				uint8_t dev, int32_t code,
+				const struct iiod_buf *buf, size_t nb)
+{
+	return __iiod_enqueue_command(writer, op, dev, code, buf, nb, -1, 0);
+}
+
 bool iiod_io_command_is_done(struct iiod_io *io)
 {
 	uint64_t timeout_us;
@@ -421,6 +1159,7 @@ int iiod_io_wait_for_command_done(struct iiod_io *io)
 {
 	uint64_t diff_ms = 0, timeout_ms = io->timeout_ms;
 	struct iio_task_token *token;
+	int ret;
 
 	iio_mutex_lock(io->lock);
 	token = io->write_token;
@@ -437,7 +1176,13 @@ int iiod_io_wait_for_command_done(struct iiod_io *io)
 			iio_task_cancel(token);
 	}
 
-	return iio_task_sync(token, (unsigned int)(timeout_ms - diff_ms));
+	ret = iio_task_sync(token, (unsigned int)(timeout_ms - diff_ms));
+
+	/* The command may have been cancelled or flushed before the data
+	 * lane could write it */
+	iiod_responder_release_order(io->responder, io);
+
+	return ret;
 }
 
 bool iiod_io_has_response(struct iiod_io *io)
@@ -502,6 +1247,11 @@ void iiod_io_cancel_response(struct iiod_io *io)
 	iiod_responder_signal_io(io, -EINTR);
 }
 
+uint8_t iiod_io_get_response_flags(const struct iiod_io *io)
+{
+	return io->r_io.cmd.dev;
+}
+
 int iiod_io_send_command_async(struct iiod_io *io,
 			       const struct iiod_command *cmd,
 			       const struct iiod_buf *buf, size_t nb)
@@ -529,6 +1279,19 @@ int iiod_io_send_response_async(struct iiod_io *io, int32_t code,
 	return iiod_enqueue_command(io, IIOD_OP_RESPONSE, 0, code, buf, nb);
 }
 
+int iiod_io_send_response_flags(struct iiod_io *io, uint8_t flags,
+				int32_t code, const struct iiod_buf *buf,
+				size_t nb)
+{
+	int ret;
+
+	ret = iiod_enqueue_command(io, IIOD_OP_RESPONSE, flags, code, buf, nb);
+	if (ret)
+		return ret;
+
+	return iiod_io_wait_for_command_done(io);
+}
+
 int iiod_io_send_response(struct iiod_io *io, int32_t code,
 			  const struct iiod_buf *buf, size_t nb)
 {
@@ -541,6 +1304,22 @@ int iiod_io_send_response(struct iiod_io *io, int32_t code,
 	return iiod_io_wait_for_command_done(io);
 }
 
+int iiod_io_send_response_dmabuf(struct iiod_io *io, int32_t code,
+				 int fd, size_t len)
+{
+	int ret;
+
+	if (!io->responder->ops->write_dmabuf || !len)
+		return -ENOSYS;
+
+	ret = __iiod_enqueue_command(io, IIOD_OP_RESPONSE, 0, code,
+				     NULL, 0, fd, len);
+	if (ret)
+		return ret;
+
+	return iiod_io_wait_for_command_done(io);
+}
+
 int iiod_io_get_response_async(struct iiod_io *io,
 			       const struct iiod_buf *buf, size_t nb)
 {
@@ -560,6 +1339,7 @@ int iiod_io_get_response_async(struct iiod_io *io,
 	if (nb)
 		memcpy(io->r_io.buf, buf, sizeof(*buf) * nb);
 	io->r_io.nb_buf = nb;
+	io->r_io.cmd.dev = 0;
 	io->r_done = false;
 	io->r_next = NULL;
 	io->r_io.start_time = read_counter_us();
@@ -578,6 +1358,20 @@ int iiod_io_get_response_async(struct iiod_io *io,
 	return 0;
 }
 
+int iiod_io_get_responses_cb(struct iiod_io *io,
+			     const struct iiod_buf *buf, size_t nb,
+			     void (*cb)(void *d, int32_t code), void *d)
+{
+	struct iiod_responder *priv = io->responder;
+
+	iio_mutex_lock(priv->lock);
+	io->r_cb = cb;
+	io->r_cb_d = d;
+	iio_mutex_unlock(priv->lock);
+
+	return iiod_io_get_response_async(io, buf, nb);
+}
+
 int iiod_io_exec_command(struct iiod_io *io,
 			 const struct iiod_command *cmd,
 			 const struct iiod_buf *cmd_buf,
@@ -646,6 +1440,25 @@ iiod_io_set_timeout(struct iiod_io *io, unsigned int timeout_ms)
 	io->timeout_ms = timeout_ms;
 }
 
+void iiod_responder_set_features(struct iiod_responder *priv,
+				 uint8_t features)
+{
+	iio_mutex_lock(priv->lock);
+	priv->features = features & IIOD_FEATURES_SUPPORTED;
+	iio_mutex_unlock(priv->lock);
+}
+
+uint8_t iiod_responder_get_features(const struct iiod_responder *priv)
+{
+	return priv->features;
+}
+
+void iiod_command_set_features(struct iiod_command_data *data,
+			       uint8_t features)
+{
+	iiod_responder_set_features((struct iiod_responder *) data, features);
+}
+
 struct iiod_responder *
 iiod_responder_create(const struct iiod_responder_ops *ops, void *d)
 {
@@ -659,6 +1472,14 @@ iiod_responder_create(const struct iiod_responder_ops *ops, void *d)
 	priv->ops = ops;
 	priv->d = d;
 
+	if (ops->read_partial) {
+		priv->rbuf = malloc(IIOD_READ_AHEAD_SIZE);
+		if (!priv->rbuf) {
+			err = -ENOMEM;
+			goto err_free_priv;
+		}
+	}
+
 	priv->lock = iio_mutex_create();
 	err = iio_err(priv->lock);
 	if (err)
@@ -669,31 +1490,79 @@ iiod_responder_create(const struct iiod_responder_ops *ops, void *d)
 	if (err)
 	      goto err_free_lock;
 
-	priv->write_task = iio_task_create(iiod_responder_write, priv,
-					   "iiod-responder-writer-task");
-	err = iio_err(priv->write_task);
+	priv->write_lock = iio_mutex_create();
+	err = iio_err(priv->write_lock);
 	if (err)
 		goto err_free_io;
 
+	priv->lane_lock = iio_mutex_create();
+	err = iio_err(priv->lane_lock);
+	if (err)
+		goto err_free_write_lock;
+
+	priv->lane_cond = iio_cond_create();
+	err = iio_err(priv->lane_cond);
+	if (err)
+		goto err_free_lane_lock;
+
+	priv->read_cond = iio_cond_create();
+	err = iio_err(priv->read_cond);
+	if (err)
+		goto err_free_lane_cond;
+
+	priv->write_bufs = calloc(IIOD_WRITE_BATCH_MAX * (NB_BUFS_MAX + 1),
+				  sizeof(*priv->write_bufs));
+	if (!priv->write_bufs) {
+		err = -ENOMEM;
+		goto err_free_read_cond;
+	}
+
+	priv->write_task = iio_task_create_batch(iiod_responder_write,
+						 IIOD_WRITE_BATCH_MAX, priv,
+						 "iiod-responder-writer-task");
+	err = iio_err(priv->write_task);
+	if (err)
+		goto err_free_write_bufs;
+
+	priv->data_write_task = iio_task_create(iiod_responder_write_data, priv,
+						"iiod-responder-data-writer-task");
+	err = iio_err(priv->data_write_task);
+	if (err)
+		goto err_free_write_task;
+
 	if (!NO_THREADS) {
 		priv->read_thrd = iio_thrd_create(iiod_responder_reader_thrd, priv,
 						  "iiod-responder-reader-thd");
 		err = iio_err(priv->read_thrd);
 		if (err)
-			goto err_free_write_task;
+			goto err_free_data_write_task;
 	}
 
 	iio_task_start(priv->write_task);
+	iio_task_start(priv->data_write_task);
 
 	return priv;
 
+err_free_data_write_task:
+	iio_task_destroy(priv->data_write_task);
 err_free_write_task:
 	iio_task_destroy(priv->write_task);
+err_free_write_bufs:
+	free(priv->write_bufs);
+err_free_read_cond:
+	iio_cond_destroy(priv->read_cond);
+err_free_lane_cond:
+	iio_cond_destroy(priv->lane_cond);
+err_free_lane_lock:
+	iio_mutex_destroy(priv->lane_lock);
+err_free_write_lock:
+	iio_mutex_destroy(priv->write_lock);
 err_free_io:
 	iiod_io_unref(priv->default_io);
 err_free_lock:
 	iio_mutex_destroy(priv->lock);
 err_free_priv:
+	free(priv->rbuf);
 	free(priv);
 	return iio_ptr(err);
 }
@@ -708,10 +1577,18 @@ void iiod_responder_destroy(struct iiod_responder *priv)
 	iiod_responder_stop(priv);
 	iiod_responder_wait_done(priv);
 
+	iio_task_destroy(priv->data_write_task);
 	iio_task_destroy(priv->write_task);
+	free(priv->write_bufs);
+	free(priv->deferred);
 
 	iiod_io_unref(priv->default_io);
+	iio_cond_destroy(priv->read_cond);
+	iio_cond_destroy(priv->lane_cond);
+	iio_mutex_destroy(priv->lane_lock);
+	iio_mutex_destroy(priv->write_lock);
 	iio_mutex_destroy(priv->lock);
+	free(priv->rbuf);
 	free(priv);
 }
 
@@ -743,12 +1620,31 @@ void iiod_io_cancel(struct iiod_io *io)
 	__iiod_io_cancel_unlocked(io);
 	token = io->write_token;
 	io->write_token = NULL;
+
+	/* No more responses will be passed to the callback */
+	io->r_cb = NULL;
+
+	/* Drop the fragmented response being received, if any */
+	if (priv->frag_io == io) {
+		priv->frag_io = NULL;
+		iiod_io_unref_unlocked(io);
+	}
+
+	/* Wait for the response data being read into the buffers, if any.
+	 * Pass the wake-up on, in case another thread waits as well. */
+	if (priv->reading_io == io) {
+		while (priv->reading_io == io)
+			iio_cond_wait(priv->read_cond, priv->lock, 0);
+
+		iio_cond_signal(priv->read_cond);
+	}
 	iio_mutex_unlock(priv->lock);
 
 	/* Discard the entry from the writers list */
 	if (token) {
 		iio_task_cancel(token);
 		iio_task_sync(token, 0);
+		iiod_responder_release_order(priv, io);
 	}
 
 	/* Cancel any pending response request */
@@ -55,9 +55,47 @@ enum iiod_opcode {
 	IIOD_OP_FREE_EVSTREAM,
 	IIOD_OP_READ_EVENT,
 
+	IIOD_OP_SET_FEATURES,
+	IIOD_OP_FRAGMENT,
+	IIOD_OP_PRINT_HASH,
+	IIOD_OP_READ_EVENTS,
+
 	IIOD_NB_OPCODES,
 };
 
+/* Set in the opcode of a message whose payload is sent separately, as a
+ * sequence of IIOD_OP_FRAGMENT messages. */
+#define IIOD_OP_FLAG_FRAGMENTED		0x80
+
+/* Set in the "dev" field of the last IIOD_OP_FRAGMENT of a message. */
+#define IIOD_FRAGMENT_LAST		0x1
+
+/* Optional protocol features. The server advertises the ones it supports in
+ * the "dev" field of its response to IIOD_OP_TIMEOUT; the client then sends
+ * the ones it supports with IIOD_OP_SET_FEATURES. A peer only uses a feature
+ * once the remote advertised it. */
+enum iiod_feature {
+	IIOD_FEATURE_FRAGMENTS		= 1 << 0,
+	IIOD_FEATURE_CONTEXT_HASH	= 1 << 1,
+	IIOD_FEATURE_READ_EVENTS	= 1 << 2,
+	IIOD_FEATURE_EVENT_PUSH		= 1 << 3,
+};
+
+#define IIOD_FEATURES_SUPPORTED		(IIOD_FEATURE_FRAGMENTS | \
+					 IIOD_FEATURE_CONTEXT_HASH | \
+					 IIOD_FEATURE_READ_EVENTS | \
+					 IIOD_FEATURE_EVENT_PUSH)
+
+/* Max. number of events sent in response to IIOD_OP_READ_EVENTS, whose
+ * "code" field contains the number of events requested. */
+#define IIOD_READ_EVENTS_MAX		64
+
+/* Set in the "code" field of IIOD_OP_CREATE_EVSTREAM to subscribe to the
+ * events: once the stream is created, the server sends them as they arrive,
+ * in responses of up to IIOD_READ_EVENTS_MAX events, without waiting for
+ * IIOD_OP_READ_EVENTS commands. */
+#define IIOD_EVSTREAM_PUSH		0x1
+
 struct iiod_command {
 	uint16_t client_id;
 	uint8_t op;
@@ -76,6 +114,17 @@ struct iiod_responder_ops {
 	ssize_t (*read)(void *d, const struct iiod_buf *buf, size_t nb);
 	ssize_t (*write)(void *d, const struct iiod_buf *buf, size_t nb);
 	ssize_t (*discard)(void *d, size_t bytes);
+
+	/* Optional. Read into the buffer, returning as soon as some data is
+	 * available. When set, the responder reads ahead of the message being
+	 * received; it must only be set when the transport never holds back
+	 * data waiting for more. */
+	ssize_t (*read_partial)(void *d, const struct iiod_buf *buf);
+
+	/* Optional. Transfer "len" bytes between the transport and the given
+	 * DMABUF, without the data going through the CPU. */
+	ssize_t (*read_dmabuf)(void *d, int fd, size_t len);
+	ssize_t (*write_dmabuf)(void *d, int fd, size_t len);
 };
 
 /* Create / Destroy IIOD Responder. */
@@ -88,9 +137,19 @@ void iiod_responder_set_timeout(struct iiod_responder *priv,
 				unsigned int timeout_ms);
 void iiod_io_set_timeout(struct iiod_io *io, unsigned int timeout_ms);
 
+/* Set the protocol features supported by the remote */
+void iiod_responder_set_features(struct iiod_responder *priv,
+				 uint8_t features);
+uint8_t iiod_responder_get_features(const struct iiod_responder *priv);
+void iiod_command_set_features(struct iiod_command_data *data,
+			       uint8_t features);
+
 /* Read the current value of the micro-second counter */
 uint64_t iiod_responder_read_counter_us(void);
 
+/* 64-bit FNV-1a hash, used to identify context descriptions */
+uint64_t iiod_responder_hash(const void *data, size_t len);
+
 /* Stop the iiod_responder. */
 void iiod_responder_stop(struct iiod_responder *responder);
 
@@ -126,6 +185,11 @@ void iiod_io_unref(struct iiod_io *io);
 int iiod_command_data_read(struct iiod_command_data *data,
 			   const struct iiod_buf *buf);
 
+/* Read the command's additional data straight into a DMABUF. Returns -ENOSYS
+ * if the transport cannot do it, in which case the data is left untouched. */
+int iiod_command_data_read_dmabuf(struct iiod_command_data *data,
+				  int fd, size_t len);
+
 /* Send command or response to the remote */
 int iiod_io_send_command(struct iiod_io *io,
 			 const struct iiod_command *cmd,
@@ -133,12 +197,23 @@ int iiod_io_send_command(struct iiod_io *io,
 int iiod_io_send_response(struct iiod_io *io, int32_t code,
 			  const struct iiod_buf *buf, size_t nb);
 
+/* Variant of iiod_io_send_response that sets the "dev" field of the
+ * response header to the given flags. */
+int iiod_io_send_response_flags(struct iiod_io *io, uint8_t flags,
+				int32_t code, const struct iiod_buf *buf,
+				size_t nb);
+
 /* Send command, then read the response. */
 int iiod_io_exec_command(struct iiod_io *io,
 			 const struct iiod_command *cmd,
 			 const struct iiod_buf *cmd_buf,
 			 const struct iiod_buf *buf);
 
+/* Send a response whose payload is the content of a DMABUF. Returns -ENOSYS
+ * if the transport cannot send DMABUFs. */
+int iiod_io_send_response_dmabuf(struct iiod_io *io, int32_t code,
+				 int fd, size_t len);
+
 /* Simplified version of iiod_io_exec_command.
  * Send a simple command then read the response code. */
 static inline int
@@ -171,11 +246,22 @@ iiod_io_send_response_code(struct iiod_io *io, int32_t code)
 int iiod_io_get_response_async(struct iiod_io *io,
 			       const struct iiod_buf *buf, size_t nb);
 
+/* Variant of iiod_io_get_response_async where the iiod_io stays registered:
+ * every response is read into the buffers, then passed to the callback, until
+ * iiod_io_cancel() is called. The callback runs from the responder's thread,
+ * and must not call any of the iiod_responder functions. */
+int iiod_io_get_responses_cb(struct iiod_io *io,
+			     const struct iiod_buf *buf, size_t nb,
+			     void (*cb)(void *d, int32_t code), void *d);
+
 /* Wait for iiod_io_get_response_async to be done. */
 int32_t iiod_io_wait_for_response(struct iiod_io *io);
 
 _Bool iiod_io_has_response(struct iiod_io *io);
 
+/* Get the flags set in the header of the last response received */
+uint8_t iiod_io_get_response_flags(const struct iiod_io *io);
+
 void iiod_io_cancel_response(struct iiod_io *io);
 
 #endif /* __IIOD_RESPONDER_H__ */
@@ -48,6 +48,7 @@ static const struct option options[] = {
 	  {"serial", required_argument, 0, 's'},
 	  {"port", required_argument, 0, 'p'},
 	  {"uri", required_argument, 0, 'u'},
+	  {"cache-dir", required_argument, 0, 'c'},
 	  {0, 0, 0, 0},
 };
 
@@ -65,6 +66,8 @@ static const char *options_descriptions[] = {
 		"\n\t\t\t    'usb:1.2.3', or 'usb:'"
 		"\n\t\t\t    'serial:/dev/ttyUSB0,115200,8n1'"
 		"\n\t\t\t    'local:' (default)"),
+	("Cache the description of the context in the given directory"
+		"\n\t\t\t(e.g. /run/iiod), to speed up restarts."),
 };
 
 static void usage(void)
@@ -99,14 +102,20 @@ static void sig_handler_usr1(int sig)
 	thread_pool_stop(main_thread_pool);
 }
 
-static void *get_xml_zstd_data(const struct iio_context *ctx, size_t *out_len)
+void *get_xml_zstd_data(const struct iio_context *ctx, size_t *out_len)
 {
 	char *xml = iio_context_get_xml(ctx);
-	size_t len, xml_len = strlen(xml);
+	size_t len, xml_len;
 	void *buf;
 #if WITH_ZSTD
 	size_t ret;
+#endif
+
+	if (iio_err(xml))
+		return NULL;
 
+	xml_len = strlen(xml);
+#if WITH_ZSTD
 	len = ZSTD_compressBound(xml_len);
 	buf = malloc(len);
 	if (!buf) {
@@ -183,7 +192,7 @@ int main(int argc, char **argv)
 	uint16_t port = IIOD_PORT;
 	int ret, ep0_fd = 0;
 
-	while ((c = getopt_long(argc, argv, "+hVdDF:n:s:p:u:",
+	while ((c = getopt_long(argc, argv, "+hVdDF:n:s:p:u:c:",
 					options, &option_index)) != -1) {
 		switch (c) {
 		case 'd':
@@ -233,6 +242,9 @@ int main(int argc, char **argv)
 		case 'u':
 			uri = optarg;
 			break;
+		case 'c':
+			iiod_params.cache_dir = optarg;
+			break;
 		case 'h':
 			usage();
 			return EXIT_SUCCESS;
@@ -11,12 +11,15 @@
 #include "ops.h"
 #include "thread-pool.h"
 
+#include "../iiod-responder.h"
+
 #include <poll.h>
 #if WITH_AIO
 #include <pthread.h>
 #include <sys/eventfd.h>
 #endif
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #if WITH_AIO
 static ssize_t async_io(struct parser_pdata *pdata, void *buf, size_t len,
@@ -156,8 +159,13 @@ static ssize_t readfd_io(struct parser_pdata *pdata, void *dest, size_t len)
 	return ret;
 }
 
-static ssize_t writefd_io(struct parser_pdata *pdata, const void *src, size_t len)
+static ssize_t writevfd_io(struct parser_pdata *pdata,
+			   const struct iovec *iov, int iovcnt)
 {
+	struct msghdr msg = {
+		.msg_iov = (struct iovec *) iov,
+		.msg_iovlen = iovcnt,
+	};
 	ssize_t ret;
 	struct pollfd pfd[2];
 
@@ -181,9 +189,9 @@ static ssize_t writefd_io(struct parser_pdata *pdata, const void *src, size_t le
 
 		do {
 			if (pdata->fd_out_is_socket)
-				ret = send(pdata->fd_out, src, len, MSG_NOSIGNAL);
+				ret = sendmsg(pdata->fd_out, &msg, MSG_NOSIGNAL);
 			else
-				ret = write(pdata->fd_out, src, len);
+				ret = writev(pdata->fd_out, iov, iovcnt);
 		} while (ret == -1 && errno == EINTR);
 
 		if (ret != -1 || errno != EAGAIN)
@@ -196,12 +204,24 @@ static ssize_t writefd_io(struct parser_pdata *pdata, const void *src, size_t le
 	return ret;
 }
 
+static ssize_t writefd_io(struct parser_pdata *pdata, const void *src, size_t len)
+{
+	struct iovec iov = {
+		.iov_base = (void *) src,
+		.iov_len = len,
+	};
+
+	return writevfd_io(pdata, &iov, 1);
+}
+
 void interpreter(struct iio_context *ctx, int fd_in, int fd_out,
 		 bool is_socket, bool is_usb,
 		 struct thread_pool *pool, const void *xml_zstd,
 		 size_t xml_zstd_len)
 {
 	struct parser_pdata pdata = { 0 };
+	void *live_xml_zstd;
+	size_t live_xml_zstd_len = 0;
 	unsigned int i;
 	int ret;
 
@@ -211,13 +231,39 @@ void interpreter(struct iio_context *ctx, int fd_in, int fd_out,
 	pdata.pool = pool;
 	pdata.binary = !WITH_IIOD_V0_COMPAT;
 
-	pdata.xml_zstd = xml_zstd;
-	pdata.xml_zstd_len = xml_zstd_len;
+	/* The description is generated for each client, so that it carries
+	 * the current scale and offset values. Fall back to the one built at
+	 * startup if it cannot be generated. */
+	live_xml_zstd = get_xml_zstd_data(ctx, &live_xml_zstd_len);
+	if (live_xml_zstd) {
+		pdata.xml_zstd = live_xml_zstd;
+		pdata.xml_zstd_len = live_xml_zstd_len;
+	} else {
+		pdata.xml_zstd = xml_zstd;
+		pdata.xml_zstd_len = xml_zstd_len;
+	}
+
+	if (pdata.xml_zstd) {
+		snprintf(pdata.xml_zstd_hash, sizeof(pdata.xml_zstd_hash),
+			 "%016llx", (unsigned long long)
+			 iiod_responder_hash(pdata.xml_zstd,
+					     pdata.xml_zstd_len));
+	}
 
 	pdata.fd_in_is_socket = is_socket;
 	pdata.fd_out_is_socket = is_socket;
 	pdata.is_usb = is_usb;
 
+	/* USB endpoints only complete a read on a short packet, so reading
+	 * ahead of the current message could stall until the client sends
+	 * more data. */
+	pdata.read_ahead = !is_usb;
+
+	/* For the same reason, messages sent to USB clients must not be
+	 * merged together, as the client reads them one by one. */
+	if (!is_usb)
+		pdata.writevfd = writevfd_io;
+
 	SLIST_INIT(&pdata.thdlist_head);
 
 #if WITH_AIO
@@ -239,8 +285,16 @@ void interpreter(struct iio_context *ctx, int fd_in, int fd_out,
 		pthread_mutex_init(&pdata.aio_mutex[i], NULL);
 	}
 
-	pdata.readfd = readfd_aio;
-	pdata.writefd = writefd_aio;
+	/* Only the FunctionFS endpoints need async. I/O. The other file
+	 * descriptors are polled, so that a read returns as soon as data
+	 * arrives and a STOP request interrupts it. */
+	if (is_usb) {
+		pdata.readfd = readfd_aio;
+		pdata.writefd = writefd_aio;
+	} else {
+		pdata.readfd = readfd_io;
+		pdata.writefd = writefd_io;
+	}
 #else
 	pdata.readfd = readfd_io;
 	pdata.writefd = writefd_io;
@@ -260,4 +314,6 @@ err_free_aio:
 		pthread_mutex_destroy(&pdata.aio_mutex[i - 1]);
 	}
 #endif
+
+	free(live_xml_zstd);
 }
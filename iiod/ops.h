@@ -45,6 +45,7 @@
 
 struct iio_mutex;
 struct iio_task;
+struct iovec;
 struct iiod_io;
 struct pollfd;
 struct thread_pool;
@@ -61,6 +62,10 @@ struct block_entry {
 	uint64_t bytes_used;
 	uint16_t idx;
 	bool cyclic;
+
+	/* DMABUF attached to the USB endpoint the block's data goes
+	 * through, or -1 if the data is copied */
+	int dmabuf_fd, ep_fd;
 };
 
 struct buffer_entry {
@@ -84,6 +89,13 @@ struct evstream_entry {
 	struct iio_task *task;
 	struct iiod_io *io;
 	uint16_t client_id;
+
+	/* Max. number of events to send in the next response */
+	unsigned int nb_events;
+
+	/* Set if the client subscribed to the events, which are then sent
+	 * without waiting for read requests */
+	bool push;
 };
 
 struct parser_pdata {
@@ -100,6 +112,10 @@ struct parser_pdata {
 	bool channel_is_output;
 	bool fd_in_is_socket, fd_out_is_socket;
 	bool is_usb;
+
+	/* Set if readfd returns as soon as some data is available, and the
+	 * transport never holds back data waiting for more. */
+	bool read_ahead;
 #if WITH_AIO
 	io_context_t aio_ctx[2];
 	int aio_eventfd[2];
@@ -110,8 +126,12 @@ struct parser_pdata {
 
 	const void *xml_zstd;
 	size_t xml_zstd_len;
+	char xml_zstd_hash[17];
 
 	ssize_t (*writefd)(struct parser_pdata *pdata, const void *buf, size_t len);
+	/* Optional; when set, the messages are gathered into vectored writes */
+	ssize_t (*writevfd)(struct parser_pdata *pdata,
+			    const struct iovec *iov, int iovcnt);
 	ssize_t (*readfd)(struct parser_pdata *pdata, void *buf, size_t len);
 };
 
@@ -127,11 +147,16 @@ void interpreter(struct iio_context *ctx, int fd_in, int fd_out,
 		 const void *xml_zstd, size_t xml_zstd_len);
 void ascii_interpreter(struct parser_pdata *pdata);
 
+void *get_xml_zstd_data(const struct iio_context *ctx, size_t *out_len);
+
 int init_usb_daemon(const char *ffs, unsigned int nb_pipes);
 int start_usb_daemon(struct iio_context *ctx, const char *ffs,
 		     unsigned int nb_pipes,
 		     int ep0_fd, struct thread_pool *pool,
 		     const void *xml_zstd, size_t xml_zstd_len);
+int usb_attach_dmabuf(int ep_fd, int fd);
+int usb_detach_dmabuf(int ep_fd, int fd);
+ssize_t usb_transfer_dmabuf(int ep_fd, int fd, size_t len);
 int start_serial_daemon(struct iio_context *ctx, const char *uart_params,
 			struct thread_pool *pool,
 			const void *xml_zstd, size_t xml_zstd_len);
@@ -16,10 +16,15 @@
 #include <iio/iio-lock.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #define ARRAY_SIZE(x) (sizeof(x) ? sizeof(x) / sizeof((x)[0]) : 0)
 
+/* Maximum number of buffers passed to a single vectored write. The responder
+ * calls back for the remaining ones. */
+#define IIOD_WRITEV_MAX 64
+
 /* Forward declaration */
 static struct iio_buffer * get_iio_buffer(struct parser_pdata *pdata,
 					  const struct iiod_command *cmd,
@@ -39,6 +44,10 @@ static void free_block_entry(struct block_entry *entry)
 {
 	iiod_io_cancel(entry->io);
 	iiod_io_unref(entry->io);
+
+	if (WITH_IIOD_USBD && entry->dmabuf_fd >= 0)
+		usb_detach_dmabuf(entry->ep_fd, entry->dmabuf_fd);
+
 	iio_block_destroy(entry->block);
 	free(entry);
 }
@@ -90,16 +99,54 @@ static void handle_print(struct parser_pdata *pdata,
 	}
 }
 
+static void handle_print_hash(struct parser_pdata *pdata,
+			      const struct iiod_command *cmd,
+			      struct iiod_command_data *cmd_data)
+{
+	struct iiod_io *io = iiod_command_get_default_io(cmd_data);
+	struct iiod_buf buf;
+
+	if (!pdata->xml_zstd) {
+		iiod_io_send_response_code(io, -EINVAL);
+		return;
+	}
+
+	buf.ptr = pdata->xml_zstd_hash;
+	buf.size = sizeof(pdata->xml_zstd_hash) - 1;
+
+	iiod_io_send_response(io, (int32_t) buf.size, &buf, 1);
+}
+
 static void handle_timeout(struct parser_pdata *pdata,
 			   const struct iiod_command *cmd,
 			   struct iiod_command_data *cmd_data)
 {
 	struct iiod_io *io = iiod_command_get_default_io(cmd_data);
 	struct iio_context *ctx = pdata->ctx;
+	uint8_t features = IIOD_FEATURES_SUPPORTED;
 	int ret;
 
 	ret = iio_context_set_timeout(pdata->ctx, cmd->code);
-	iiod_io_send_response_code(io, ret);
+
+	/* The hash is only served along with the description */
+	if (!pdata->xml_zstd)
+		features &= ~IIOD_FEATURE_CONTEXT_HASH;
+
+	/* Advertise the optional protocol features we support. Older clients
+	 * just ignore the flags of the response. */
+	iiod_io_send_response_flags(io, features, ret, NULL, 0);
+}
+
+static void handle_set_features(struct parser_pdata *pdata,
+				const struct iiod_command *cmd,
+				struct iiod_command_data *cmd_data)
+{
+	struct iiod_io *io = iiod_command_get_default_io(cmd_data);
+
+	/* The client tells us which of the features we advertised it
+	 * supports as well. */
+	iiod_command_set_features(cmd_data, (uint8_t) cmd->code);
+	iiod_io_send_response_code(io, 0);
 }
 
 static const struct iio_attr *
@@ -331,6 +378,12 @@ static int buffer_dequeue_block(void *priv, void *d)
 		nb_data++;
 
 		ret = data.size;
+
+		if (entry->dmabuf_fd >= 0
+		    && !iiod_io_send_response_dmabuf(entry->io, ret,
+						     entry->dmabuf_fd,
+						     data.size))
+			return 0;
 	}
 
 out_send_response:
@@ -617,6 +670,30 @@ static void handle_disable_buffer(struct parser_pdata *pdata,
 	handle_set_enabled_buffer(pdata, cmd, cmd_data, false);
 }
 
+/* Let the USB gadget transfer the block's data straight from/to its DMABUF.
+ * If the kernel does not support it, the data is copied as usual. */
+static void block_entry_attach_dmabuf(struct parser_pdata *pdata,
+				      struct iio_buffer *buf,
+				      struct block_entry *entry)
+{
+	int fd, ep_fd, ret;
+
+	fd = iio_block_get_dmabuf_fd(entry->block);
+	if (fd < 0)
+		return;
+
+	ep_fd = iio_buffer_is_tx(buf) ? pdata->fd_in : pdata->fd_out;
+
+	ret = usb_attach_dmabuf(ep_fd, fd);
+	if (ret) {
+		IIO_DEBUG("Unable to attach DMABUF to USB endpoint: %d\n", ret);
+		return;
+	}
+
+	entry->dmabuf_fd = fd;
+	entry->ep_fd = ep_fd;
+}
+
 static void handle_create_block(struct parser_pdata *pdata,
 				const struct iiod_command *cmd,
 				struct iiod_command_data *cmd_data)
@@ -673,6 +750,10 @@ static void handle_create_block(struct parser_pdata *pdata,
 	entry->block = block;
 	entry->io = io;
 	entry->idx = cmd->code >> 16;
+	entry->dmabuf_fd = -1;
+
+	if (WITH_IIOD_USBD && pdata->is_usb)
+		block_entry_attach_dmabuf(pdata, buf, entry);
 
 	/* Keep a reference to the iiod_io until the block is freed. */
 	iiod_io_ref(io);
@@ -783,7 +864,14 @@ static void handle_transfer_block(struct parser_pdata *pdata,
 		readbuf.ptr = iio_block_start(block);
 		readbuf.size = iio_block_end(block) - readbuf.ptr;
 
-		ret = iiod_command_data_read(cmd_data, &readbuf);
+		ret = -ENOSYS;
+		if (block_entry->dmabuf_fd >= 0) {
+			ret = iiod_command_data_read_dmabuf(cmd_data,
+							    block_entry->dmabuf_fd,
+							    readbuf.size);
+		}
+		if (ret == -ENOSYS)
+			ret = iiod_command_data_read(cmd_data, &readbuf);
 		if (ret < 0)
 			goto out_send_response;
 	}
@@ -867,14 +955,14 @@ void iiod_set_event(struct iio_event_stream *stream,
 static int evstream_read(void *priv, void *d)
 {
 	struct evstream_entry *entry = priv;
-	struct iio_event event;
+	struct iio_event events[IIOD_READ_EVENTS_MAX];
 	struct iiod_buf buf = {
-		.ptr = &event,
-		.size = sizeof(event),
+		.ptr = events,
 	};
-	int ret;
+	ssize_t ret;
 
-	ret = iio_event_stream_read(entry->stream, &event, false);
+	ret = iio_event_stream_read_many(entry->stream, events,
+					 entry->nb_events, false);
 	if (ret == -EAGAIN) {
 		/* If iio_event_stream_read() returned -EAGAIN for a blocking
 		 * read, trust that the application will call iiod_set_event(). */
@@ -882,9 +970,17 @@ static int evstream_read(void *priv, void *d)
 	}
 
 	if (ret < 0)
-	      return iiod_io_send_response_code(entry->io, ret);
+	      return iiod_io_send_response_code(entry->io, (int) ret);
+
+	buf.size = (size_t) ret * sizeof(events[0]);
 
-	return iiod_io_send_response(entry->io, sizeof(event), &buf, 1);
+	ret = iiod_io_send_response(entry->io, (int32_t) buf.size, &buf, 1);
+	if (ret < 0 || !entry->push)
+		return (int) ret;
+
+	/* Subscribed client: wait for the next batch of events right away.
+	 * Whatever got queued in the meantime is sent in one response. */
+	return iio_task_enqueue_autoclear(entry->task, entry);
 }
 
 static void handle_create_evstream(struct parser_pdata *pdata,
@@ -893,7 +989,7 @@ static void handle_create_evstream(struct parser_pdata *pdata,
 {
 	const struct iio_context *ctx = pdata->ctx;
 	const struct iio_device *dev;
-	struct evstream_entry *entry;
+	struct evstream_entry *entry = NULL;
 	struct iiod_io *io;
 	int ret = -EINVAL;
 
@@ -918,6 +1014,8 @@ static void handle_create_evstream(struct parser_pdata *pdata,
 	entry->dev = dev;
 	entry->client_id = cmd->client_id;
 	entry->pdata = pdata;
+	entry->push = cmd->code & IIOD_EVSTREAM_PUSH;
+	entry->nb_events = IIOD_READ_EVENTS_MAX;
 
 	entry->stream = iio_device_create_event_stream(dev);
 	ret = iio_err(entry->stream);
@@ -946,6 +1044,15 @@ static void handle_create_evstream(struct parser_pdata *pdata,
 
 out_send_response:
 	iiod_io_send_response_code(io, ret);
+
+	/* Only start sending events once the client got the response, so that
+	 * it can tell them apart. */
+	if (!ret && entry->push) {
+		ret = iio_task_enqueue_autoclear(entry->task, entry);
+		if (ret)
+			iiod_io_send_response_code(io, ret);
+	}
+
 	iiod_io_unref(io);
 }
 
@@ -1024,7 +1131,19 @@ static void handle_read_event(struct parser_pdata *pdata,
 		return;
 	}
 
-	if (cmd->code) {
+	if (cmd->op == IIOD_OP_READ_EVENTS) {
+		/* Send all the events queued, up to the number requested */
+		if (cmd->code <= 0)
+			entry->nb_events = 1;
+		else if (cmd->code > IIOD_READ_EVENTS_MAX)
+			entry->nb_events = IIOD_READ_EVENTS_MAX;
+		else
+			entry->nb_events = (unsigned int) cmd->code;
+	} else {
+		entry->nb_events = 1;
+	}
+
+	if (cmd->op == IIOD_OP_READ_EVENT && cmd->code) {
 		struct iio_event event;
 		struct iiod_buf buf = {
 			.ptr = &event,
@@ -1078,6 +1197,10 @@ static const iiod_opcode_fn iiod_op_functions[] = {
 	[IIOD_OP_CREATE_EVSTREAM]	= handle_create_evstream,
 	[IIOD_OP_FREE_EVSTREAM]		= handle_free_evstream,
 	[IIOD_OP_READ_EVENT]		= handle_read_event,
+	[IIOD_OP_READ_EVENTS]		= handle_read_event,
+
+	[IIOD_OP_SET_FEATURES]		= handle_set_features,
+	[IIOD_OP_PRINT_HASH]		= handle_print_hash,
 };
 
 static int iiod_cmd(const struct iiod_command *cmd,
@@ -1085,7 +1208,8 @@ static int iiod_cmd(const struct iiod_command *cmd,
 {
 	struct parser_pdata *pdata = d;
 
-	if (cmd->op >= IIOD_NB_OPCODES) {
+	if (cmd->op >= ARRAY_SIZE(iiod_op_functions)
+	    || !iiod_op_functions[cmd->op]) {
 		IIO_ERROR("Received invalid opcode 0x%x\n", cmd->op);
 		return -EINVAL;
 	}
@@ -1102,13 +1226,89 @@ static ssize_t iiod_read(void *d, const struct iiod_buf *buf, size_t nb)
 
 static ssize_t iiod_write(void *d, const struct iiod_buf *buf, size_t nb)
 {
-	return write_all(d, buf->ptr, buf->size);
+	struct parser_pdata *pdata = d;
+	struct iovec iov[IIOD_WRITEV_MAX];
+	ssize_t ret;
+	size_t i;
+
+	if (!pdata->writevfd || nb == 1)
+		return write_all(pdata, buf->ptr, buf->size);
+
+	if (nb > ARRAY_SIZE(iov))
+		nb = ARRAY_SIZE(iov);
+
+	for (i = 0; i < nb; i++) {
+		iov[i].iov_base = buf[i].ptr;
+		iov[i].iov_len = buf[i].size;
+	}
+
+	ret = pdata->writevfd(pdata, iov, (int) nb);
+
+	return ret ? ret : -EPIPE;
+}
+
+static ssize_t iiod_read_partial(void *d, const struct iiod_buf *buf)
+{
+	struct parser_pdata *pdata = d;
+	ssize_t ret;
+
+	ret = pdata->readfd(pdata, buf->ptr, buf->size);
+
+	return ret ? ret : -EPIPE;
+}
+
+static ssize_t iiod_discard(void *d, size_t bytes)
+{
+	char buf[0x1000];
+
+	if (bytes > sizeof(buf))
+		bytes = sizeof(buf);
+
+	return read_all(d, buf, bytes);
 }
 
 static const struct iiod_responder_ops iiod_responder_ops = {
 	.cmd	= iiod_cmd,
 	.read	= iiod_read,
 	.write	= iiod_write,
+	.discard = iiod_discard,
+};
+
+static ssize_t iiod_read_dmabuf(void *d, int fd, size_t len)
+{
+	struct parser_pdata *pdata = d;
+
+	if (!WITH_IIOD_USBD)
+		return -ENOSYS;
+
+	return usb_transfer_dmabuf(pdata->fd_in, fd, len);
+}
+
+static ssize_t iiod_write_dmabuf(void *d, int fd, size_t len)
+{
+	struct parser_pdata *pdata = d;
+
+	if (!WITH_IIOD_USBD)
+		return -ENOSYS;
+
+	return usb_transfer_dmabuf(pdata->fd_out, fd, len);
+}
+
+static const struct iiod_responder_ops iiod_responder_usb_ops = {
+	.cmd	= iiod_cmd,
+	.read	= iiod_read,
+	.write	= iiod_write,
+	.discard = iiod_discard,
+	.read_dmabuf = iiod_read_dmabuf,
+	.write_dmabuf = iiod_write_dmabuf,
+};
+
+static const struct iiod_responder_ops iiod_responder_readahead_ops = {
+	.cmd	= iiod_cmd,
+	.read	= iiod_read,
+	.write	= iiod_write,
+	.discard = iiod_discard,
+	.read_partial = iiod_read_partial,
 };
 
 static void iiod_responder_free_resources(struct parser_pdata *pdata)
@@ -1148,9 +1348,15 @@ static void iiod_responder_free_resources(struct parser_pdata *pdata)
 
 int binary_parse(struct parser_pdata *pdata)
 {
+	const struct iiod_responder_ops *ops = &iiod_responder_ops;
 	struct iiod_responder *responder;
 
-	responder = iiod_responder_create(&iiod_responder_ops, pdata);
+	if (pdata->read_ahead)
+		ops = &iiod_responder_readahead_ops;
+	else if (WITH_IIOD_USBD && pdata->is_usb)
+		ops = &iiod_responder_usb_ops;
+
+	responder = iiod_responder_create(ops, pdata);
 	if (!responder)
 		return -ENOMEM;
 
@@ -64,6 +64,21 @@ static void serial_main(struct thread_pool *pool, void *d)
 	free(pdata);
 }
 
+/* Ask the driver to push received bytes to the reader right away instead of
+ * batching them. Not all drivers support it, so failures are ignored. */
+static void serial_set_low_latency(int fd)
+{
+	struct serial_struct serinfo;
+
+	if (ioctl(fd, TIOCGSERIAL, &serinfo) == -1)
+		return;
+
+	serinfo.flags |= ASYNC_LOW_LATENCY;
+
+	if (ioctl(fd, TIOCSSERIAL, &serinfo) == -1)
+		IIO_DEBUG("Unable to set low-latency mode: %d\n", -errno);
+}
+
 static int serial_configure(int fd, unsigned int uart_bps,
 			    unsigned int uart_bits,
 			    char uart_parity,
@@ -225,6 +240,8 @@ static int serial_configure(int fd, unsigned int uart_bps,
 		return err;
 	}
 
+	serial_set_low_latency(fd);
+
 	return 0;
 }
 
@@ -246,7 +263,8 @@ int start_serial_daemon(struct iio_context *ctx, const char *uart_params,
 	if (!pdata)
 		goto err_free_dev;
 
-	fd = open(dev, O_RDWR | O_CLOEXEC);
+	/* Non-blocking, so that reads and writes go through poll() */
+	fd = open(dev, O_RDWR | O_CLOEXEC | O_NONBLOCK);
 	if (fd == -1) {
 		err = -errno;
 		goto err_free_pdata;
@@ -15,6 +15,7 @@
 #include <poll.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/ioctl.h>
 
 /* u8"IIO" for non-c11 compilers */
 #define NAME "\x0049\x0049\x004F"
@@ -26,6 +27,20 @@
 #define IIO_USD_CMD_OPEN_PIPE 1
 #define IIO_USD_CMD_CLOSE_PIPE 2
 
+/* DMABUF interface of FunctionFS, from Linux 6.9 */
+#ifndef FUNCTIONFS_DMABUF_TRANSFER
+struct usb_ffs_dmabuf_transfer_req {
+	int fd;
+	uint32_t flags;
+	uint64_t length;
+} __attribute__((packed));
+
+#define FUNCTIONFS_DMABUF_ATTACH	_IOW('g', 131, int)
+#define FUNCTIONFS_DMABUF_DETACH	_IOW('g', 132, int)
+#define FUNCTIONFS_DMABUF_TRANSFER	_IOW('g', 133, \
+					     struct usb_ffs_dmabuf_transfer_req)
+#endif
+
 
 struct usb_ffs_header {
 	struct usb_functionfs_descs_head_v2 header;
@@ -79,6 +94,56 @@ static void usbd_client_thread(struct thread_pool *pool, void *d)
 	free(pdata);
 }
 
+int usb_attach_dmabuf(int ep_fd, int fd)
+{
+	int ret;
+
+	ret = ioctl(ep_fd, FUNCTIONFS_DMABUF_ATTACH, &fd);
+	if (ret == -1)
+		return -errno;
+
+	return 0;
+}
+
+int usb_detach_dmabuf(int ep_fd, int fd)
+{
+	int ret;
+
+	ret = ioctl(ep_fd, FUNCTIONFS_DMABUF_DETACH, &fd);
+	if (ret == -1)
+		return -errno;
+
+	return 0;
+}
+
+ssize_t usb_transfer_dmabuf(int ep_fd, int fd, size_t len)
+{
+	struct usb_ffs_dmabuf_transfer_req req = {
+		.fd = fd,
+		.length = len,
+	};
+	struct pollfd pfd = {
+		.fd = fd,
+		.events = POLLOUT,
+	};
+	int ret;
+
+	ret = ioctl(ep_fd, FUNCTIONFS_DMABUF_TRANSFER, &req);
+	if (ret == -1)
+		return -errno;
+
+	/* The transfer is asynchronous; the DMABUF becomes writable again
+	 * once the USB controller is done with it. */
+	ret = poll_nointr(&pfd, 1);
+	if (ret < 0)
+		return -errno;
+
+	if (pfd.revents & (POLLERR | POLLNVAL))
+		return -EIO;
+
+	return (ssize_t) len;
+}
+
 static int usb_open_pipe(struct usbd_pdata *pdata, unsigned int pipe_id)
 {
 	struct usbd_client_pdata *cpdata;
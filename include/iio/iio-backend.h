@@ -48,6 +48,7 @@ struct iio_buffer;
 struct iio_device;
 struct iio_context;
 struct iio_channel;
+struct iio_block_allocator;
 struct iio_block_pdata;
 struct iio_buffer_pdata;
 struct iio_context_pdata;
@@ -131,6 +132,25 @@ struct iio_backend_ops {
 	int (*read_ev)(struct iio_event_stream_pdata *pdata,
 		       struct iio_event *out_event,
 		       bool nonblock);
+
+	struct iio_block_pdata *
+		(*create_block_from_dmabuf)(struct iio_buffer_pdata *pdata,
+					    int fd, size_t size, void **data);
+
+	/* Called once the buffer is created, with the allocator to use for
+	 * the memory of its blocks. */
+	void (*set_block_allocator)(struct iio_buffer_pdata *pdata,
+				    struct iio_block_allocator *alloc);
+
+	struct iio_block_pdata *
+		(*create_block_from_memory)(struct iio_buffer_pdata *pdata,
+					    void *ptr, size_t size);
+
+	ssize_t (*read_ev_many)(struct iio_event_stream_pdata *pdata,
+				struct iio_event *events, size_t nb,
+				bool nonblock);
+
+	uint64_t (*get_ev_overflows)(struct iio_event_stream_pdata *pdata);
 };
 
 /**
@@ -198,6 +218,12 @@ iio_channel_get_pdata(const struct iio_channel *chn);
 __api void
 iio_channel_set_pdata(struct iio_channel *chn, struct iio_channel_pdata *data);
 
+/* Mark the scale and offset of the channel's data format as up to date, so
+ * that they are not read back from the channel's attributes when the
+ * context is created. */
+__api void
+iio_channel_set_scale_offset_known(struct iio_channel *chn);
+
 __api int
 iio_scan_add_result(struct iio_scan *ctx, const char *desc, const char *uri);
 
@@ -214,6 +240,13 @@ iio_snprintf(char *buf, size_t len, const char *fmt, ...);
 __api char *iio_strdup(const char *str);
 __api size_t iio_strlcpy(char * __restrict dst, const char * __restrict src, size_t dsize);
 
+/* Allocate and free the memory of a block. A NULL allocator falls back to
+ * malloc() and free(). */
+__api void *
+iio_block_allocator_alloc(struct iio_block_allocator *alloc, size_t size);
+__api void
+iio_block_allocator_free(struct iio_block_allocator *alloc, void *data);
+
 __api struct iio_context *
 iio_create_context_from_xml(const struct iio_context_params *params,
 			    const char *uri, const struct iio_backend *backend,
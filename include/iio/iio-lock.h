@@ -38,6 +38,13 @@ __api int iio_thrd_join_and_destroy(struct iio_thrd *thrd);
 
 __api struct iio_task * iio_task_create(int (*task)(void *firstarg, void *d),
 					void *firstarg, const char *name);
+/* Variant of iio_task_create() where the callback receives all the elements
+ * queued at the time it runs (up to "max"), and stores the return value of
+ * each element into the "rets" array. */
+__api struct iio_task *
+iio_task_create_batch(void (*task)(void *firstarg, void **elms,
+				   int *rets, unsigned int nb),
+		      unsigned int max, void *firstarg, const char *name);
 __api void iio_task_flush(struct iio_task *task);
 __api int iio_task_destroy(struct iio_task *task);
 
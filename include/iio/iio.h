@@ -96,6 +96,8 @@ struct iio_event_stream;
 struct iio_buffer;
 struct iio_scan;
 struct iio_stream;
+struct iio_relay;
+struct iio_recorder;
 
 /**
  * @enum iio_log_level
@@ -152,8 +154,15 @@ struct iio_context_params {
 	/** @brief Timeout for I/O operations. If zero, the default timeout is used. */
 	unsigned int timeout_ms;
 
+	/** @brief Existing directory where the descriptions of remote contexts
+	 * are cached, keyed by the hash advertised by the server and the URI.
+	 * The local backend also stores there a snapshot of the local context,
+	 * used as long as the IIO devices and the kernel do not change.
+	 * If NULL, nothing is cached. */
+	const char *cache_dir;
+
 	/** @brief Reserved for future fields. */
-	char __rsrv[32];
+	char __rsrv[32 - sizeof(void *)];
 };
 
 /*
@@ -550,7 +559,9 @@ iio_get_builtin_backend(unsigned int index);
  * - USB backend, "usb:"\n When more than one usb device is attached, requires
  *   bus, address, and interface parts separated with a dot. For example
  *   <i>"usb:3.32.5"</i>. Where there is only one USB device attached, the shorthand
- *   <i>"usb:"</i> can be used.
+ *   <i>"usb:"</i> can be used. An optional number of pipes over which the
+ *   blocks of each RX buffer are spread can be appended after a comma, e.g.
+ *   <i>"usb:3.32.5,4"</i> or <i>"usb:,4"</i> (default <b>1</b>, max. 9).
  * - Serial backend, "serial:"\n Requires:
  *     - a port (/dev/ttyUSB0),
  *     - baud_rate (default <b>115200</b>)
@@ -1093,6 +1104,38 @@ __api void iio_buffer_destroy(struct iio_buffer *buf);
 __api void iio_buffer_cancel(struct iio_buffer *buf);
 
 
+/** @brief Flags for the memory of blocks allocated by Libiio
+ *
+ * These only apply to blocks whose memory is not provided by the backend or
+ * the kernel, for instance blocks of remote buffers, or local buffers which
+ * do not support DMABUF or MMAP. Such blocks are always aligned on 64 bytes,
+ * and their memory is recycled when they are destroyed. */
+enum iio_block_alloc_flags {
+	/** Use huge pages, or transparent huge pages as a fallback */
+	IIO_BLOCK_ALLOC_HUGEPAGES	= 1 << 0,
+
+	/** Lock the memory in RAM, so that it cannot be swapped out. If the
+	 * memory cannot be locked (e.g. because of RLIMIT_MEMLOCK), it is used
+	 * unlocked and a warning is logged. */
+	IIO_BLOCK_ALLOC_LOCKED		= 1 << 1,
+
+	/** Allocate from the NUMA node of the thread creating the block */
+	IIO_BLOCK_ALLOC_NUMA_LOCAL	= 1 << 2,
+};
+
+
+/** @brief Configure how the memory of the buffer's blocks is allocated
+ * @param buf A pointer to an iio_buffer structure
+ * @param flags A bitmask of enum iio_block_alloc_flags
+ * @return On success, 0 is returned
+ * @return On error, a negative error code is returned. -EBUSY means that
+ *   blocks of the buffer are still alive.
+ *
+ * <b>NOTE:</b> This must be called before any block is created. */
+__api int iio_buffer_set_block_alloc_flags(struct iio_buffer *buf,
+					   unsigned int flags);
+
+
 /** @brief Enable the buffer
  * @param buf A pointer to an iio_buffer structure
  * @return On success, 0
@@ -1134,6 +1177,48 @@ __api __check_ret struct iio_block *
 iio_buffer_create_block(struct iio_buffer *buffer, size_t size);
 
 
+/** @brief Create a data block for the given buffer, using memory provided
+ * by the application
+ * @param buffer A pointer to an iio_buffer structure
+ * @param ptr A pointer to the memory to use for the block
+ * @param size The size of the block to create, in bytes
+ * @return On success, a pointer to an iio_block structure
+ * @return On failure, a pointer-encoded error is returned
+ *
+ * <b>NOTE:</b> The memory must remain valid until the block is destroyed,
+ * and should be aligned at least on the buffer's sample size. Samples are
+ * read or written directly from/to that memory. The block cannot be backed
+ * by a DMABUF or a kernel mapping, so such blocks should not be mixed with
+ * blocks created with iio_buffer_create_block() on local buffers. */
+__api __check_ret struct iio_block *
+iio_buffer_create_block_from_memory(struct iio_buffer *buffer,
+				    void *ptr, size_t size);
+
+
+/** @brief Create a data block for the given buffer, backed by an existing
+ * DMABUF
+ * @param buffer A pointer to an iio_buffer structure
+ * @param fd The file descriptor of the DMABUF
+ * @param size The size of the block to create, in bytes
+ * @return On success, a pointer to an iio_block structure
+ * @return On failure, a pointer-encoded error is returned. -ENOSYS means
+ *   that the backend or the kernel cannot import DMABUFs.
+ *
+ * <b>NOTE:</b> The block holds its own reference to the DMABUF, so the
+ * caller may close the file descriptor once the block is created. The DMABUF
+ * can come from another IIO block (see iio_block_get_dmabuf_fd), or from any
+ * other exporter (e.g. udmabuf or DMA heaps); this allows moving samples
+ * between devices without any copy. CPU access is synchronized with
+ * DMA_BUF_IOCTL_SYNC when the block is enqueued and dequeued. If the DMABUF
+ * cannot be mapped, iio_block_start, iio_block_first and iio_block_end
+ * return NULL, iio_block_foreach_sample returns -ENOSYS, and the block can
+ * only be used to exchange data between devices. The same DMABUF must not be
+ * enqueued to two buffers at the same time. */
+__api __check_ret struct iio_block *
+iio_buffer_create_block_from_dmabuf(struct iio_buffer *buffer,
+				    int fd, size_t size);
+
+
 /** @brief Destroy the given block
  * @param block A pointer to an iio_block structure */
 __api void iio_block_destroy(struct iio_block *block);
@@ -1141,7 +1226,8 @@ __api void iio_block_destroy(struct iio_block *block);
 
 /** @brief Get the start address of the block
  * @param block A pointer to an iio_block structure
- * @return A pointer corresponding to the start address of the block */
+ * @return A pointer corresponding to the start address of the block, or NULL
+ * if the block has no CPU mapping */
 __api void *iio_block_start(const struct iio_block *block);
 
 
@@ -1149,7 +1235,8 @@ __api void *iio_block_start(const struct iio_block *block);
  * @param block A pointer to an iio_block structure
  * @param chn A pointer to an iio_channel structure
  * @return A pointer to the first sample found, or to the end of the block if
- * no sample for the given channel is present in the block
+ * no sample for the given channel is present in the block, or NULL if the
+ * block has no CPU mapping
  *
  * <b>NOTE:</b> This function, coupled with iio_block_end, can be used to
  * iterate on all the samples of a given channel present in the block, doing
@@ -1173,7 +1260,7 @@ __api void *iio_block_first(const struct iio_block *block,
 /** @brief Get the address after the last sample in a block
  * @param block A pointer to an iio_block structure
  * @return A pointer corresponding to the address that follows the last sample
- * present in the buffer */
+ * present in the buffer, or NULL if the block has no CPU mapping */
 __api void *iio_block_end(const struct iio_block *block);
 
 
@@ -1184,6 +1271,7 @@ __api void *iio_block_end(const struct iio_block *block);
  * @param callback A pointer to a function to call for each sample found
  * @param data A user-specified pointer that will be passed to the callback
  * @return number of bytes processed.
+ * @return -ENOSYS if the block has no CPU mapping.
  *
  * <b>NOTE:</b> The callback receives four arguments:
  * * A pointer to the iio_channel structure corresponding to the sample,
@@ -1227,6 +1315,15 @@ __api int iio_block_dequeue(struct iio_block *block, bool nonblock);
 __api struct iio_buffer * iio_block_get_buffer(const struct iio_block *block);
 
 
+/** @brief Retrieve the file descriptor of the DMABUF backing the block
+ * @param block A pointer to an iio_block structure
+ * @return On success, the DMABUF file descriptor, which remains owned by
+ *   the block
+ * @return On error, a negative error code is returned. -EINVAL means that
+ *   the block is not backed by a DMABUF. */
+__api int iio_block_get_dmabuf_fd(const struct iio_block *block);
+
+
 /** @} *//* ------------------------------------------------------------------*/
 /* ------------------------- Stream functions --------------------------------*/
 /** @defgroup Stream Stream
@@ -1247,6 +1344,51 @@ iio_buffer_create_stream(struct iio_buffer *buffer, size_t nb_blocks,
 			 size_t samples_count);
 
 
+/** @brief Parameters and latency statistics of a low-latency iio_stream */
+struct iio_stream_latency_stats {
+	/** @brief Number of blocks currently used */
+	size_t nb_blocks;
+
+	/** @brief Size of the blocks, in samples. It is also the watermark
+	 * of the kernel buffer, when the backend uses one. */
+	size_t samples_count;
+
+	/** @brief Time needed to fill one block, in microseconds */
+	uint64_t block_duration_us;
+
+	/** @brief Observed latencies, in microseconds: time elapsed between
+	 * the capture of the oldest sample of a block, and the moment the block
+	 * was handed to the application. Only the blocks dequeued since the
+	 * last retune are taken into account. */
+	uint64_t p50_us, p90_us, p99_us, max_us;
+
+	/** @brief Number of blocks handed to the application more than one
+	 * block duration after they were filled */
+	uint64_t late_blocks;
+
+	/** @brief Number of times the blocks were resized or added */
+	uint64_t retunes;
+};
+
+
+/** @brief Create a low-latency iio_stream object for the given iio_buffer
+ * @param buffer A pointer to an iio_buffer structure of a RX device
+ * @param latency_us The latency target, in microseconds
+ * @param sample_rate The sample rate of the device, in samples per second.
+ *   If zero, it is read from the device's "sampling_frequency" attribute.
+ * @return On success, a pointer to an iio_stream structure
+ * @return On failure, a pointer-encoded error is returned
+ *
+ * <b>NOTE:</b> The number and size of the blocks are picked from the latency
+ * target, then tuned while the stream runs: the blocks are made as small as
+ * possible, as long as the application dequeues them in time, and the queue
+ * grows when it falls behind, and shrinks back once it keeps up. Retuning recreates the blocks, so the samples
+ * captured during that time are lost. */
+__api __check_ret struct iio_stream *
+iio_buffer_create_low_latency_stream(struct iio_buffer *buffer,
+				     uint64_t latency_us, double sample_rate);
+
+
 /** @brief Destroy the given stream object
  * @param stream A pointer to an iio_stream structure */
 __api void
@@ -1261,6 +1403,196 @@ __api __check_ret const struct iio_block *
 iio_stream_get_next_block(struct iio_stream *stream);
 
 
+/** @brief Get the parameters and latency statistics of a low-latency stream
+ * @param stream A pointer to an iio_stream structure
+ * @param stats A pointer to an iio_stream_latency_stats structure to fill
+ * @return On success, 0 is returned
+ * @return On error, a negative error code is returned. -EINVAL means that
+ *   the stream was not created with iio_buffer_create_low_latency_stream. */
+__api int
+iio_stream_get_latency_stats(const struct iio_stream *stream,
+			     struct iio_stream_latency_stats *stats);
+
+
+/** @} *//* ------------------------------------------------------------------*/
+/* ------------------------- Relay functions ---------------------------------*/
+/** @defgroup Relay Relay
+ * @{
+ * @struct iio_relay
+ * @brief A helper object moving samples from a RX buffer to a TX buffer */
+
+
+/** @brief Statistics of a iio_relay object */
+struct iio_relay_stats {
+	/** @brief Number of blocks sent to the sink buffer */
+	uint64_t blocks;
+
+	/** @brief Number of bytes sent to the sink buffer */
+	uint64_t bytes;
+
+	/** @brief Number of source blocks dropped because the sink buffer
+	 * was not ready to accept them */
+	uint64_t drops;
+
+	/** @brief Time elapsed since the relay was started, in microseconds */
+	uint64_t elapsed_us;
+
+	/** @brief True if the blocks are shared between the two buffers */
+	bool zero_copy;
+};
+
+
+/** @brief Create a iio_relay object, and start relaying samples
+ * @param src A pointer to the iio_buffer structure of the RX device
+ * @param dst A pointer to the iio_buffer structure of the TX device
+ * @param nb_blocks The number of iio_block objects to create, internally.
+ *   In doubt, a good value is 4.
+ * @param samples_count The size of the iio_block objects, in samples
+ * @param transform An optional callback, called from the relay's thread
+ *   for each block received. It must fill the second block from the first
+ *   one, and return the number of bytes to send, 0 to skip the block, or a
+ *   negative error code to stop the relay.
+ * @param d Pointer passed as the last argument of the callback
+ * @return On success, a pointer to an iio_relay structure
+ * @return On failure, a pointer-encoded error is returned
+ *
+ * <b>NOTE:</b> Without a callback, both buffers must have the same sample
+ * size. The blocks are then shared between the two buffers when both sides
+ * support DMABUFs, so that the samples are never copied. Otherwise, the
+ * samples are copied on a dedicated thread. The source buffer is never
+ * stalled: if the sink buffer has no free block, the samples are dropped. */
+__api __check_ret struct iio_relay *
+iio_buffer_create_relay(struct iio_buffer *src, struct iio_buffer *dst,
+			size_t nb_blocks, size_t samples_count,
+			ssize_t (*transform)(const struct iio_block *src,
+					     struct iio_block *dst, void *d),
+			void *d);
+
+
+/** @brief Stop and destroy the given relay object
+ * @param relay A pointer to an iio_relay structure
+ *
+ * <b>NOTE:</b> Both buffers are cancelled (see iio_buffer_cancel), and must
+ * be destroyed afterwards. */
+__api void
+iio_relay_destroy(struct iio_relay *relay);
+
+
+/** @brief Get the statistics of the given relay object
+ * @param relay A pointer to an iio_relay structure
+ * @param stats A pointer to an iio_relay_stats structure to fill
+ * @return 0 if the relay is running, or the negative error code that
+ *   stopped it */
+__api int
+iio_relay_get_stats(const struct iio_relay *relay,
+		    struct iio_relay_stats *stats);
+
+
+/** @} *//* ------------------------------------------------------------------*/
+/* ------------------------- Recorder functions ------------------------------*/
+/** @defgroup Recorder Recorder
+ * @{
+ * @struct iio_recorder
+ * @brief A helper object writing the samples of a RX buffer to disk */
+
+
+/** @brief Write the files with O_DIRECT, bypassing the page cache */
+#define IIO_RECORDER_DIRECT_IO		(1 << 0)
+
+/** @brief Write a SigMF metadata file along with each data file, once the
+ * data file is complete. The samples following a dropped block start a new
+ * capture segment. */
+#define IIO_RECORDER_SIGMF		(1 << 1)
+
+
+/** @brief Parameters of a iio_recorder object */
+struct iio_recorder_params {
+	/** @brief Path of the data file. When the files are rotated, the
+	 * index of each file is inserted before the ".sigmf-data" extension,
+	 * or appended to the path. */
+	const char *path;
+
+	/** @brief Max. size of each file in bytes, or 0 to write a single
+	 * file. Rounded up to a multiple of the size of the writes. */
+	uint64_t file_size;
+
+	/** @brief Number of samples to record, or 0 to record until the
+	 * recorder is destroyed */
+	uint64_t samples;
+
+	/** @brief Sample rate written to the metadata, in Hz. If zero, it is
+	 * read from the "sampling_frequency" attribute of the device. */
+	double sample_rate;
+
+	/** @brief Bitmask of IIO_RECORDER_* flags */
+	unsigned int flags;
+};
+
+
+/** @brief Statistics of a iio_recorder object */
+struct iio_recorder_stats {
+	/** @brief Number of blocks recorded */
+	uint64_t blocks;
+
+	/** @brief Number of bytes written */
+	uint64_t bytes;
+
+	/** @brief Number of blocks dropped because the disk could not keep
+	 * up with the buffer */
+	uint64_t drops;
+
+	/** @brief Time elapsed since the recorder was started, in
+	 * microseconds */
+	uint64_t elapsed_us;
+
+	/** @brief Number of data files created */
+	unsigned int files;
+
+	/** @brief True once the requested number of samples were written */
+	bool done;
+};
+
+
+/** @brief Create a iio_recorder object, and start recording samples
+ * @param buf A pointer to the iio_buffer structure of a RX device
+ * @param nb_blocks The number of iio_block objects to create, internally.
+ *   In doubt, a good value is 4.
+ * @param samples_count The size of the iio_block objects, in samples
+ * @param params A pointer to the iio_recorder_params structure to use
+ * @return On success, a pointer to an iio_recorder structure
+ * @return On failure, a pointer-encoded error is returned
+ *
+ * <b>NOTE:</b> The samples are copied into two aligned buffers, written to
+ * disk by a dedicated thread. The buffer is never stalled: if both are still
+ * being written when a block arrives, the block is dropped. With
+ * IIO_RECORDER_DIRECT_IO, the files are written with regular I/O on the
+ * filesystems that do not support O_DIRECT. */
+__api __check_ret struct iio_recorder *
+iio_buffer_create_recorder(struct iio_buffer *buf, size_t nb_blocks,
+			   size_t samples_count,
+			   const struct iio_recorder_params *params);
+
+
+/** @brief Stop and destroy the given recorder object
+ * @param rec A pointer to an iio_recorder structure
+ *
+ * <b>NOTE:</b> The buffer is cancelled (see iio_buffer_cancel), and must be
+ * destroyed afterwards. The samples received until then are written to the
+ * disk before this function returns. */
+__api void
+iio_recorder_destroy(struct iio_recorder *rec);
+
+
+/** @brief Get the statistics of the given recorder object
+ * @param rec A pointer to an iio_recorder structure
+ * @param stats A pointer to an iio_recorder_stats structure to fill
+ * @return 0 if the recorder is running or done, or the negative error code
+ *   that stopped it */
+__api int
+iio_recorder_get_stats(const struct iio_recorder *rec,
+		       struct iio_recorder_stats *stats);
+
+
 /** @} *//* ------------------------------------------------------------------*/
 /* ---------------------------- HWMON support --------------------------------*/
 /** @defgroup Hwmon Compatibility with hardware monitoring (hwmon) devices
@@ -1392,6 +1724,34 @@ __api int iio_event_stream_read(struct iio_event_stream *stream,
 				struct iio_event *out_event,
 				bool nonblock);
 
+/**
+ * @brief Read all the available events from the event stream, up to a limit.
+ * @param stream A pointer to an iio_event_stream structure
+ * @param events A pointer to an array of iio_event structures, that will be
+ *   filled by this function.
+ * @param nb The number of entries of the array
+ * @param nonblock if True, the operation won't block and return an error if
+ *   there is currently no event in the queue.
+ * @return On success, the number of events read is returned
+ * @return On error, a negative errno code is returned.
+ *
+ * <b>NOTE</b>: Only waits for the first event; the ones already queued are
+ * then returned in the same call. Cancellation works just like with
+ * iio_event_stream_read. */
+__api ssize_t iio_event_stream_read_many(struct iio_event_stream *stream,
+					 struct iio_event *events, size_t nb,
+					 bool nonblock);
+
+/** @brief Get the number of events lost by the event stream
+ * @param stream A pointer to an iio_event_stream structure
+ * @return The number of events dropped because the application did not read
+ *   them fast enough
+ *
+ * <b>NOTE</b>: Only remote contexts whose server pushes the events keep such
+ * a count; with other backends, zero is always returned. */
+__api uint64_t
+iio_event_stream_get_overflows(const struct iio_event_stream *stream);
+
 /** @} *//* ------------------------------------------------------------------*/
 /* ------------------------- Low-level functions -----------------------------*/
 /** @defgroup Debug Debug and low-level functions
@@ -16,6 +16,7 @@
 struct iiod_client;
 struct iiod_client_io;
 struct iiod_client_pdata;
+struct iio_block_allocator;
 struct iio_event_stream_pdata;
 
 struct iiod_client_ops {
@@ -28,6 +29,15 @@ struct iiod_client_ops {
 	void (*cancel)(struct iiod_client_pdata *desc);
 };
 
+/* Flags of iiod_client_new_flags() */
+enum iiod_client_flags {
+	/* The read op returns as soon as some data is available, so it is
+	 * safe to request more data than the remote sent. Allows the client
+	 * to read ahead of the incoming messages, and to merge consecutive
+	 * writes. */
+	IIOD_CLIENT_READ_PARTIAL = 1 << 0,
+};
+
 __api void iiod_client_mutex_lock(struct iiod_client *client);
 __api void iiod_client_mutex_unlock(struct iiod_client *client);
 
@@ -36,6 +46,11 @@ iiod_client_new(const struct iio_context_params *params,
 		struct iiod_client_pdata *desc,
 		const struct iiod_client_ops *ops);
 
+__api struct iiod_client *
+iiod_client_new_flags(const struct iio_context_params *params,
+		      struct iiod_client_pdata *desc,
+		      const struct iiod_client_ops *ops, unsigned int flags);
+
 __api void iiod_client_destroy(struct iiod_client *client);
 
 __api bool iiod_client_uses_binary_interface(const struct iiod_client *client);
@@ -76,9 +91,30 @@ __api void iiod_client_free_buffer(struct iiod_client_buffer_pdata *pdata);
 __api int iiod_client_enable_buffer(struct iiod_client_buffer_pdata *pdata,
 				    size_t nb_samples, bool enable, bool cyclic);
 
+/* Max. number of additional connections a buffer can be spread over */
+#define IIOD_CLIENT_MAX_STRIPES 8
+
+/* Spread the blocks of a RX buffer over the connection of another client.
+ * The blocks' data then flows through the connection they were created on,
+ * while the commands keep going through the buffer's client, so that the
+ * blocks are enqueued in order. */
+__api int
+iiod_client_buffer_add_stripe(struct iiod_client_buffer_pdata *pdata,
+			      struct iiod_client *client);
+
+/* Set the allocator used for the memory of the buffer's blocks */
+__api void
+iiod_client_set_block_allocator(struct iiod_client_buffer_pdata *pdata,
+				struct iio_block_allocator *alloc);
+
 __api struct iio_block_pdata *
 iiod_client_create_block(struct iiod_client_buffer_pdata *pdata,
 			 size_t size, void **data);
+/* Variant of iiod_client_create_block() where the data is received into,
+ * or sent from, memory owned by the application */
+__api struct iio_block_pdata *
+iiod_client_create_block_from_memory(struct iiod_client_buffer_pdata *pdata,
+				     void *ptr, size_t size);
 __api void iiod_client_free_block(struct iio_block_pdata *block);
 
 __api int iiod_client_enqueue_block(struct iio_block_pdata *block,
@@ -99,6 +135,10 @@ void iiod_client_close_event_stream(struct iio_event_stream_pdata *pdata);
 int iiod_client_read_event(struct iio_event_stream_pdata *pdata,
 			   struct iio_event *out_event,
 			   bool nonblock);
+ssize_t iiod_client_read_events(struct iio_event_stream_pdata *pdata,
+				struct iio_event *events, size_t nb,
+				bool nonblock);
+uint64_t iiod_client_get_event_overflows(struct iio_event_stream_pdata *pdata);
 
 #undef __api
 
@@ -0,0 +1,289 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2024 Analog Devices, Inc.
+ */
+
+#include "local.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <iio/iio.h>
+#include <iio/iio-backend.h>
+#include <iio/iio-lock.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Max. number of attribute files kept open */
+#define LOCAL_ATTR_CACHE_SIZE		256
+#define LOCAL_ATTR_CACHE_BUCKETS	64
+
+struct local_attr_fd {
+	/* Next entry in the same hash bucket */
+	struct local_attr_fd *hnext;
+
+	/* Neighbours in the LRU list */
+	struct local_attr_fd *prev, *next;
+
+	char *path;
+	uint32_t hash;
+	int fd, flags;
+
+	unsigned int users;
+	bool cached;
+};
+
+struct local_attr_cache {
+	struct iio_mutex *lock;
+	struct local_attr_fd *buckets[LOCAL_ATTR_CACHE_BUCKETS];
+
+	/* Most and least recently used entries */
+	struct local_attr_fd *head, *tail;
+	unsigned int nb_entries;
+};
+
+static uint32_t local_attr_hash(const char *path, int flags)
+{
+	uint32_t hash = 2166136261u ^ (uint32_t) flags;
+
+	for (; *path; path++)
+		hash = (hash ^ (unsigned char) *path) * 16777619u;
+
+	return hash;
+}
+
+static void local_attr_lru_unlink(struct local_attr_cache *cache,
+				  struct local_attr_fd *entry)
+{
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		cache->head = entry->next;
+
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		cache->tail = entry->prev;
+
+	entry->prev = NULL;
+	entry->next = NULL;
+}
+
+static void local_attr_lru_push(struct local_attr_cache *cache,
+				struct local_attr_fd *entry)
+{
+	entry->prev = NULL;
+	entry->next = cache->head;
+
+	if (cache->head)
+		cache->head->prev = entry;
+	else
+		cache->tail = entry;
+
+	cache->head = entry;
+}
+
+static void local_attr_fd_free(struct local_attr_fd *entry)
+{
+	close(entry->fd);
+	free(entry->path);
+	free(entry);
+}
+
+/* Remove the entry from the cache. It is freed once its last user is done
+ * with it. */
+static void local_attr_uncache(struct local_attr_cache *cache,
+			       struct local_attr_fd *entry)
+{
+	struct local_attr_fd **ptr;
+
+	ptr = &cache->buckets[entry->hash % LOCAL_ATTR_CACHE_BUCKETS];
+	while (*ptr != entry)
+		ptr = &(*ptr)->hnext;
+	*ptr = entry->hnext;
+
+	local_attr_lru_unlink(cache, entry);
+	cache->nb_entries--;
+	entry->cached = false;
+}
+
+static void local_attr_evict(struct local_attr_cache *cache)
+{
+	struct local_attr_fd *entry;
+
+	for (entry = cache->tail; entry; entry = entry->prev) {
+		if (!entry->users) {
+			local_attr_uncache(cache, entry);
+			local_attr_fd_free(entry);
+			return;
+		}
+	}
+}
+
+static struct local_attr_fd *
+local_attr_get(struct local_attr_cache *cache, const char *path, int flags)
+{
+	uint32_t hash = local_attr_hash(path, flags);
+	struct local_attr_fd *entry, **bucket;
+	int fd;
+
+	bucket = &cache->buckets[hash % LOCAL_ATTR_CACHE_BUCKETS];
+
+	iio_mutex_lock(cache->lock);
+
+	for (entry = *bucket; entry; entry = entry->hnext) {
+		if (entry->hash == hash && entry->flags == flags
+		    && !strcmp(entry->path, path)) {
+			entry->users++;
+			local_attr_lru_unlink(cache, entry);
+			local_attr_lru_push(cache, entry);
+			iio_mutex_unlock(cache->lock);
+			return entry;
+		}
+	}
+
+	iio_mutex_unlock(cache->lock);
+
+	fd = open(path, flags | O_CLOEXEC);
+	if (fd == -1)
+		return iio_ptr(-errno);
+
+	entry = zalloc(sizeof(*entry));
+	if (!entry)
+		goto err_close_fd;
+
+	entry->path = strdup(path);
+	if (!entry->path)
+		goto err_free_entry;
+
+	entry->hash = hash;
+	entry->fd = fd;
+	entry->flags = flags;
+	entry->users = 1;
+
+	iio_mutex_lock(cache->lock);
+
+	if (cache->nb_entries >= LOCAL_ATTR_CACHE_SIZE)
+		local_attr_evict(cache);
+
+	/* If every entry is in use, the file is simply closed after use */
+	if (cache->nb_entries < LOCAL_ATTR_CACHE_SIZE) {
+		entry->hnext = *bucket;
+		*bucket = entry;
+		local_attr_lru_push(cache, entry);
+		cache->nb_entries++;
+		entry->cached = true;
+	}
+
+	iio_mutex_unlock(cache->lock);
+
+	return entry;
+
+err_free_entry:
+	free(entry);
+err_close_fd:
+	close(fd);
+	return iio_ptr(-ENOMEM);
+}
+
+static void local_attr_put(struct local_attr_cache *cache,
+			   struct local_attr_fd *entry, bool drop)
+{
+	bool free_entry;
+
+	iio_mutex_lock(cache->lock);
+
+	if (drop && entry->cached)
+		local_attr_uncache(cache, entry);
+
+	free_entry = !--entry->users && !entry->cached;
+
+	iio_mutex_unlock(cache->lock);
+
+	if (free_entry)
+		local_attr_fd_free(entry);
+}
+
+static ssize_t local_attr_rw(struct local_attr_cache *cache, const char *path,
+			     void *buf, size_t len, bool is_write)
+{
+	struct local_attr_fd *entry;
+	unsigned int retry;
+	ssize_t ret;
+
+	for (retry = 0; retry < 2; retry++) {
+		entry = local_attr_get(cache, path,
+				       is_write ? O_WRONLY : O_RDONLY);
+		ret = iio_err(entry);
+		if (ret)
+			return ret;
+
+		/* Sysfs files are regenerated when read from offset 0, and
+		 * each write is handled as a whole by the driver. */
+		do {
+			if (is_write)
+				ret = pwrite(entry->fd, buf, len, 0);
+			else
+				ret = pread(entry->fd, buf, len, 0);
+		} while (ret == -1 && errno == EINTR);
+
+		if (ret == -1)
+			ret = -errno;
+
+		/* A failed file may belong to a device that is gone; drop it
+		 * from the cache. If the device was re-created, reopening
+		 * the file gets us the new one. */
+		local_attr_put(cache, entry, ret < 0);
+
+		if (ret != -ENODEV)
+			break;
+	}
+
+	return ret;
+}
+
+ssize_t local_attr_read(struct local_attr_cache *cache, const char *path,
+			char *dst, size_t len)
+{
+	return local_attr_rw(cache, path, dst, len, false);
+}
+
+ssize_t local_attr_write(struct local_attr_cache *cache, const char *path,
+			 const char *src, size_t len)
+{
+	return local_attr_rw(cache, path, (void *) src, len, true);
+}
+
+struct local_attr_cache * local_attr_cache_new(void)
+{
+	struct local_attr_cache *cache;
+	int err;
+
+	cache = zalloc(sizeof(*cache));
+	if (!cache)
+		return iio_ptr(-ENOMEM);
+
+	cache->lock = iio_mutex_create();
+	err = iio_err(cache->lock);
+	if (err) {
+		free(cache);
+		return iio_ptr(err);
+	}
+
+	return cache;
+}
+
+void local_attr_cache_free(struct local_attr_cache *cache)
+{
+	struct local_attr_fd *entry, *next;
+
+	for (entry = cache->head; entry; entry = next) {
+		next = entry->next;
+		local_attr_fd_free(entry);
+	}
+
+	iio_mutex_destroy(cache->lock);
+	free(cache);
+}
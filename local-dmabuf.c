@@ -9,6 +9,7 @@
 #include "local.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <iio/iio.h>
 #include <iio/iio-backend.h>
 #include <poll.h>
@@ -22,6 +23,13 @@
 #define IIO_DMABUF_ENQUEUE_IOCTL	_IOW('i', 0x93, struct iio_dmabuf)
 #define IIO_DMABUF_SYNC_IOCTL		_IOW('b', 0, struct dma_buf_sync)
 
+/* Interface used to attach DMABUFs created outside of IIO. Attached DMABUFs
+ * are enqueued with their own ioctl, which the kernel headers name
+ * IIO_BUFFER_DMABUF_ENQUEUE_IOCTL. */
+#define IIO_DMABUF_ATTACH_IOCTL		_IOW('i', 0x92, int)
+#define IIO_DMABUF_DETACH_IOCTL		_IOW('i', 0x93, int)
+#define IIO_DMABUF_ENQUEUE_ATTACHED_IOCTL _IOW('i', 0x94, struct iio_dmabuf)
+
 #define IIO_DMABUF_FLAG_CYCLIC		(1 << 0)
 
 #define DMA_BUF_SYNC_READ      (1 << 0)
@@ -81,6 +89,7 @@ local_create_dmabuf(struct iio_buffer_pdata *pdata, size_t size, void **data)
 	priv->size = size;
 	priv->buf = pdata;
 	priv->dequeued = true;
+	priv->dmabuf = true;
 	pdata->dmabuf_supported = true;
 
 	return priv;
@@ -92,11 +101,67 @@ err_free_priv:
 	return iio_ptr(ret);
 }
 
+struct iio_block_pdata *
+local_import_dmabuf(struct iio_buffer_pdata *pdata, int fd,
+		    size_t size, void **data)
+{
+	struct iio_block_pdata *priv;
+	int ret;
+
+	/* The buffer cannot be set up for both imported DMABUFs and
+	 * MMAP or io_uring blocks. */
+	if (pdata->mmap_supported || pdata->uring)
+		return iio_ptr(-EINVAL);
+
+	priv = zalloc(sizeof(*priv));
+	if (!priv)
+		return iio_ptr(-ENOMEM);
+
+	/* Keep our own reference, so that the caller can close its fd */
+	fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	if (fd == -1) {
+		ret = -errno;
+		goto err_free_priv;
+	}
+
+	ret = ioctl_nointr(pdata->fd, IIO_DMABUF_ATTACH_IOCTL, &fd);
+	if (ret == -ENODEV || ret == -EINVAL || ret == -ENOTTY)
+		ret = -ENOSYS;
+	if (ret < 0)
+		goto err_close_fd;
+
+	/* Not every exporter supports CPU access; such blocks can only be
+	 * used to move data between devices. */
+	*data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (*data == MAP_FAILED)
+		*data = NULL;
+
+	priv->pdata = (void *)(intptr_t) fd;
+	priv->data = *data;
+	priv->size = size;
+	priv->buf = pdata;
+	priv->dequeued = true;
+	priv->dmabuf = true;
+	priv->imported = true;
+	pdata->dmabuf_imported = true;
+
+	return priv;
+
+err_close_fd:
+	close(fd);
+err_free_priv:
+	free(priv);
+	return iio_ptr(ret);
+}
+
 void local_free_dmabuf(struct iio_block_pdata *pdata)
 {
 	int fd = (int)(intptr_t) pdata->pdata;
 
-	munmap(pdata->data, pdata->size);
+	if (pdata->imported)
+		ioctl_nointr(pdata->buf->fd, IIO_DMABUF_DETACH_IOCTL, &fd);
+	if (pdata->data)
+		munmap(pdata->data, pdata->size);
 	close(fd);
 	free(pdata);
 }
@@ -125,7 +190,13 @@ int local_enqueue_dmabuf(struct iio_block_pdata *pdata,
 	if (ret)
 		return ret;
 
-	ret = ioctl_nointr(pdata->buf->fd, IIO_DMABUF_ENQUEUE_IOCTL, &dmabuf);
+	if (pdata->imported) {
+		ret = ioctl_nointr(pdata->buf->fd,
+				   IIO_DMABUF_ENQUEUE_ATTACHED_IOCTL, &dmabuf);
+	} else {
+		ret = ioctl_nointr(pdata->buf->fd,
+				   IIO_DMABUF_ENQUEUE_IOCTL, &dmabuf);
+	}
 	if (ret)
 		return ret;
 
@@ -134,6 +205,11 @@ int local_enqueue_dmabuf(struct iio_block_pdata *pdata,
 	return 0;
 }
 
+int local_dmabuf_get_fd(struct iio_block_pdata *pdata)
+{
+	return (int)(intptr_t) pdata->pdata;
+}
+
 int local_dequeue_dmabuf(struct iio_block_pdata *pdata, bool nonblock)
 {
 	struct iio_buffer_pdata *buf_pdata = pdata->buf;
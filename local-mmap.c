@@ -102,6 +102,10 @@ local_create_mmap_block(struct iio_buffer_pdata *pdata,
 	if (!pdata->mmap_supported)
 		return iio_ptr(-ENOSYS);
 
+	/* Imported DMABUFs cannot be mixed with MMAP blocks */
+	if (pdata->dmabuf_imported)
+		return iio_ptr(-EINVAL);
+
 	priv = zalloc(sizeof(*priv));
 	if (!priv)
 		return iio_ptr(-ENOMEM);
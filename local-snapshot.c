@@ -0,0 +1,236 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2024 Analog Devices, Inc.
+ */
+
+#include "iio-config.h"
+#include "local.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <iio/iio.h>
+#include <iio/iio-backend.h>
+#include <iio/iio-debug.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+
+#define SNAPSHOT_HASH_INIT	0xcbf29ce484222325ull
+#define SNAPSHOT_FILE		"local.snap"
+
+/* 64-bit FNV-1a */
+static uint64_t snapshot_hash(uint64_t hash, const void *data, size_t len)
+{
+	const unsigned char *ptr = data;
+
+	for (; len; len--, ptr++)
+		hash = (hash ^ *ptr) * 0x100000001b3ull;
+
+	return hash;
+}
+
+static uint64_t snapshot_hash_str(uint64_t hash, const char *str)
+{
+	return snapshot_hash(hash, str, strlen(str) + 1);
+}
+
+static uint64_t snapshot_hash_mtime(uint64_t hash, const char *path)
+{
+	struct stat st;
+	uint64_t mtime[2] = { 0 };
+
+	if (!stat(path, &st)) {
+		mtime[0] = (uint64_t) st.st_mtim.tv_sec;
+		mtime[1] = (uint64_t) st.st_mtim.tv_nsec;
+	}
+
+	return snapshot_hash(hash, mtime, sizeof(mtime));
+}
+
+/* Hash the name of every device in the directory, along with the content of
+ * its "name" file and the modification time of its "scan_elements" folder.
+ * The per-device hashes are summed, so that the result does not depend on
+ * the order in which the entries are listed. */
+static uint64_t snapshot_hash_devices(uint64_t hash, const char *path)
+{
+	char buf[PATH_MAX], name[256];
+	struct dirent *entry;
+	uint64_t sum = 0, dev_hash;
+	size_t len;
+	FILE *f;
+	DIR *dir;
+
+	dir = opendir(path);
+	if (!dir)
+		return snapshot_hash(hash, &sum, sizeof(sum));
+
+	while ((entry = readdir(dir))) {
+		if (entry->d_name[0] == '.')
+			continue;
+
+		dev_hash = snapshot_hash_str(SNAPSHOT_HASH_INIT, entry->d_name);
+
+		iio_snprintf(buf, sizeof(buf), "%s/%s/name", path, entry->d_name);
+		f = fopen(buf, "r");
+		if (f) {
+			len = fread(name, 1, sizeof(name), f);
+			dev_hash = snapshot_hash(dev_hash, name, len);
+			fclose(f);
+		}
+
+		iio_snprintf(buf, sizeof(buf), "%s/%s/scan_elements",
+			     path, entry->d_name);
+		dev_hash = snapshot_hash_mtime(dev_hash, buf);
+
+		sum += dev_hash;
+	}
+
+	closedir(dir);
+
+	return snapshot_hash(hash, &sum, sizeof(sum));
+}
+
+uint64_t local_snapshot_fingerprint(void)
+{
+	uint64_t hash = SNAPSHOT_HASH_INIT;
+	struct utsname uts;
+
+	hash = snapshot_hash_str(hash, SNAPSHOT_FILE " " LIBIIO_VERSION_GIT);
+
+	if (!uname(&uts)) {
+		hash = snapshot_hash_str(hash, uts.release);
+		hash = snapshot_hash_str(hash, uts.version);
+	}
+
+	hash = snapshot_hash_devices(hash, "/sys/bus/iio/devices");
+	if (WITH_HWMON)
+		hash = snapshot_hash_devices(hash, "/sys/class/hwmon");
+
+	hash = snapshot_hash_mtime(hash, "/sys/kernel/debug/iio");
+	if (WITH_LOCAL_CONFIG)
+		hash = snapshot_hash_mtime(hash, "/etc/libiio.ini");
+
+	return hash;
+}
+
+static char * snapshot_get_path(const struct iio_context_params *params)
+{
+	size_t len = strlen(params->cache_dir) + sizeof("/" SNAPSHOT_FILE);
+	char *path;
+
+	path = malloc(len);
+	if (path)
+		iio_snprintf(path, len, "%s/" SNAPSHOT_FILE, params->cache_dir);
+
+	return path;
+}
+
+/* Snapshot files start with a header line containing the fingerprint of the
+ * system they describe, then the length and hash of the payload. The payload
+ * is the XML description of the context, a NUL character, then the backend
+ * data as text. */
+char * local_snapshot_load(const struct iio_context_params *params,
+			   uint64_t fingerprint, const char **data)
+{
+	size_t uri_len = sizeof("xml:") - 1;
+	unsigned long long fp, len, hash;
+	char *path, *xml = NULL, *end;
+	FILE *f;
+
+	path = snapshot_get_path(params);
+	if (!path)
+		return NULL;
+
+	f = fopen(path, "rb");
+	if (!f)
+		goto out_free_path;
+
+	if (fscanf(f, "IIOSNAP1 %llx %llu %llx\n", &fp, &len, &hash) != 3
+	    || fp != fingerprint || !len || len > SIZE_MAX - uri_len - 1) {
+		prm_dbg(params, "Snapshot %s is outdated\n", path);
+		goto out_fclose;
+	}
+
+	xml = malloc(uri_len + len + 1);
+	if (!xml)
+		goto out_fclose;
+
+	memcpy(xml, "xml:", uri_len);
+
+	if (fread(&xml[uri_len], 1, len, f) != len
+	    || snapshot_hash(SNAPSHOT_HASH_INIT, &xml[uri_len], len) != hash
+	    || !(end = memchr(&xml[uri_len], '\0', len))) {
+		prm_warn(params, "Ignoring invalid snapshot %s\n", path);
+		free(xml);
+		xml = NULL;
+		goto out_fclose;
+	}
+
+	xml[uri_len + len] = '\0';
+	*data = end + 1;
+
+	prm_dbg(params, "Loaded local context from snapshot %s\n", path);
+
+out_fclose:
+	fclose(f);
+out_free_path:
+	free(path);
+	return xml;
+}
+
+void local_snapshot_store(const struct iio_context_params *params,
+			  uint64_t fingerprint, const char *xml,
+			  const char *data)
+{
+	size_t xml_len = strlen(xml) + 1, data_len = strlen(data);
+	char *path, *tmp;
+	uint64_t hash;
+	size_t len;
+	FILE *f;
+	bool ok;
+
+	path = snapshot_get_path(params);
+	if (!path)
+		return;
+
+	len = strlen(path) + sizeof(".tmp");
+	tmp = malloc(len);
+	if (!tmp)
+		goto out_free_path;
+
+	/* Write to a temporary file then rename it, so that concurrent
+	 * readers never see a partially written file. */
+	iio_snprintf(tmp, len, "%s.tmp", path);
+
+	f = fopen(tmp, "wb");
+	if (!f) {
+		prm_dbg(params, "Unable to create snapshot %s\n", tmp);
+		goto out_free_tmp;
+	}
+
+	hash = snapshot_hash(SNAPSHOT_HASH_INIT, xml, xml_len);
+	hash = snapshot_hash(hash, data, data_len);
+
+	ok = fprintf(f, "IIOSNAP1 %016llx %llu %016llx\n",
+		     (unsigned long long) fingerprint,
+		     (unsigned long long) (xml_len + data_len),
+		     (unsigned long long) hash) > 0
+		&& fwrite(xml, 1, xml_len, f) == xml_len
+		&& fwrite(data, 1, data_len, f) == data_len;
+	ok = !fclose(f) && ok;
+
+	if (!ok || rename(tmp, path)) {
+		prm_dbg(params, "Unable to write snapshot %s\n", path);
+		remove(tmp);
+	}
+
+out_free_tmp:
+	free(tmp);
+out_free_path:
+	free(path);
+}
@@ -0,0 +1,722 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2024 Analog Devices, Inc.
+ */
+
+/* For syscall() */
+#define _DEFAULT_SOURCE
+
+#include "iio-private.h"
+#include "local.h"
+
+#include <errno.h>
+#include <iio/iio.h>
+#include <iio/iio-backend.h>
+#include <iio/iio-debug.h>
+#include <iio/iio-lock.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOCAL_URING_ENTRIES	64
+
+/* Completions may be reaped by another thread while a block is being freed;
+ * the freeing thread checks again after this delay. */
+#define LOCAL_URING_FREE_POLL_MS	10
+
+#define container_of(ptr, type, member)	\
+	((type *)(void *)((uintptr_t)(ptr) - offsetof(type, member)))
+
+/* Set in the user data of the poll requests that precede the transfers */
+#define LOCAL_URING_POLL_TAG	1
+
+struct local_uring_block {
+	struct iio_block_pdata pdata;
+
+	/* Next block in the pending list, and in the submitted chain */
+	struct local_uring_block *next, *chain_next;
+
+	size_t bytes_used, done;
+	int err;
+
+	bool enqueued, submitted, completed;
+	bool user_memory, freeing;
+};
+
+struct local_uring {
+	struct iio_mutex *lock;
+	int fd;
+
+	void *ring;
+	size_t ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array, sq_entries;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	/* Transfers waiting to be submitted, in order */
+	struct local_uring_block *pending, *pending_tail;
+
+	/* Transfers submitted to the kernel as one chain of linked requests */
+	struct local_uring_block *chain;
+	unsigned int nb_inflight;
+
+	unsigned int nb_blocks;
+	bool cancelled;
+};
+
+static struct local_uring_block *
+local_uring_get_block(struct iio_block_pdata *pdata)
+{
+	return container_of(pdata, struct local_uring_block, pdata);
+}
+
+static int local_uring_enter(int fd, unsigned int to_submit,
+			     unsigned int min_complete, unsigned int flags)
+{
+	long ret;
+
+	do {
+		ret = syscall(SYS_io_uring_enter, fd, to_submit,
+			      min_complete, flags, NULL, 0);
+	} while (ret == -1 && errno == EINTR);
+
+	if (ret == -1)
+		return -errno;
+
+	return (int) ret;
+}
+
+static bool local_uring_probe(int fd)
+{
+	static const unsigned char opcodes[] = {
+		IORING_OP_READ, IORING_OP_WRITE, IORING_OP_ASYNC_CANCEL,
+		IORING_OP_POLL_ADD,
+	};
+	struct io_uring_probe *probe;
+	size_t len = sizeof(*probe) + 256 * sizeof(probe->ops[0]);
+	bool supported;
+	unsigned int i;
+
+	probe = zalloc(len);
+	if (!probe)
+		return false;
+
+	supported = !syscall(SYS_io_uring_register, fd,
+			     IORING_REGISTER_PROBE, probe, 256);
+
+	for (i = 0; supported && i < sizeof(opcodes); i++) {
+		supported = opcodes[i] < probe->ops_len
+			&& (probe->ops[opcodes[i]].flags & IO_URING_OP_SUPPORTED);
+	}
+
+	free(probe);
+
+	return supported;
+}
+
+static int local_uring_map(struct local_uring *uring,
+			   const struct io_uring_params *p)
+{
+	size_t sq_size, cq_size;
+	char *ring;
+
+	sq_size = p->sq_off.array + p->sq_entries * sizeof(unsigned int);
+	cq_size = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+
+	/* With IORING_FEAT_SINGLE_MMAP, both rings share one mapping */
+	uring->ring_size = sq_size > cq_size ? sq_size : cq_size;
+	uring->ring = mmap(NULL, uring->ring_size, PROT_READ | PROT_WRITE,
+			   MAP_SHARED, uring->fd, IORING_OFF_SQ_RING);
+	if (uring->ring == MAP_FAILED)
+		return -errno;
+
+	uring->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+	uring->sqes = mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE,
+			   MAP_SHARED, uring->fd, IORING_OFF_SQES);
+	if (uring->sqes == MAP_FAILED) {
+		munmap(uring->ring, uring->ring_size);
+		return -errno;
+	}
+
+	ring = uring->ring;
+	uring->sq_head = (unsigned int *) (ring + p->sq_off.head);
+	uring->sq_tail = (unsigned int *) (ring + p->sq_off.tail);
+	uring->sq_mask = (unsigned int *) (ring + p->sq_off.ring_mask);
+	uring->sq_array = (unsigned int *) (ring + p->sq_off.array);
+	uring->sq_entries = p->sq_entries;
+
+	uring->cq_head = (unsigned int *) (ring + p->cq_off.head);
+	uring->cq_tail = (unsigned int *) (ring + p->cq_off.tail);
+	uring->cq_mask = (unsigned int *) (ring + p->cq_off.ring_mask);
+	uring->cqes = (struct io_uring_cqe *) (ring + p->cq_off.cqes);
+
+	return 0;
+}
+
+static struct local_uring * local_uring_create(void)
+{
+	struct io_uring_params p = { 0 };
+	struct local_uring *uring;
+	int err;
+
+	uring = zalloc(sizeof(*uring));
+	if (!uring)
+		return iio_ptr(-ENOMEM);
+
+	uring->lock = iio_mutex_create();
+	err = iio_err(uring->lock);
+	if (err)
+		goto err_free_uring;
+
+	uring->fd = (int) syscall(SYS_io_uring_setup, LOCAL_URING_ENTRIES, &p);
+	if (uring->fd == -1) {
+		/* Old kernel, or io_uring disabled by the system policy */
+		err = -ENOSYS;
+		goto err_destroy_mutex;
+	}
+
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP)
+	    || !(p.features & IORING_FEAT_NODROP)
+	    || !local_uring_probe(uring->fd)) {
+		err = -ENOSYS;
+		goto err_close_fd;
+	}
+
+	err = local_uring_map(uring, &p);
+	if (err)
+		goto err_close_fd;
+
+	return uring;
+
+err_close_fd:
+	close(uring->fd);
+err_destroy_mutex:
+	iio_mutex_destroy(uring->lock);
+err_free_uring:
+	free(uring);
+	return iio_ptr(err);
+}
+
+void local_uring_destroy(struct local_uring *uring)
+{
+	munmap(uring->sqes, uring->sqes_size);
+	munmap(uring->ring, uring->ring_size);
+	close(uring->fd);
+	iio_mutex_destroy(uring->lock);
+	free(uring);
+}
+
+/* The ring is not polled by the kernel, which only reads the new entries on
+ * io_uring_enter(); they can therefore be filled after being queued. */
+static struct io_uring_sqe * local_uring_get_sqe(struct local_uring *uring)
+{
+	unsigned int head, tail = *uring->sq_tail;
+	struct io_uring_sqe *sqe;
+
+	head = __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+	if (tail - head >= uring->sq_entries)
+		return NULL;
+
+	sqe = &uring->sqes[tail & *uring->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+
+	uring->sq_array[tail & *uring->sq_mask] = tail & *uring->sq_mask;
+	__atomic_store_n(uring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	return sqe;
+}
+
+static unsigned int local_uring_get_sq_space(struct local_uring *uring)
+{
+	unsigned int head = __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+
+	return uring->sq_entries - (*uring->sq_tail - head);
+}
+
+/* Submit the requests queued in the SQ ring that the kernel did not consume
+ * yet. The lock must be held. */
+static int local_uring_flush(struct local_uring *uring)
+{
+	unsigned int head, tail = *uring->sq_tail;
+	int ret;
+
+	head = __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+	if (head == tail)
+		return 0;
+
+	ret = local_uring_enter(uring->fd, tail - head, 0, 0);
+
+	/* The CQ ring is full; the requests are submitted on the next call,
+	 * once completions have been reaped. */
+	if (ret == -EAGAIN || ret == -EBUSY)
+		return 0;
+
+	return ret < 0 ? ret : 0;
+}
+
+/* The IIO character device is a stream: concurrent transfers could complete
+ * out of order. The pending blocks are therefore submitted as one chain of
+ * linked requests, which the kernel processes in order, without going back to
+ * userspace in between. The next chain is only submitted once the previous
+ * one is done.
+ *
+ * The buffer's file descriptor is non-blocking, so a transfer would fail with
+ * -EAGAIN right away if the buffer is not ready. Each transfer is therefore
+ * preceded by a linked poll request, which waits for the buffer to be ready.
+ * The lock must be held. */
+static int local_uring_submit(struct local_uring *uring)
+{
+	struct local_uring_block *block, **last = &uring->chain;
+	struct iio_buffer_pdata *buf;
+	struct io_uring_sqe *sqe = NULL;
+	bool is_tx;
+
+	if (uring->cancelled || uring->nb_inflight)
+		return local_uring_flush(uring);
+
+	while (uring->pending && local_uring_get_sq_space(uring) >= 2) {
+		block = uring->pending;
+		buf = block->pdata.buf;
+		is_tx = iio_device_is_tx(buf->dev);
+
+		sqe = local_uring_get_sqe(uring);
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->fd = buf->fd;
+		sqe->poll_events = is_tx ? POLLOUT : POLLIN;
+		sqe->flags = IOSQE_IO_LINK;
+		sqe->user_data = (uintptr_t) block | LOCAL_URING_POLL_TAG;
+
+		sqe = local_uring_get_sqe(uring);
+		if (is_tx)
+			sqe->opcode = IORING_OP_WRITE;
+		else
+			sqe->opcode = IORING_OP_READ;
+
+		sqe->fd = buf->fd;
+		sqe->addr = (uintptr_t) block->pdata.data + block->done;
+		sqe->len = (unsigned int) (block->bytes_used - block->done);
+		sqe->flags = IOSQE_IO_LINK;
+		sqe->user_data = (uintptr_t) block;
+
+		uring->pending = block->next;
+		block->next = NULL;
+		block->submitted = true;
+
+		*last = block;
+		last = &block->chain_next;
+		uring->nb_inflight++;
+	}
+
+	if (!uring->pending)
+		uring->pending_tail = NULL;
+
+	/* Terminate the chain */
+	if (sqe)
+		sqe->flags &= ~IOSQE_IO_LINK;
+
+	return local_uring_flush(uring);
+}
+
+static void local_uring_complete(struct local_uring *uring,
+				 struct local_uring_block *block, int err)
+{
+	block->err = err;
+	block->completed = true;
+	block->submitted = false;
+}
+
+static void local_uring_handle_cqe(struct local_uring *uring,
+				   struct local_uring_block *block, int res)
+{
+	uring->nb_inflight--;
+
+	if (res > 0) {
+		block->done += (size_t) res;
+
+		/* A short transfer breaks the chain; the remainder is
+		 * submitted again, ahead of the blocks that followed. */
+		if (block->done >= block->bytes_used)
+			local_uring_complete(uring, block, 0);
+	} else if (res == 0) {
+		local_uring_complete(uring, block, -EIO);
+	} else if (res == -ECANCELED || res == -EINTR || res == -EAGAIN) {
+		if (uring->cancelled)
+			local_uring_complete(uring, block, -EBADF);
+		else if (block->freeing)
+			local_uring_complete(uring, block, res);
+
+		/* Otherwise, the chain was interrupted before the transfer
+		 * could complete; it will be submitted again, behind a new
+		 * poll request, so that it waits for the buffer to be ready
+		 * instead of failing again right away. */
+	} else {
+		local_uring_complete(uring, block, res);
+	}
+}
+
+/* Process the completions, and requeue the transfers that were interrupted
+ * once the whole chain is done. The lock must be held. */
+static void local_uring_reap(struct local_uring *uring)
+{
+	struct local_uring_block *block, *next, *requeue = NULL, **last;
+	unsigned int head = *uring->cq_head, tail;
+	struct io_uring_cqe *cqe;
+
+	tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+
+	for (; head != tail; head++) {
+		cqe = &uring->cqes[head & *uring->cq_mask];
+
+		/* Completions of cancellation requests have no block. Those
+		 * of poll requests are not needed: if the poll failed, the
+		 * linked transfer is cancelled, and completes as such. */
+		if (cqe->user_data && !(cqe->user_data & LOCAL_URING_POLL_TAG))
+			local_uring_handle_cqe(uring, (void *)(uintptr_t) cqe->user_data,
+					       cqe->res);
+	}
+
+	__atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+
+	if (uring->nb_inflight || !uring->chain)
+		return;
+
+	last = &requeue;
+
+	for (block = uring->chain; block; block = next) {
+		next = block->chain_next;
+		block->chain_next = NULL;
+
+		/* A block being freed is not submitted again: the freeing
+		 * thread only waits for it to leave the chain. */
+		if (block->submitted && block->freeing) {
+			local_uring_complete(uring, block, -EBADF);
+		} else if (block->submitted) {
+			block->submitted = false;
+			*last = block;
+			last = &block->next;
+		}
+	}
+
+	uring->chain = NULL;
+
+	if (requeue) {
+		*last = uring->pending;
+		if (!uring->pending)
+			uring->pending_tail = container_of(last,
+							   struct local_uring_block,
+							   next);
+		uring->pending = requeue;
+	}
+}
+
+/* Ask the kernel to abort the transfers of the chain, and the poll requests
+ * preceding them. Aborting the request in progress cancels all the linked
+ * ones. Returns -EAGAIN if the ring had no room for all the requests.
+ * The lock must be held. */
+static int local_uring_abort(struct local_uring *uring)
+{
+	struct local_uring_block *block;
+	struct io_uring_sqe *sqe;
+	int ret;
+
+	for (block = uring->chain; block; block = block->chain_next) {
+		if (!block->submitted)
+			continue;
+
+		if (local_uring_get_sq_space(uring) < 2) {
+			ret = local_uring_flush(uring);
+			return ret < 0 ? ret : -EAGAIN;
+		}
+
+		sqe = local_uring_get_sqe(uring);
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->fd = -1;
+		sqe->addr = (uintptr_t) block | LOCAL_URING_POLL_TAG;
+
+		sqe = local_uring_get_sqe(uring);
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->fd = -1;
+		sqe->addr = (uintptr_t) block;
+	}
+
+	return local_uring_flush(uring);
+}
+
+static int local_uring_init(struct iio_buffer_pdata *pdata)
+{
+	struct local_uring *uring;
+	int err;
+
+	if (!pdata->uring_check_done) {
+		pdata->uring_check_done = true;
+
+		uring = local_uring_create();
+		err = iio_err(uring);
+		if (err) {
+			dev_dbg(pdata->dev, "io_uring unavailable: %d\n", err);
+			return err;
+		}
+
+		pdata->uring = uring;
+	}
+
+	return pdata->uring ? 0 : -ENOSYS;
+}
+
+static struct iio_block_pdata *
+local_uring_new_block(struct iio_buffer_pdata *pdata, void *ptr,
+		      size_t size, void **data)
+{
+	struct local_uring_block *block;
+	int err;
+
+	/* io_uring blocks go through the fileio interface, which cannot be
+	 * used along with DMABUF or MMAP blocks on the same buffer. */
+	if (pdata->dmabuf_supported || pdata->dmabuf_imported
+	    || pdata->mmap_supported)
+		return iio_ptr(-EINVAL);
+
+	err = local_uring_init(pdata);
+	if (err)
+		return iio_ptr(-ENOSYS);
+
+	block = zalloc(sizeof(*block));
+	if (!block)
+		return iio_ptr(-ENOMEM);
+
+	if (ptr) {
+		block->user_memory = true;
+	} else {
+		ptr = iio_block_allocator_alloc(pdata->allocator, size);
+		if (!ptr) {
+			free(block);
+			return iio_ptr(-ENOMEM);
+		}
+	}
+
+	block->pdata.buf = pdata;
+	block->pdata.data = ptr;
+	block->pdata.size = size;
+	block->pdata.uring = true;
+
+	if (size > pdata->size)
+		pdata->size = size;
+
+	iio_mutex_lock(pdata->uring->lock);
+	pdata->uring->nb_blocks++;
+	iio_mutex_unlock(pdata->uring->lock);
+
+	if (data)
+		*data = ptr;
+
+	return &block->pdata;
+}
+
+struct iio_block_pdata *
+local_create_uring_block(struct iio_buffer_pdata *pdata,
+			 size_t size, void **data)
+{
+	return local_uring_new_block(pdata, NULL, size, data);
+}
+
+struct iio_block_pdata *
+local_create_uring_block_from_memory(struct iio_buffer_pdata *pdata,
+				     void *ptr, size_t size)
+{
+	return local_uring_new_block(pdata, ptr, size, NULL);
+}
+
+void local_free_uring_block(struct iio_block_pdata *pdata)
+{
+	struct local_uring_block *prev, **ptr, *block = local_uring_get_block(pdata);
+	struct local_uring *uring = pdata->buf->uring;
+	struct pollfd pollfd = { .fd = uring->fd, .events = POLLIN };
+	bool aborted = false;
+
+	iio_mutex_lock(uring->lock);
+
+	/* The kernel may still be accessing the memory; abort the transfer
+	 * and wait for it to be done. The lock is dropped while waiting, so
+	 * that the other blocks can still be used. */
+	block->freeing = true;
+
+	for (local_uring_reap(uring); block->submitted;
+	     local_uring_reap(uring)) {
+		/* If the ring was full, queue the abort again once the
+		 * kernel consumed some requests. */
+		if (!aborted)
+			aborted = local_uring_abort(uring) != -EAGAIN;
+
+		iio_mutex_unlock(uring->lock);
+		poll(&pollfd, 1, LOCAL_URING_FREE_POLL_MS);
+		iio_mutex_lock(uring->lock);
+	}
+
+	for (ptr = &uring->chain; *ptr; ptr = &(*ptr)->chain_next) {
+		if (*ptr == block) {
+			*ptr = block->chain_next;
+			break;
+		}
+	}
+
+	for (ptr = &uring->pending, prev = NULL; *ptr;
+	     prev = *ptr, ptr = &(*ptr)->next) {
+		if (*ptr == block) {
+			*ptr = block->next;
+			if (uring->pending_tail == block)
+				uring->pending_tail = prev;
+			break;
+		}
+	}
+
+	/* Let the next blocks pick the watermark */
+	if (!--uring->nb_blocks)
+		pdata->buf->size = 0;
+
+	/* Resubmit the transfers of the other blocks, if they were part of
+	 * the aborted chain */
+	local_uring_submit(uring);
+
+	iio_mutex_unlock(uring->lock);
+
+	if (!block->user_memory)
+		iio_block_allocator_free(pdata->buf->allocator, pdata->data);
+	free(block);
+}
+
+int local_enqueue_uring_block(struct iio_block_pdata *pdata,
+			      size_t bytes_used, bool cyclic)
+{
+	struct local_uring_block *block = local_uring_get_block(pdata);
+	struct local_uring *uring = pdata->buf->uring;
+	int ret;
+
+	if (block->enqueued) {
+		/* Already enqueued */
+		return -EPERM;
+	}
+
+	iio_mutex_lock(uring->lock);
+
+	if (uring->cancelled) {
+		iio_mutex_unlock(uring->lock);
+		return -EBADF;
+	}
+
+	block->bytes_used = bytes_used;
+	block->done = 0;
+	block->err = 0;
+	block->completed = false;
+	block->enqueued = true;
+
+	if (uring->pending_tail)
+		uring->pending_tail->next = block;
+	else
+		uring->pending = block;
+	uring->pending_tail = block;
+
+	/* If the submission fails, the block stays queued; the submission is
+	 * retried, and the error reported, when the block is dequeued. */
+	ret = local_uring_submit(uring);
+
+	iio_mutex_unlock(uring->lock);
+
+	if (ret < 0)
+		dev_dbg(pdata->buf->dev, "io_uring submission failed: %d\n", ret);
+
+	return 0;
+}
+
+int local_dequeue_uring_block(struct iio_block_pdata *pdata, bool nonblock)
+{
+	struct local_uring_block *block = local_uring_get_block(pdata);
+	struct iio_buffer_pdata *buf = pdata->buf;
+	struct timespec start, *time_ptr = NULL;
+	struct local_uring *uring = buf->uring;
+	bool completed, cancelled;
+	int ret;
+
+	if (!block->enqueued) {
+		/* Already dequeued */
+		return -EPERM;
+	}
+
+	if (!nonblock) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		time_ptr = &start;
+	}
+
+	for (;;) {
+		iio_mutex_lock(uring->lock);
+
+		local_uring_reap(uring);
+
+		completed = block->completed;
+		cancelled = uring->cancelled;
+		ret = 0;
+
+		if (!completed && !cancelled)
+			ret = local_uring_submit(uring);
+
+		iio_mutex_unlock(uring->lock);
+
+		if (completed) {
+			block->enqueued = false;
+			return block->err;
+		}
+
+		if (cancelled)
+			return -EBADF;
+		if (ret < 0)
+			return ret;
+
+		/* The ring's file descriptor is readable when completions are
+		 * available. */
+		ret = buffer_check_ready(buf, uring->fd, POLLIN, time_ptr);
+		if (ret < 0)
+			return ret;
+	}
+}
+
+void local_cancel_uring(struct local_uring *uring)
+{
+	struct local_uring_block *block, *next;
+
+	iio_mutex_lock(uring->lock);
+
+	uring->cancelled = true;
+
+	for (block = uring->pending; block; block = next) {
+		next = block->next;
+		block->next = NULL;
+		local_uring_complete(uring, block, -EBADF);
+	}
+
+	uring->pending = NULL;
+	uring->pending_tail = NULL;
+
+	local_uring_abort(uring);
+
+	iio_mutex_unlock(uring->lock);
+}
+
+unsigned int local_uring_get_nb_blocks(struct local_uring *uring)
+{
+	unsigned int nb_blocks;
+
+	iio_mutex_lock(uring->lock);
+	nb_blocks = uring->nb_blocks;
+	iio_mutex_unlock(uring->lock);
+
+	return nb_blocks;
+}
@@ -52,6 +52,7 @@ static int local_context_scan(const struct iio_context_params *params,
 
 struct iio_context_pdata {
 	struct iio_mutex *lock;
+	struct local_attr_cache *attr_cache;
 };
 
 struct iio_device_pdata {
@@ -68,6 +69,16 @@ struct iio_channel_pdata {
 	struct iio_attr_list protected;
 };
 
+/* Max. number of threads used to enumerate the devices' attributes */
+#define LOCAL_SCAN_THREADS 8
+
+struct local_scan {
+	struct iio_context *ctx;
+	struct iio_mutex *lock;
+	unsigned int next;
+	int err;
+};
+
 static const char * const device_attrs_denylist[] = {
 	"dev",
 	"uevent",
@@ -126,6 +137,8 @@ static void local_shutdown(struct iio_context *ctx)
 
 	if (ctx->pdata && ctx->pdata->lock)
 		iio_mutex_destroy(ctx->pdata->lock);
+	if (ctx->pdata && ctx->pdata->attr_cache)
+		local_attr_cache_free(ctx->pdata->attr_cache);
 }
 
 /** Shrinks the first nb characters of a string
@@ -324,13 +337,22 @@ static int local_do_enable_buffer(struct iio_buffer_pdata *pdata, bool enable)
 static int local_enable_buffer(struct iio_buffer_pdata *pdata,
 			       size_t nb_samples, bool enable, bool cyclic)
 {
+	size_t length = nb_samples;
 	int ret;
 
-	if ((pdata->dmabuf_supported | pdata->mmap_supported) != !nb_samples)
+	if (WITH_LOCAL_IO_URING && pdata->uring && !nb_samples) {
+		/* The kernel buffer holds all the blocks, so that it can keep
+		 * up while a chain of transfers is being resubmitted. */
+		nb_samples = pdata->size / pdata->sample_size;
+		length = nb_samples * local_uring_get_nb_blocks(pdata->uring);
+	}
+
+	if ((pdata->dmabuf_supported | pdata->dmabuf_imported
+	     | pdata->mmap_supported) != !nb_samples)
 		return -EINVAL;
 
 	if (nb_samples) {
-		ret = local_set_buffer_size(pdata, nb_samples);
+		ret = local_set_buffer_size(pdata, length);
 		if (ret)
 			return ret;
 
@@ -437,11 +459,11 @@ local_writebuf(struct iio_buffer_pdata *buffer, const void *src, size_t len)
 		return ret;
 }
 
-static ssize_t local_do_read_dev_attr(const char *id, unsigned int buf_id,
+static ssize_t local_do_read_dev_attr(struct local_attr_cache *cache,
+				      const char *id, unsigned int buf_id,
 				      const char *attr, char *dst, size_t len,
 				      enum iio_attr_type type)
 {
-	FILE *f;
 	char buf[1024];
 	ssize_t ret;
 
@@ -478,25 +500,17 @@ static ssize_t local_do_read_dev_attr(const char *id, unsigned int buf_id,
 			return -EINVAL;
 	}
 
-	f = fopen(buf, "re");
-	if (!f)
-		return -errno;
-
-	ret = fread(dst, 1, len, f);
+	ret = local_attr_read(cache, buf, dst, len);
 
 	/* if we didn't read the entire file, fail */
-	if (!feof(f))
+	if (ret == (ssize_t) len)
 		ret = -EFBIG;
 
 	if (ret > 0)
 		dst[ret - 1] = '\0';
-	else
+	else if (len)
 		dst[0] = '\0';
 
-	fflush(f);
-	if (ferror(f))
-		ret = -errno;
-	fclose(f);
 	return ret;
 }
 
@@ -507,7 +521,8 @@ static ssize_t local_read_dev_attr(const struct iio_device *dev,
 {
 	const char *id = iio_device_get_id(dev);
 
-	return local_do_read_dev_attr(id, buf_id, attr, dst, len, type);
+	return local_do_read_dev_attr(dev->ctx->pdata->attr_cache,
+				      id, buf_id, attr, dst, len, type);
 }
 
 static ssize_t local_write_dev_attr(const struct iio_device *dev,
@@ -515,7 +530,6 @@ static ssize_t local_write_dev_attr(const struct iio_device *dev,
 				    const char *src, size_t len,
 				    enum iio_attr_type type)
 {
-	FILE *f;
 	char buf[1024];
 	ssize_t ret;
 
@@ -552,15 +566,8 @@ static ssize_t local_write_dev_attr(const struct iio_device *dev,
 			return -EINVAL;
 	}
 
-	f = fopen(buf, "we");
-	if (!f)
-		return -errno;
+	ret = local_attr_write(dev->ctx->pdata->attr_cache, buf, src, len);
 
-	ret = fwrite(src, 1, len, f);
-	fflush(f);
-	if (ferror(f))
-		ret = -errno;
-	fclose(f);
 	return ret ? ret : -EIO;
 }
 
@@ -1235,7 +1242,6 @@ static int add_events(struct iio_device *dev, const char *devpath)
 
 static int create_device(void *d, const char *path)
 {
-	unsigned int i;
 	int ret;
 	struct iio_context *ctx = d;
 	struct iio_device *dev;
@@ -1244,12 +1250,14 @@ static int create_device(void *d, const char *path)
 
 	id = strrchr(path, '/') + 1;
 
-	ret = (int)local_do_read_dev_attr(id, 0, "name", name, sizeof(name),
+	ret = (int)local_do_read_dev_attr(ctx->pdata->attr_cache, id, 0,
+					  "name", name, sizeof(name),
 					  IIO_ATTR_TYPE_DEVICE);
 	if (ret > 0)
 		name_ptr = name;
 
-	ret = (int)local_do_read_dev_attr(id, 0, "label", label, sizeof(label),
+	ret = (int)local_do_read_dev_attr(ctx->pdata->attr_cache, id, 0,
+					  "label", label, sizeof(label),
 					  IIO_ATTR_TYPE_DEVICE);
 	if (ret < 0)
 		label_ptr = label;
@@ -1258,13 +1266,31 @@ static int create_device(void *d, const char *path)
 	if (!dev)
 		return -ENOMEM;
 
+	return 0;
+}
+
+/* Enumerate the attributes and channels of a device. This only touches the
+ * device itself, so several devices can be populated concurrently. On error,
+ * the device is left to be freed along with the context. */
+static int populate_device(struct iio_device *dev)
+{
+	const struct iio_context *ctx = iio_device_get_context(dev);
+	char path[PATH_MAX];
+	unsigned int i;
+	int ret;
+
+	if (WITH_HWMON && iio_device_is_hwmon(dev))
+		iio_snprintf(path, sizeof(path), "/sys/class/hwmon/%s", dev->id);
+	else
+		iio_snprintf(path, sizeof(path), "/sys/bus/iio/devices/%s", dev->id);
+
 	ret = foreach_in_dir(ctx, dev, path, false, add_attr_or_channel);
 	if (ret < 0)
-		goto err_free_device;
+		goto err_free_scan_elements;
 
 	ret = add_buffer_attributes(dev, path);
 	if (ret < 0)
-		goto err_free_device;
+		goto err_free_scan_elements;
 
 	ret = add_events(dev, path);
 	if (ret < 0)
@@ -1289,7 +1315,7 @@ static int create_device(void *d, const char *path)
 
 	ret = detect_and_move_global_attrs(dev);
 	if (ret < 0)
-		goto err_free_device;
+		return ret;
 
 	/* sorting is done after global attrs are added */
 	for (i = 0; i < dev->nb_channels; i++)
@@ -1302,12 +1328,75 @@ static int create_device(void *d, const char *path)
 err_free_scan_elements:
 	for (i = 0; i < dev->nb_channels; i++)
 		free_protected_attrs(dev->channels[i]);
-err_free_device:
-	local_free_pdata(dev);
-	free_device(dev);
 	return ret;
 }
 
+static int populate_devices_thrd(void *d)
+{
+	struct local_scan *scan = d;
+	struct iio_device *dev;
+	int ret;
+
+	for (;;) {
+		iio_mutex_lock(scan->lock);
+		if (scan->err || scan->next == scan->ctx->nb_devices) {
+			iio_mutex_unlock(scan->lock);
+			break;
+		}
+
+		dev = scan->ctx->devices[scan->next++];
+		iio_mutex_unlock(scan->lock);
+
+		ret = populate_device(dev);
+		if (ret < 0) {
+			iio_mutex_lock(scan->lock);
+			if (!scan->err)
+				scan->err = ret;
+			iio_mutex_unlock(scan->lock);
+		}
+	}
+
+	return 0;
+}
+
+static int populate_devices(struct iio_context *ctx)
+{
+	struct iio_thrd *thrds[LOCAL_SCAN_THREADS - 1];
+	struct local_scan scan = { .ctx = ctx };
+	unsigned int i, nb_thrds = LOCAL_SCAN_THREADS;
+	long nb_cpus;
+	int ret;
+
+	nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nb_cpus > 0 && (unsigned long) nb_cpus < nb_thrds)
+		nb_thrds = (unsigned int) nb_cpus;
+	if (ctx->nb_devices < nb_thrds)
+		nb_thrds = ctx->nb_devices;
+
+	scan.lock = iio_mutex_create();
+	ret = iio_err(scan.lock);
+	if (ret)
+		return ret;
+
+	/* The calling thread takes part in the scan, so failing to create
+	 * the additional threads only makes it slower. */
+	for (i = 0; i + 1 < nb_thrds; i++) {
+		thrds[i] = iio_thrd_create(populate_devices_thrd, &scan,
+					   "local-scan");
+		if (iio_err(thrds[i]))
+			break;
+	}
+
+	populate_devices_thrd(&scan);
+
+	while (i--)
+		iio_thrd_join_and_destroy(thrds[i]);
+
+	iio_mutex_destroy(scan.lock);
+
+	return scan.err;
+}
+
 static int add_debug_attr(void *d, const char *path)
 {
 	struct iio_device *dev = d;
@@ -1343,6 +1432,9 @@ static void local_signal_cancel_fd(const struct iio_device *dev, int fd)
 static void local_cancel_buffer(struct iio_buffer_pdata *pdata)
 {
 	local_signal_cancel_fd(pdata->dev, pdata->cancel_fd);
+
+	if (WITH_LOCAL_IO_URING && pdata->uring)
+		local_cancel_uring(pdata->uring);
 }
 
 static char * local_get_description(const struct iio_context *ctx)
@@ -1532,6 +1624,8 @@ local_create_buffer(const struct iio_device *dev, unsigned int idx,
 		}
 	}
 
+	pdata->sample_size = iio_device_get_sample_size(dev, mask);
+
 	return pdata;
 
 err_close:
@@ -1547,6 +1641,9 @@ err_free_pdata:
 
 static void local_free_buffer(struct iio_buffer_pdata *pdata)
 {
+	if (WITH_LOCAL_IO_URING && pdata->uring)
+		local_uring_destroy(pdata->uring);
+
 	free(pdata->pdata);
 	local_close_fd(pdata->dev, pdata->fd);
 	close(pdata->cancel_fd);
@@ -1577,12 +1674,43 @@ local_create_block(struct iio_buffer_pdata *pdata, size_t size, void **data)
 			return block;
 	}
 
+	if (WITH_LOCAL_IO_URING)
+		return local_create_uring_block(pdata, size, data);
+
+	return iio_ptr(-ENOSYS);
+}
+
+static struct iio_block_pdata *
+local_create_block_from_memory(struct iio_buffer_pdata *pdata,
+			       void *ptr, size_t size)
+{
+	if (WITH_LOCAL_IO_URING)
+		return local_create_uring_block_from_memory(pdata, ptr, size);
+
+	return iio_ptr(-ENOSYS);
+}
+
+static void local_set_block_allocator(struct iio_buffer_pdata *pdata,
+				      struct iio_block_allocator *alloc)
+{
+	pdata->allocator = alloc;
+}
+
+static struct iio_block_pdata *
+local_create_block_from_dmabuf(struct iio_buffer_pdata *pdata, int fd,
+			       size_t size, void **data)
+{
+	if (WITH_LOCAL_DMABUF_API)
+		return local_import_dmabuf(pdata, fd, size, data);
+
 	return iio_ptr(-ENOSYS);
 }
 
 static void local_free_block(struct iio_block_pdata *pdata)
 {
-	if (WITH_LOCAL_DMABUF_API && pdata->buf->dmabuf_supported)
+	if (WITH_LOCAL_IO_URING && pdata->uring)
+		local_free_uring_block(pdata);
+	else if (WITH_LOCAL_DMABUF_API && pdata->dmabuf)
 		local_free_dmabuf(pdata);
 	else if (WITH_LOCAL_MMAP_API && pdata->buf->mmap_supported)
 		local_free_mmap_block(pdata);
@@ -1591,7 +1719,10 @@ static void local_free_block(struct iio_block_pdata *pdata)
 static int local_enqueue_block(struct iio_block_pdata *pdata,
 			       size_t bytes_used, bool cyclic)
 {
-	if (WITH_LOCAL_DMABUF_API && pdata->buf->dmabuf_supported)
+	if (WITH_LOCAL_IO_URING && pdata->uring)
+		return local_enqueue_uring_block(pdata, bytes_used, cyclic);
+
+	if (WITH_LOCAL_DMABUF_API && pdata->dmabuf)
 		return local_enqueue_dmabuf(pdata, bytes_used, cyclic);
 
 	if (WITH_LOCAL_MMAP_API && pdata->buf->mmap_supported)
@@ -1602,7 +1733,10 @@ static int local_enqueue_block(struct iio_block_pdata *pdata,
 
 int local_dequeue_block(struct iio_block_pdata *pdata, bool nonblock)
 {
-	if (WITH_LOCAL_DMABUF_API && pdata->buf->dmabuf_supported)
+	if (WITH_LOCAL_IO_URING && pdata->uring)
+		return local_dequeue_uring_block(pdata, nonblock);
+
+	if (WITH_LOCAL_DMABUF_API && pdata->dmabuf)
 		return local_dequeue_dmabuf(pdata, nonblock);
 
 	if (WITH_LOCAL_MMAP_API && pdata->buf->mmap_supported)
@@ -1611,6 +1745,14 @@ int local_dequeue_block(struct iio_block_pdata *pdata, bool nonblock)
 	return -ENOSYS;
 }
 
+static int local_get_dmabuf_fd(struct iio_block_pdata *pdata)
+{
+	if (WITH_LOCAL_DMABUF_API && pdata->dmabuf)
+		return local_dmabuf_get_fd(pdata);
+
+	return -EINVAL;
+}
+
 static struct iio_event_stream_pdata *
 local_open_events_fd(const struct iio_device *dev)
 {
@@ -1656,8 +1798,9 @@ static void local_close_events_fd(struct iio_event_stream_pdata *pdata)
 	free(pdata);
 }
 
-static int local_read_event(struct iio_event_stream_pdata *pdata,
-			    struct iio_event *out_event, bool nonblock)
+static ssize_t local_read_events(struct iio_event_stream_pdata *pdata,
+				 struct iio_event *events, size_t nb,
+				 bool nonblock)
 {
 	struct pollfd pollfd[2] = {
 		{
@@ -1668,7 +1811,8 @@ static int local_read_event(struct iio_event_stream_pdata *pdata,
 			.events = POLLIN,
 		}
 	};
-	int ret, timeout_rel = nonblock ? 0 : -1;
+	int timeout_rel = nonblock ? 0 : -1;
+	ssize_t ret;
 
 	do {
 		ret = poll(pollfd, 2, timeout_rel);
@@ -1691,10 +1835,22 @@ static int local_read_event(struct iio_event_stream_pdata *pdata,
 		return -EIO;
 	}
 
-	if (read(pdata->fd, out_event, sizeof(*out_event)) < 0) /* Flawfinder: ignore */
+	/* The kernel returns as many queued events as fit in the buffer */
+	ret = read(pdata->fd, events, nb * sizeof(*events)); /* Flawfinder: ignore */
+	if (ret < 0)
 		return -errno;
 
-	return 0;
+	return ret / (ssize_t) sizeof(*events);
+}
+
+static int local_read_event(struct iio_event_stream_pdata *pdata,
+			    struct iio_event *out_event, bool nonblock)
+{
+	ssize_t ret;
+
+	ret = local_read_events(pdata, out_event, 1, nonblock);
+
+	return ret < 0 ? (int) ret : 0;
 }
 
 static const struct iio_backend_ops local_ops = {
@@ -1710,6 +1866,10 @@ static const struct iio_backend_ops local_ops = {
 	.free_block = local_free_block,
 	.enqueue_block = local_enqueue_block,
 	.dequeue_block = local_dequeue_block,
+	.get_dmabuf_fd = local_get_dmabuf_fd,
+	.create_block_from_dmabuf = local_create_block_from_dmabuf,
+	.set_block_allocator = local_set_block_allocator,
+	.create_block_from_memory = local_create_block_from_memory,
 
 	.create_buffer = local_create_buffer,
 	.free_buffer = local_free_buffer,
@@ -1722,6 +1882,7 @@ static const struct iio_backend_ops local_ops = {
 	.open_ev = local_open_events_fd,
 	.close_ev = local_close_events_fd,
 	.read_ev = local_read_event,
+	.read_ev_many = local_read_events,
 };
 
 const struct iio_backend iio_local_backend = {
@@ -1802,15 +1963,237 @@ out_close_ini:
 	return ret;
 }
 
+static int init_context_pdata(struct iio_context *ctx)
+{
+	int ret;
+
+	ctx->pdata = calloc(1, sizeof(*ctx->pdata));
+	if (!ctx->pdata)
+		return -ENOMEM;
+
+	ctx->pdata->lock = iio_mutex_create();
+	ret = iio_err(ctx->pdata->lock);
+	if (ret < 0) {
+		ctx->pdata->lock = NULL;
+		return ret;
+	}
+
+	ctx->pdata->attr_cache = local_attr_cache_new();
+	ret = iio_err(ctx->pdata->attr_cache);
+	if (ret < 0) {
+		ctx->pdata->attr_cache = NULL;
+		return ret;
+	}
+
+	return 0;
+}
+
+static ssize_t snapshot_print_enable_fns(const struct iio_context *ctx,
+					 char *str, size_t len)
+{
+	const struct iio_channel *chn;
+	const struct iio_device *dev;
+	unsigned int i, j;
+	ssize_t ret, total = 0;
+
+	for (i = 0; i < ctx->nb_devices; i++) {
+		dev = ctx->devices[i];
+
+		for (j = 0; j < dev->nb_channels; j++) {
+			chn = dev->channels[j];
+			if (!chn->pdata || !chn->pdata->enable_fn)
+				continue;
+
+			ret = iio_snprintf(str, len, "%s %c %s %s\n", dev->id,
+					   chn->is_output ? 'o' : 'i',
+					   chn->id, chn->pdata->enable_fn);
+			if (ret < 0)
+				return ret;
+
+			total += ret;
+			if (str) {
+				str += ret;
+				len -= ret;
+			}
+		}
+	}
+
+	return total;
+}
+
+/* The XML description of a context does not record which file enables each
+ * channel; it is saved along with the snapshot, as one line per channel. */
+static char * snapshot_get_enable_fns(const struct iio_context *ctx)
+{
+	ssize_t len;
+	char *str;
+
+	len = snapshot_print_enable_fns(ctx, NULL, 0);
+	if (len < 0)
+		return iio_ptr((int) len);
+
+	str = malloc(len + 1);
+	if (!str)
+		return iio_ptr(-ENOMEM);
+
+	*str = '\0';
+	snapshot_print_enable_fns(ctx, str, len + 1);
+
+	return str;
+}
+
+static int snapshot_set_enable_fns(struct iio_context *ctx, char *data)
+{
+	char *line, *dev_id, *dir, *chn_id, *fn, *saveptr;
+	struct iio_channel *chn;
+	struct iio_device *dev;
+	unsigned int i, j;
+
+	for (i = 0; i < ctx->nb_devices; i++) {
+		dev = ctx->devices[i];
+
+		for (j = 0; j < dev->nb_channels; j++) {
+			dev->channels[j]->pdata =
+				zalloc(sizeof(struct iio_channel_pdata));
+			if (!dev->channels[j]->pdata)
+				return -ENOMEM;
+		}
+	}
+
+	for (line = strtok_r(data, "\n", &saveptr); line;
+	     line = strtok_r(NULL, "\n", &saveptr)) {
+		dev_id = line;
+		dir = strchr(dev_id, ' ');
+		chn_id = dir ? strchr(dir + 1, ' ') : NULL;
+		fn = chn_id ? strchr(chn_id + 1, ' ') : NULL;
+		if (!fn)
+			return -EINVAL;
+
+		*dir++ = '\0';
+		*chn_id++ = '\0';
+		*fn++ = '\0';
+
+		dev = (struct iio_device *) iio_context_find_device(ctx, dev_id);
+		if (!dev || strcmp(dev->id, dev_id))
+			return -EINVAL;
+
+		chn = (struct iio_channel *)
+			iio_device_find_channel(dev, chn_id, *dir == 'o');
+		if (!chn || chn->pdata->enable_fn)
+			return -EINVAL;
+
+		chn->pdata->enable_fn = iio_strdup(fn);
+		if (!chn->pdata->enable_fn)
+			return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/* Create the context from the snapshot saved in the cache directory, if it
+ * matches the given fingerprint. Returns NULL if there is no usable snapshot,
+ * in which case the context must be built from sysfs. */
+static struct iio_context *
+local_create_context_from_snapshot(const struct iio_context_params *params,
+				   uint64_t fingerprint)
+{
+	struct iio_context *ctx;
+	struct iio_device *dev;
+	const char *data;
+	unsigned int i, j;
+	char *xml;
+	int ret;
+
+	xml = local_snapshot_load(params, fingerprint, &data);
+	if (!xml)
+		return NULL;
+
+	ctx = iio_create_context_from_xml(params, xml, &iio_local_backend,
+					  NULL, NULL, NULL, 0);
+	ret = iio_err(ctx);
+	if (ret) {
+		prm_perror(params, ret, "Unable to create context from snapshot");
+		free(xml);
+		return NULL;
+	}
+
+	ret = init_context_pdata(ctx);
+	if (ret < 0)
+		goto err_context_destroy;
+
+	ret = snapshot_set_enable_fns(ctx, (char *) data);
+	if (ret < 0)
+		goto err_context_destroy;
+
+	ret = iio_context_init(ctx);
+	if (ret < 0)
+		goto err_context_destroy;
+
+	ret = init_devices(ctx);
+	if (ret < 0)
+		goto err_context_destroy;
+
+	/* The scale and offset saved in the snapshot may be stale; have them
+	 * read back from sysfs when the context is created. */
+	for (i = 0; i < ctx->nb_devices; i++) {
+		dev = ctx->devices[i];
+
+		for (j = 0; j < dev->nb_channels; j++) {
+			dev->channels[j]->scale_offset_known = false;
+			dev->channels[j]->scale_offset_from_desc = false;
+		}
+	}
+
+	free(xml);
+	return ctx;
+
+err_context_destroy:
+	prm_perror(params, ret, "Unable to use snapshot");
+	iio_context_destroy(ctx);
+	free(xml);
+	return NULL;
+}
+
+static void local_store_snapshot(const struct iio_context *ctx,
+				 uint64_t fingerprint)
+{
+	char *xml, *enable_fns;
+
+	xml = iio_context_get_xml(ctx);
+	if (iio_err(xml))
+		return;
+
+	enable_fns = snapshot_get_enable_fns(ctx);
+	if (!iio_err(enable_fns)) {
+		local_snapshot_store(&ctx->params, fingerprint,
+				     xml, enable_fns);
+		free(enable_fns);
+	}
+
+	free(xml);
+}
+
 static struct iio_context *
 local_create_context(const struct iio_context_params *params, const char *args)
 {
+	bool use_snapshot = WITH_XML_BACKEND && params->cache_dir;
+	uint64_t fingerprint = 0;
 	struct iio_context *ctx;
 	char *description;
 	int ret = -ENOMEM;
 	struct utsname uts;
 	bool no_iio;
 
+	if (use_snapshot) {
+		/* Computed before the scan, so that a change happening while
+		 * scanning invalidates the snapshot. */
+		fingerprint = local_snapshot_fingerprint();
+
+		ctx = local_create_context_from_snapshot(params, fingerprint);
+		if (ctx)
+			return ctx;
+	}
+
 	description = local_get_description(NULL);
 	if (!description)
 		return iio_ptr(-ENOMEM);
@@ -1822,14 +2205,7 @@ local_create_context(const struct iio_context_params *params, const char *args)
 	if (ret)
 		return iio_err_cast(ctx);
 
-	ctx->pdata = calloc(1, sizeof(*ctx->pdata));
-	if (!ctx->pdata) {
-		ret = -ENOMEM;
-		goto err_context_destroy;
-	}
-
-	ctx->pdata->lock = iio_mutex_create();
-	ret = iio_err(ctx->pdata->lock);
+	ret = init_context_pdata(ctx);
 	if (ret < 0)
 		goto err_context_destroy;
 
@@ -1850,6 +2226,10 @@ local_create_context(const struct iio_context_params *params, const char *args)
 			goto err_context_destroy;
 	}
 
+	ret = populate_devices(ctx);
+	if (ret < 0)
+		goto err_context_destroy;
+
 	iio_sort_devices(ctx);
 
 	foreach_in_dir(ctx, ctx, "/sys/kernel/debug/iio", true, add_debug);
@@ -1877,6 +2257,9 @@ local_create_context(const struct iio_context_params *params, const char *args)
 	if (ret < 0)
 		goto err_context_destroy;
 
+	if (use_snapshot)
+		local_store_snapshot(ctx, fingerprint);
+
 	return ctx;
 
 err_context_destroy:
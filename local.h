@@ -11,10 +11,15 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 struct iio_buffer_impl_pdata;
+struct iio_block_allocator;
 struct iio_block_impl_pdata;
+struct iio_context_params;
 struct iio_device;
+struct local_attr_cache;
+struct local_uring;
 struct timespec;
 
 struct iio_buffer_pdata {
@@ -25,6 +30,16 @@ struct iio_buffer_pdata {
 	bool dmabuf_supported;
 	bool mmap_supported;
 	size_t size;
+
+	/* Set once a DMABUF created outside of IIO has been attached */
+	bool dmabuf_imported;
+
+	size_t sample_size;
+	struct iio_block_allocator *allocator;
+
+	/* Set when transfers are submitted through io_uring */
+	struct local_uring *uring;
+	bool uring_check_done;
 };
 
 struct iio_block_pdata {
@@ -33,6 +48,15 @@ struct iio_block_pdata {
 	size_t size;
 	void *data;
 	bool dequeued;
+
+	/* Set for blocks backed by a DMABUF */
+	bool dmabuf;
+
+	/* Set for DMABUFs created outside of IIO */
+	bool imported;
+
+	/* Set for blocks transferred through io_uring */
+	bool uring;
 };
 
 int ioctl_nointr(int fd, unsigned long request, void *data);
@@ -42,11 +66,15 @@ int buffer_check_ready(struct iio_buffer_pdata *pdata, int fd,
 
 struct iio_block_pdata *
 local_create_dmabuf(struct iio_buffer_pdata *pdata, size_t size, void **data);
+struct iio_block_pdata *
+local_import_dmabuf(struct iio_buffer_pdata *pdata, int fd,
+		    size_t size, void **data);
 void local_free_dmabuf(struct iio_block_pdata *pdata);
 
 int local_enqueue_dmabuf(struct iio_block_pdata *pdata,
 			 size_t bytes_used, bool cyclic);
 int local_dequeue_dmabuf(struct iio_block_pdata *pdata, bool nonblock);
+int local_dmabuf_get_fd(struct iio_block_pdata *pdata);
 
 struct iio_block_pdata *
 local_create_mmap_block(struct iio_buffer_pdata *pdata,
@@ -59,4 +87,35 @@ int local_dequeue_mmap_block(struct iio_block_pdata *pdata, bool nonblock);
 
 struct iio_buffer_impl_pdata * local_alloc_mmap_buffer_impl(void);
 
+struct iio_block_pdata *
+local_create_uring_block(struct iio_buffer_pdata *pdata,
+			 size_t size, void **data);
+struct iio_block_pdata *
+local_create_uring_block_from_memory(struct iio_buffer_pdata *pdata,
+				     void *ptr, size_t size);
+void local_free_uring_block(struct iio_block_pdata *pdata);
+
+int local_enqueue_uring_block(struct iio_block_pdata *pdata,
+			      size_t bytes_used, bool cyclic);
+int local_dequeue_uring_block(struct iio_block_pdata *pdata, bool nonblock);
+
+void local_cancel_uring(struct local_uring *uring);
+void local_uring_destroy(struct local_uring *uring);
+unsigned int local_uring_get_nb_blocks(struct local_uring *uring);
+
+struct local_attr_cache * local_attr_cache_new(void);
+void local_attr_cache_free(struct local_attr_cache *cache);
+
+ssize_t local_attr_read(struct local_attr_cache *cache, const char *path,
+			char *dst, size_t len);
+ssize_t local_attr_write(struct local_attr_cache *cache, const char *path,
+			 const char *src, size_t len);
+
+uint64_t local_snapshot_fingerprint(void);
+char * local_snapshot_load(const struct iio_context_params *params,
+			   uint64_t fingerprint, const char **data);
+void local_snapshot_store(const struct iio_context_params *params,
+			  uint64_t fingerprint, const char *xml,
+			  const char *data);
+
 #endif /* __IIO_LOCAL_H */
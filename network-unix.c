@@ -178,17 +178,23 @@ int do_create_socket(const struct addrinfo *addrinfo)
 	return fd;
 }
 
-int do_select(int fd, unsigned int timeout)
+int do_select_any(const int *fds, unsigned int nb, unsigned int timeout)
 {
-	struct pollfd pfd;
+	struct pollfd pfd[NETWORK_MAX_ADDRS];
+	unsigned int i;
 	int ret;
 
-	pfd.fd = fd;
-	pfd.events = POLLOUT | POLLERR;
-	pfd.revents = 0;
+	if (nb > NETWORK_MAX_ADDRS)
+		return -EINVAL;
+
+	for (i = 0; i < nb; i++) {
+		pfd[i].fd = fds[i];
+		pfd[i].events = POLLOUT | POLLERR;
+		pfd[i].revents = 0;
+	}
 
 	do {
-		ret = poll(&pfd, 1, timeout);
+		ret = poll(pfd, nb, timeout ? (int) timeout : -1);
 	} while (ret == -1 && errno == EINTR);
 
 	if (ret < 0)
@@ -197,5 +203,7 @@ int do_select(int fd, unsigned int timeout)
 	if (ret == 0)
 		return -ETIMEDOUT;
 
-	return 0;
+	for (i = 0; !pfd[i].revents; i++);
+
+	return (int) i;
 }
@@ -118,11 +118,12 @@ int do_create_socket(const struct addrinfo *addrinfo)
 	return (int) s;
 }
 
-int do_select(int fd, unsigned int timeout)
+int do_select_any(const int *fds, unsigned int nb, unsigned int timeout)
 {
 	struct timeval tv;
 	struct timeval *ptv;
-	fd_set set;
+	fd_set wset, eset;
+	unsigned int i;
 	int ret;
 
 #ifdef _MSC_BUILD
@@ -132,8 +133,12 @@ int do_select(int fd, unsigned int timeout)
 	 */
 #pragma warning(disable : 4389)
 #endif
-	FD_ZERO(&set);
-	FD_SET(fd, &set);
+	FD_ZERO(&wset);
+	FD_ZERO(&eset);
+	for (i = 0; i < nb; i++) {
+		FD_SET(fds[i], &wset);
+		FD_SET(fds[i], &eset);
+	}
 #ifdef _MSC_BUILD
 #pragma warning(default: 4389)
 #endif
@@ -146,12 +151,18 @@ int do_select(int fd, unsigned int timeout)
 		ptv = NULL;
 	}
 
-	ret = select(fd + 1, NULL, &set, &set, ptv);
-	if (ret < 0)
+	/* The first argument is ignored on Windows */
+	ret = select(0, NULL, &wset, &eset, ptv);
+	if (ret == SOCKET_ERROR)
 		return -WSAGetLastError();
 
 	if (ret == 0)
-		return -WSAETIMEDOUT;
+		return -ETIMEDOUT;
 
-	return 0;
+	for (i = 0; i < nb; i++) {
+		if (FD_ISSET(fds[i], &wset) || FD_ISSET(fds[i], &eset))
+			break;
+	}
+
+	return (int) i;
 }
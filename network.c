@@ -8,6 +8,7 @@
 
 #include "dns_sd.h"
 #include "iio-config.h"
+#include "iio-private.h"
 #include "network.h"
 
 #include <iio/iio.h>
@@ -53,10 +54,17 @@
 
 #define NETWORK_TIMEOUT_MS 5000
 
+/* Delay before starting a connection attempt to the next address, while
+ * the previous ones are still in progress (RFC 8305 recommends 250 ms) */
+#define HAPPY_EYEBALLS_DELAY_MS 250
+
 struct iio_context_pdata {
 	struct iiod_client_pdata io_ctx;
 	struct addrinfo *addrinfo;
 	struct iiod_client *iiod_client;
+
+	/* Address that answered first, used for the other connections */
+	const struct addrinfo *conn_addrinfo;
 };
 
 struct iio_buffer_pdata {
@@ -172,33 +180,44 @@ network_writebuf(struct iio_buffer_pdata *pdata, const void *src, size_t len)
 	return iiod_client_writebuf(pdata->pdata, src, len);
 }
 
-/* The purpose of this function is to provide a version of connect()
- * that does not ignore timeouts... */
-static int do_connect(int fd, const struct addrinfo *addrinfo,
-	unsigned int timeout)
+/* Start a non-blocking connection to the given address. Returns the socket
+ * on success; *done is set if the connection was established immediately. */
+static int start_connect(const struct addrinfo *addrinfo, bool *done)
 {
-	int ret, error;
-	socklen_t len;
+	int ret, fd;
+
+	fd = do_create_socket(addrinfo);
+	if (fd < 0)
+		return fd;
 
 	ret = set_blocking_mode(fd, false);
 	if (ret < 0)
-		return ret;
+		goto err_close;
 
 	ret = connect(fd, addrinfo->ai_addr, (int) addrinfo->ai_addrlen);
+	*done = !ret;
 	if (ret < 0) {
 		ret = network_get_error();
 		if (!network_connect_in_progress(ret))
-			return ret;
+			goto err_close;
 	}
 
-	ret = do_select(fd, timeout);
-	if (ret < 0)
-		return ret;
+	return fd;
+
+err_close:
+	close(fd);
+	return ret;
+}
+
+static int finish_connect(int fd)
+{
+	int ret, error, yes = 1;
+	socklen_t len;
 
 	/* Verify that we don't have an error */
 	len = sizeof(error);
 	ret = getsockopt(fd, SOL_SOCKET, SO_ERROR, (char *)&error, &len);
-	if(ret < 0)
+	if (ret < 0)
 		return network_get_error();
 
 	if (error)
@@ -208,34 +227,129 @@ static int do_connect(int fd, const struct addrinfo *addrinfo,
 	if (ret < 0)
 		return ret;
 
+	if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY,
+		       (const char *) &yes, sizeof(yes)) < 0)
+		return network_get_error();
+
 	return 0;
 }
 
-int create_socket(const struct addrinfo *addrinfo, unsigned int timeout)
+/* Connect to the first responding address of the array, racing the
+ * connection attempts as described in RFC 8305 ("Happy Eyeballs"): a new
+ * attempt is started every HAPPY_EYEBALLS_DELAY_MS, or as soon as the
+ * previous one failed, without cancelling the ones still in progress.
+ * The timeout applies to the whole operation. */
+static int connect_any(const struct addrinfo **addrs, unsigned int nb,
+		       unsigned int timeout, unsigned int *idx)
 {
-	int ret, fd, yes = 1;
+	int fds[NETWORK_MAX_ADDRS], ret = -ENOENT, fd = -1;
+	unsigned int i, wait, nb_fds = 0, next = 0, ids[NETWORK_MAX_ADDRS];
+	uint64_t start_time = iio_read_counter_us(), elapsed;
+	bool done;
+
+	while (fd < 0 && (next < nb || nb_fds)) {
+		done = false;
+
+		if (next < nb) {
+			ret = start_connect(addrs[next], &done);
+			if (ret >= 0) {
+				fds[nb_fds] = ret;
+				ids[nb_fds++] = next;
+			}
 
-	fd = do_create_socket(addrinfo);
-	if (fd < 0)
-		return fd;
+			next++;
 
-	ret = do_connect(fd, addrinfo, timeout);
-	if (ret < 0) {
-		close(fd);
-		return ret;
+			if (!nb_fds)
+				continue;
+		}
+
+		if (done) {
+			i = nb_fds - 1;
+		} else {
+			wait = next < nb ? HAPPY_EYEBALLS_DELAY_MS : timeout;
+
+			if (timeout) {
+				elapsed = (iio_read_counter_us() - start_time) / 1000;
+				if (elapsed >= timeout) {
+					ret = -ETIMEDOUT;
+					break;
+				}
+
+				if (!wait || wait > timeout - elapsed)
+					wait = (unsigned int)(timeout - elapsed);
+			}
+
+			ret = do_select_any(fds, nb_fds, wait);
+			if (ret == -ETIMEDOUT)
+				continue;
+			if (ret < 0)
+				break;
+
+			i = (unsigned int) ret;
+		}
+
+		ret = finish_connect(fds[i]);
+		if (!ret) {
+			fd = fds[i];
+			*idx = ids[i];
+		} else {
+			close(fds[i]);
+		}
+
+		/* Drop the socket from the set */
+		fds[i] = fds[--nb_fds];
+		ids[i] = ids[nb_fds];
 	}
 
-	if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY,
-				(const char *) &yes, sizeof(yes)) < 0) {
-		ret = -errno;
-		close(fd);
-		return ret;
+	for (i = 0; i < nb_fds; i++)
+		close(fds[i]);
+
+	return fd >= 0 ? fd : ret;
+}
+
+int create_socket(const struct addrinfo *addrinfo, unsigned int timeout)
+{
+	unsigned int idx;
+
+	return connect_any(&addrinfo, 1, timeout, &idx);
+}
+
+int create_socket_any(const struct addrinfo *res, unsigned int timeout,
+		      const struct addrinfo **addrinfo)
+{
+	const struct addrinfo *addrs[NETWORK_MAX_ADDRS], *first = res, *other;
+	unsigned int nb = 0, idx;
+	int fd;
+
+	/* Interleave the address families, starting with the one preferred
+	 * by getaddrinfo(), as recommended by RFC 8305. */
+	for (other = res; other && other->ai_family == res->ai_family; )
+		other = other->ai_next;
+
+	while ((first || other) && nb < ARRAY_SIZE(addrs)) {
+		if (first) {
+			addrs[nb++] = first;
+			do {
+				first = first->ai_next;
+			} while (first && first->ai_family != res->ai_family);
+		}
+
+		if (other && nb < ARRAY_SIZE(addrs)) {
+			addrs[nb++] = other;
+			do {
+				other = other->ai_next;
+			} while (other && other->ai_family == res->ai_family);
+		}
 	}
 
+	fd = connect_any(addrs, nb, timeout, &idx);
+	if (fd >= 0)
+		*addrinfo = addrs[idx];
+
 	return fd;
 }
 
-static char * network_get_description(struct addrinfo *res,
+static char * network_get_description(const struct addrinfo *res,
 				      const struct iio_context_params *params)
 {
 	char *description;
@@ -320,7 +434,7 @@ network_setup_iiod_client(const struct iio_device *dev,
 	 * Use the timeout that was set when creating the context.
 	 * See commit 9eff490 for more info.
 	 */
-	ret = create_socket(pdata->addrinfo, NETWORK_TIMEOUT_MS);
+	ret = create_socket(pdata->conn_addrinfo, NETWORK_TIMEOUT_MS);
 	if (ret < 0) {
 		dev_perror(dev, ret, "Unable to create socket");
 		return iio_ptr(ret);
@@ -334,8 +448,9 @@ network_setup_iiod_client(const struct iio_device *dev,
 		goto err_close_socket;
 	}
 
-	client = iiod_client_new(pdata->io_ctx.params, io_ctx,
-				 &network_iiod_client_ops);
+	client = iiod_client_new_flags(pdata->io_ctx.params, io_ctx,
+				       &network_iiod_client_ops,
+				       IIOD_CLIENT_READ_PARTIAL);
 	ret = iio_err(client);
 	if (ret < 0) {
 		dev_perror(dev, ret, "Unable to create IIOD client");
@@ -497,6 +612,20 @@ struct iio_block_pdata * network_create_block(struct iio_buffer_pdata *pdata,
 	return iiod_client_create_block(pdata->pdata, size, data);
 }
 
+static struct iio_block_pdata *
+network_create_block_from_memory(struct iio_buffer_pdata *pdata,
+				 void *ptr, size_t size)
+{
+	return iiod_client_create_block_from_memory(pdata->pdata, ptr, size);
+}
+
+static void
+network_set_block_allocator(struct iio_buffer_pdata *pdata,
+			    struct iio_block_allocator *alloc)
+{
+	iiod_client_set_block_allocator(pdata->pdata, alloc);
+}
+
 static struct iio_event_stream_pdata *
 network_open_events_fd(const struct iio_device *dev)
 {
@@ -526,12 +655,16 @@ static const struct iio_backend_ops network_ops = {
 
 	.create_block = network_create_block,
 	.free_block = iiod_client_free_block,
+	.set_block_allocator = network_set_block_allocator,
+	.create_block_from_memory = network_create_block_from_memory,
 	.enqueue_block = iiod_client_enqueue_block,
 	.dequeue_block = iiod_client_dequeue_block,
 
 	.open_ev = network_open_events_fd,
 	.close_ev = iiod_client_close_event_stream,
 	.read_ev = iiod_client_read_event,
+	.read_ev_many = iiod_client_read_events,
+	.get_ev_overflows = iiod_client_get_event_overflows,
 };
 
 __api_export_if(WITH_NETWORK_BACKEND_DYNAMIC)
@@ -560,6 +693,7 @@ static struct iio_context * network_create_context(const struct iio_context_para
 						   const char *hostname)
 {
 	struct addrinfo hints, *res;
+	const struct addrinfo *addrinfo;
 	struct iio_context *ctx;
 	struct iiod_client *iiod_client;
 	struct iio_context_pdata *pdata;
@@ -704,7 +838,7 @@ static struct iio_context * network_create_context(const struct iio_context_para
 		return iio_ptr(ret);
 	}
 
-	fd = create_socket(res, params->timeout_ms);
+	fd = create_socket_any(res, params->timeout_ms, &addrinfo);
 	if (fd < 0) {
 		ret = fd;
 		goto err_free_addrinfo;
@@ -716,12 +850,13 @@ static struct iio_context * network_create_context(const struct iio_context_para
 		goto err_close_socket;
 	}
 
-	description = network_get_description(res, params);
+	description = network_get_description(addrinfo, params);
 	ret = iio_err(description);
 	if (ret)
 		goto err_free_pdata;
 
 	pdata->addrinfo = res;
+	pdata->conn_addrinfo = addrinfo;
 	pdata->io_ctx.fd = fd;
 	pdata->io_ctx.params = params;
 	pdata->io_ctx.ctx_pdata = pdata;
@@ -730,8 +865,9 @@ static struct iio_context * network_create_context(const struct iio_context_para
 	if (ret)
 		goto err_free_description;
 
-	iiod_client = iiod_client_new(params, &pdata->io_ctx,
-				      &network_iiod_client_ops);
+	iiod_client = iiod_client_new_flags(params, &pdata->io_ctx,
+					    &network_iiod_client_ops,
+					    IIOD_CLIENT_READ_PARTIAL);
 	ret = iio_err(iiod_client);
 	if (ret)
 		goto err_cleanup_cancel;
@@ -14,6 +14,9 @@
 
 #define FQDN_LEN (255)              /* RFC 1035 */
 
+/* Max. number of addresses tried concurrently when connecting */
+#define NETWORK_MAX_ADDRS 16
+
 struct iio_context_params;
 struct iio_context_pdata;
 struct addrinfo;
@@ -36,8 +39,13 @@ int wait_cancellable(struct iiod_client_pdata *io_ctx,
 		     bool read, unsigned int timeout_ms);
 
 int create_socket(const struct addrinfo *addrinfo, unsigned int timeout);
+int create_socket_any(const struct addrinfo *res, unsigned int timeout,
+		      const struct addrinfo **addrinfo);
 int do_create_socket(const struct addrinfo *addrinfo);
-int do_select(int fd, unsigned int timeout);
+
+/* Wait until one of the sockets is connected or failed to connect, and
+ * return its index. A timeout of 0 means no timeout. */
+int do_select_any(const int *fds, unsigned int nb, unsigned int timeout);
 
 int set_blocking_mode(int s, bool blocking);
 
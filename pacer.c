@@ -0,0 +1,93 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2024 Analog Devices, Inc.
+ */
+
+#include "iio-private.h"
+
+#include <errno.h>
+#include <iio/iio-backend.h>
+#include <iio/iio-lock.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+/* Used by the backends that emulate the timing of the hardware: the transfers
+ * wait until their samples are due, unless the buffer is cancelled. */
+struct iio_pacer {
+	struct iio_mutex *lock;
+	struct iio_cond *cond;
+	bool cancelled;
+};
+
+struct iio_pacer * iio_pacer_create(void)
+{
+	struct iio_pacer *pacer;
+	int err;
+
+	pacer = zalloc(sizeof(*pacer));
+	if (!pacer)
+		return iio_ptr(-ENOMEM);
+
+	pacer->lock = iio_mutex_create();
+	err = iio_err(pacer->lock);
+	if (err)
+		goto err_free_pacer;
+
+	pacer->cond = iio_cond_create();
+	err = iio_err(pacer->cond);
+	if (err)
+		goto err_destroy_lock;
+
+	return pacer;
+
+err_destroy_lock:
+	iio_mutex_destroy(pacer->lock);
+err_free_pacer:
+	free(pacer);
+	return iio_ptr(err);
+}
+
+void iio_pacer_destroy(struct iio_pacer *pacer)
+{
+	iio_cond_destroy(pacer->cond);
+	iio_mutex_destroy(pacer->lock);
+	free(pacer);
+}
+
+void iio_pacer_cancel(struct iio_pacer *pacer)
+{
+	iio_mutex_lock(pacer->lock);
+	pacer->cancelled = true;
+	iio_cond_signal(pacer->cond);
+	iio_mutex_unlock(pacer->lock);
+}
+
+/* Wait until the given time, in microseconds of iio_read_counter_us(). A
+ * deadline in the past only checks for cancellation. */
+int iio_pacer_wait(struct iio_pacer *pacer, uint64_t deadline)
+{
+	uint64_t now;
+	int ret = 0;
+
+	iio_mutex_lock(pacer->lock);
+
+	for (;;) {
+		if (pacer->cancelled) {
+			ret = -EBADF;
+			break;
+		}
+
+		now = iio_read_counter_us();
+		if (now >= deadline)
+			break;
+
+		iio_cond_wait(pacer->cond, pacer->lock,
+			      (unsigned int) ((deadline - now + 999) / 1000));
+	}
+
+	iio_mutex_unlock(pacer->lock);
+
+	return ret;
+}
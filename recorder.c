@@ -0,0 +1,853 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2024 Analog Devices, Inc.
+ */
+
+/* For O_DIRECT */
+#define _GNU_SOURCE
+
+#include "iio-config.h"
+#include "iio-private.h"
+
+#include <errno.h>
+#include <iio/iio-debug.h>
+#include <iio/iio-lock.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+
+struct iio_recorder *
+iio_buffer_create_recorder(struct iio_buffer *buf, size_t nb_blocks,
+			   size_t samples_count,
+			   const struct iio_recorder_params *params)
+{
+	return iio_ptr(-ENOSYS);
+}
+
+void iio_recorder_destroy(struct iio_recorder *rec)
+{
+}
+
+int iio_recorder_get_stats(const struct iio_recorder *rec,
+			   struct iio_recorder_stats *stats)
+{
+	return -ENOSYS;
+}
+
+#else /* _WIN32 */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+/* O_DIRECT transfers must be aligned to the logical block size of the
+ * device; 4 KiB covers both 512-byte and 4 KiB sector drives. */
+#define IIO_RECORDER_ALIGN		4096
+#define IIO_RECORDER_CHUNK_SIZE		(4 * 1024 * 1024)
+
+#define SIGMF_DATA_EXT			".sigmf-data"
+#define SIGMF_META_EXT			".sigmf-meta"
+
+/* Start of a segment of contiguous samples: its position in the recorded
+ * data, in bytes, and the index of its first sample in the acquisition,
+ * dropped samples included. */
+struct iio_recorder_capture {
+	uint64_t pos, index;
+};
+
+struct iio_recorder {
+	struct iio_buffer *buf;
+	struct iio_stream *stream;
+	size_t sample_size;
+	uint64_t bytes_left;
+
+	char *stem;
+	const char *ext;
+	double sample_rate;
+	unsigned int flags;
+	uint64_t file_size;
+
+	/* The capture thread fills the chunks in turn; the writer thread
+	 * writes them to disk in the same order. */
+	char *chunks[2];
+	size_t chunk_size, chunk_len[2];
+	bool chunk_full[2];
+	unsigned int cur, next_write;
+	size_t fill;
+
+	/* Only used by the capture thread */
+	uint64_t nb_samples, pushed;
+	bool dropped;
+
+	/* Only used by the writer thread */
+	int fd;
+	bool direct;
+	uint64_t file_bytes, file_start;
+	char *meta_path;
+
+	struct iio_thrd *capture_thrd, *writer_thrd;
+
+	/* Protects the fields below */
+	struct iio_mutex *lock;
+	struct iio_cond *cond;
+	bool stop, capture_done;
+	struct iio_recorder_stats stats;
+	uint64_t start_time, end_time;
+	int err;
+
+	/* SigMF capture segments, in order */
+	struct iio_recorder_capture *captures;
+	size_t nb_captures, captures_size;
+};
+
+static uint64_t round_up(uint64_t size, uint64_t align)
+{
+	return (size + align - 1) / align * align;
+}
+
+static size_t lcm(size_t a, size_t b)
+{
+	size_t x = a, y = b, tmp;
+
+	while (y) {
+		tmp = x % y;
+		x = y;
+		y = tmp;
+	}
+
+	return a / x * b;
+}
+
+static void iio_recorder_print_str(FILE *f, const char *str)
+{
+	fputc('"', f);
+
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			fputc('\\', f);
+		if ((unsigned char) *str >= 0x20)
+			fputc(*str, f);
+	}
+
+	fputc('"', f);
+}
+
+/* JSON needs a dot as the decimal separator, whatever the locale */
+static void iio_recorder_print_double(FILE *f, double val)
+{
+	char buf[64], *ptr;
+
+	iio_snprintf(buf, sizeof(buf), "%.17g", val);
+
+	for (ptr = buf; *ptr; ptr++)
+		if (*ptr == ',')
+			*ptr = '.';
+
+	fputs(buf, f);
+}
+
+/* Returns the SigMF datatype of the samples, if all the channels share the
+ * same format, and it is one that SigMF can describe. */
+static bool iio_recorder_get_datatype(const struct iio_recorder *rec,
+				      char *buf, size_t len)
+{
+	const struct iio_device *dev = rec->buf->dev;
+	const struct iio_data_format *fmt, *first = NULL;
+	const struct iio_channel *chn;
+	unsigned int i;
+
+	for (i = 0; i < dev->nb_channels; i++) {
+		chn = dev->channels[i];
+		if (!iio_channel_is_enabled(chn, rec->buf->mask))
+			continue;
+
+		fmt = iio_channel_get_data_format(chn);
+		if (!first)
+			first = fmt;
+
+		if (fmt->repeat > 1 || fmt->length != first->length
+		    || fmt->is_signed != first->is_signed
+		    || fmt->is_be != first->is_be)
+			return false;
+	}
+
+	if (!first || (first->length != 8 && first->length != 16
+		       && first->length != 32 && first->length != 64))
+		return false;
+
+	iio_snprintf(buf, len, "r%c%u%s", first->is_signed ? 'i' : 'u',
+		     first->length, first->length == 8 ? ""
+		     : first->is_be ? "_be" : "_le");
+
+	return true;
+}
+
+static int
+iio_recorder_write_metadata(const struct iio_recorder *rec, const char *path,
+			    const struct iio_recorder_capture *captures,
+			    size_t nb_captures)
+{
+	const struct iio_device *dev = rec->buf->dev;
+	const struct iio_data_format *fmt;
+	const struct iio_channel *chn;
+	unsigned int i, nb = 0;
+	char datatype[16];
+	const char *name;
+	bool first = true;
+	FILE *f;
+	int ret;
+
+	f = fopen(path, "w");
+	if (!f)
+		return -errno;
+
+	for (i = 0; i < dev->nb_channels; i++)
+		nb += iio_channel_is_enabled(dev->channels[i], rec->buf->mask);
+
+	fputs("{\n\t\"global\": {\n", f);
+
+	if (iio_recorder_get_datatype(rec, datatype, sizeof(datatype)))
+		fprintf(f, "\t\t\"core:datatype\": \"%s\",\n", datatype);
+	else
+		dev_warn(dev, "Samples cannot be described as a SigMF datatype\n");
+
+	if (rec->sample_rate > 0.0) {
+		fputs("\t\t\"core:sample_rate\": ", f);
+		iio_recorder_print_double(f, rec->sample_rate);
+		fputs(",\n", f);
+	}
+
+	fprintf(f, "\t\t\"core:num_channels\": %u,\n", nb);
+	fputs("\t\t\"core:version\": \"1.0.0\",\n", f);
+	fputs("\t\t\"core:recorder\": \"libiio " LIBIIO_VERSION_GIT "\",\n", f);
+
+	name = iio_device_get_name(dev);
+	fputs("\t\t\"core:hw\": ", f);
+	iio_recorder_print_str(f, name ? name : iio_device_get_id(dev));
+
+	fputs(",\n\t\t\"core:extensions\": [ { \"name\": \"iio\", "
+	      "\"version\": \"1.0.0\", \"optional\": true } ],\n", f);
+	fputs("\t\t\"iio:channels\": [", f);
+
+	for (i = 0; i < dev->nb_channels; i++) {
+		chn = dev->channels[i];
+		if (!iio_channel_is_enabled(chn, rec->buf->mask))
+			continue;
+
+		fmt = iio_channel_get_data_format(chn);
+
+		fputs(first ? "\n\t\t\t{ \"id\": " : ",\n\t\t\t{ \"id\": ", f);
+		iio_recorder_print_str(f, iio_channel_get_id(chn));
+		/* Same format as the "format" attribute of the XML */
+		fprintf(f, ", \"format\": \"%ce:%c%u/%u",
+			fmt->is_be ? 'b' : 'l',
+			fmt->is_signed ? (fmt->is_fully_defined ? 'S' : 's')
+				       : (fmt->is_fully_defined ? 'U' : 'u'),
+			fmt->bits, fmt->length);
+		if (fmt->repeat > 1)
+			fprintf(f, "X%u", fmt->repeat);
+		fprintf(f, ">>%u\"", fmt->shift);
+
+		if (fmt->with_scale) {
+			fputs(", \"scale\": ", f);
+			iio_recorder_print_double(f, fmt->scale);
+		}
+
+		fputs(", \"offset\": ", f);
+		iio_recorder_print_double(f, fmt->offset);
+		fputs(" }", f);
+
+		first = false;
+	}
+
+	fputs("\n\t\t]\n\t},\n\t\"captures\": [", f);
+
+	for (i = 0; i < nb_captures; i++) {
+		fprintf(f, "%s\n\t\t{ \"core:sample_start\": %llu, "
+			"\"core:global_index\": %llu }", i ? "," : "",
+			(unsigned long long) (captures[i].pos / rec->sample_size),
+			(unsigned long long) captures[i].index);
+	}
+
+	fputs("\n\t],\n\t\"annotations\": []\n}\n", f);
+
+	ret = ferror(f) ? -EIO : 0;
+	if (fclose(f) && !ret)
+		ret = -errno;
+
+	return ret;
+}
+
+static int iio_recorder_open_file(struct iio_recorder *rec, const char *path)
+{
+	int flags = O_WRONLY | O_CREAT | O_TRUNC;
+
+	rec->direct = false;
+
+#ifdef O_DIRECT
+	if (rec->flags & IIO_RECORDER_DIRECT_IO) {
+		rec->fd = open(path, flags | O_DIRECT, 0666);
+		if (rec->fd >= 0) {
+			rec->direct = true;
+			return 0;
+		}
+
+		if (errno != EINVAL)
+			return -errno;
+
+		dev_dbg(rec->buf->dev,
+			"O_DIRECT not supported for %s, using regular I/O\n",
+			path);
+	}
+#endif
+
+	rec->fd = open(path, flags, 0666);
+	if (rec->fd < 0)
+		return -errno;
+
+	return 0;
+}
+
+/* Close the current data file, and write its metadata: the segment the file
+ * starts in, then each segment starting within it. */
+static int iio_recorder_close_file(struct iio_recorder *rec)
+{
+	uint64_t end = rec->file_start + rec->file_bytes;
+	struct iio_recorder_capture *captures = NULL;
+	size_t i, first, nb = 0;
+	int err = 0;
+
+	if (rec->fd < 0)
+		return 0;
+
+	close(rec->fd);
+	rec->fd = -1;
+
+	if (!rec->meta_path)
+		goto out_next_file;
+
+	iio_mutex_lock(rec->lock);
+
+	if (rec->nb_captures) {
+		for (first = 0; first + 1 < rec->nb_captures
+		     && rec->captures[first + 1].pos <= rec->file_start; first++);
+
+		for (nb = 1; first + nb < rec->nb_captures
+		     && rec->captures[first + nb].pos < end; nb++);
+
+		captures = malloc(nb * sizeof(*captures));
+		if (captures) {
+			memcpy(captures, &rec->captures[first],
+			       nb * sizeof(*captures));
+		}
+
+		/* The next file starts in the last segment of this one, or
+		 * in the one starting right where this file ends. */
+		first += nb - 1;
+		if (first + 1 < rec->nb_captures
+		    && rec->captures[first + 1].pos == end)
+			first++;
+
+		rec->nb_captures -= first;
+		memmove(rec->captures, &rec->captures[first],
+			rec->nb_captures * sizeof(*captures));
+	}
+
+	iio_mutex_unlock(rec->lock);
+
+	if (!captures) {
+		err = -ENOMEM;
+		goto out_free_path;
+	}
+
+	captures[0].index += (rec->file_start - captures[0].pos)
+		/ rec->sample_size;
+	captures[0].pos = rec->file_start;
+
+	for (i = 0; i < nb; i++)
+		captures[i].pos -= rec->file_start;
+
+	err = iio_recorder_write_metadata(rec, rec->meta_path, captures, nb);
+	if (err) {
+		dev_perror(rec->buf->dev, err, "Unable to write %s",
+			   rec->meta_path);
+	}
+
+	free(captures);
+out_free_path:
+	free(rec->meta_path);
+	rec->meta_path = NULL;
+out_next_file:
+	rec->file_start = end;
+	return err;
+}
+
+static int iio_recorder_next_file(struct iio_recorder *rec)
+{
+	size_t len = strlen(rec->stem) + sizeof("-4294967295" SIGMF_DATA_EXT);
+	unsigned int idx = rec->stats.files;
+	char *path;
+	int err;
+
+	err = iio_recorder_close_file(rec);
+	if (err)
+		return err;
+
+	path = malloc(len);
+	if (!path)
+		return -ENOMEM;
+
+	if (rec->file_size)
+		iio_snprintf(path, len, "%s-%04u%s", rec->stem, idx, rec->ext);
+	else
+		iio_snprintf(path, len, "%s%s", rec->stem, rec->ext);
+
+	err = iio_recorder_open_file(rec, path);
+	if (err) {
+		dev_perror(rec->buf->dev, err, "Unable to create %s", path);
+		goto out_free_path;
+	}
+
+	/* The metadata is written once the file is complete, as the capture
+	 * segments it holds are only known then. */
+	if (rec->flags & IIO_RECORDER_SIGMF) {
+		if (rec->file_size)
+			iio_snprintf(path, len, "%s-%04u" SIGMF_META_EXT,
+				     rec->stem, idx);
+		else
+			iio_snprintf(path, len, "%s" SIGMF_META_EXT, rec->stem);
+
+		rec->meta_path = path;
+		path = NULL;
+	}
+
+	rec->file_bytes = 0;
+
+	iio_mutex_lock(rec->lock);
+	rec->stats.files++;
+	iio_mutex_unlock(rec->lock);
+
+out_free_path:
+	free(path);
+	return err;
+}
+
+static int iio_recorder_write_chunk(struct iio_recorder *rec,
+				    char *data, size_t len)
+{
+	size_t left = len;
+	ssize_t ret;
+	int err;
+
+	if (rec->fd < 0 || (rec->file_size && rec->file_bytes >= rec->file_size)) {
+		err = iio_recorder_next_file(rec);
+		if (err)
+			return err;
+	}
+
+	/* Only the last chunk can be partial. Pad it to please O_DIRECT,
+	 * then cut the file back to its actual size. */
+	if (rec->direct) {
+		left = round_up(len, IIO_RECORDER_ALIGN);
+		memset(data + len, 0, left - len);
+	}
+
+	while (left) {
+		ret = write(rec->fd, data, left);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		data += ret;
+		left -= (size_t) ret;
+	}
+
+	if (rec->direct && len % IIO_RECORDER_ALIGN
+	    && ftruncate(rec->fd, (off_t) (rec->file_bytes + len)))
+		return -errno;
+
+	rec->file_bytes += len;
+
+	iio_mutex_lock(rec->lock);
+	rec->stats.bytes += len;
+	iio_mutex_unlock(rec->lock);
+
+	return 0;
+}
+
+static int iio_recorder_writer(void *d)
+{
+	struct iio_recorder *rec = d;
+	unsigned int idx;
+	size_t len;
+	int ret, err = 0;
+
+	iio_mutex_lock(rec->lock);
+
+	for (;;) {
+		idx = rec->next_write;
+
+		while (!rec->chunk_full[idx] && !rec->capture_done)
+			iio_cond_wait(rec->cond, rec->lock, 0);
+
+		if (!rec->chunk_full[idx])
+			break;
+
+		len = rec->chunk_len[idx];
+		iio_mutex_unlock(rec->lock);
+
+		err = iio_recorder_write_chunk(rec, rec->chunks[idx], len);
+
+		iio_mutex_lock(rec->lock);
+		if (err)
+			break;
+
+		rec->chunk_full[idx] = false;
+		rec->next_write ^= 1;
+	}
+
+	iio_mutex_unlock(rec->lock);
+
+	ret = iio_recorder_close_file(rec);
+	if (!err)
+		err = ret;
+
+	iio_mutex_lock(rec->lock);
+
+	if (err) {
+		if (!rec->err)
+			rec->err = err;
+	} else if (!rec->stop && !rec->err) {
+		/* The requested number of samples was written */
+		rec->stats.done = true;
+	}
+
+	rec->end_time = iio_read_counter_us();
+	iio_cond_signal(rec->cond);
+	iio_mutex_unlock(rec->lock);
+
+	return err;
+}
+
+static void iio_recorder_submit(struct iio_recorder *rec)
+{
+	iio_mutex_lock(rec->lock);
+	rec->chunk_len[rec->cur] = rec->fill;
+	rec->chunk_full[rec->cur] = true;
+	iio_cond_signal(rec->cond);
+	iio_mutex_unlock(rec->lock);
+
+	rec->cur ^= 1;
+	rec->fill = 0;
+}
+
+/* Start a new capture segment with the next samples. The lock must be
+ * held. */
+static int iio_recorder_add_capture(struct iio_recorder *rec)
+{
+	struct iio_recorder_capture *captures;
+	size_t size;
+
+	if (rec->nb_captures == rec->captures_size) {
+		size = rec->captures_size ? rec->captures_size * 2 : 8;
+		captures = realloc(rec->captures, size * sizeof(*captures));
+		if (!captures)
+			return -ENOMEM;
+
+		rec->captures = captures;
+		rec->captures_size = size;
+	}
+
+	rec->captures[rec->nb_captures].pos = rec->pushed;
+	rec->captures[rec->nb_captures].index = rec->nb_samples;
+	rec->nb_captures++;
+
+	return 0;
+}
+
+/* Copy the samples to the chunks. The block is dropped if the writer did
+ * not release enough room for it yet; the samples that follow then start a
+ * new capture segment. */
+static int iio_recorder_push(struct iio_recorder *rec,
+			     const char *src, size_t len)
+{
+	bool drop;
+	size_t space, nb;
+	int err;
+
+	iio_mutex_lock(rec->lock);
+
+	err = rec->err;
+	space = rec->chunk_full[rec->cur] ? 0 : rec->chunk_size - rec->fill;
+	if (space && len > space && !rec->chunk_full[rec->cur ^ 1])
+		space += rec->chunk_size;
+
+	drop = len > space;
+
+	if (!err && !drop && (rec->flags & IIO_RECORDER_SIGMF)
+	    && (rec->dropped || !rec->nb_captures))
+		err = iio_recorder_add_capture(rec);
+
+	if (!err && drop)
+		rec->stats.drops++;
+	else if (!err)
+		rec->stats.blocks++;
+
+	iio_mutex_unlock(rec->lock);
+
+	if (err)
+		return err;
+
+	rec->nb_samples += len / rec->sample_size;
+	rec->dropped = drop;
+
+	if (drop)
+		return 0;
+
+	rec->pushed += len;
+
+	while (len) {
+		nb = rec->chunk_size - rec->fill;
+		if (nb > len)
+			nb = len;
+
+		memcpy(rec->chunks[rec->cur] + rec->fill, src, nb);
+		rec->fill += nb;
+		src += nb;
+		len -= nb;
+
+		if (rec->fill == rec->chunk_size)
+			iio_recorder_submit(rec);
+	}
+
+	return 0;
+}
+
+static int iio_recorder_capture(void *d)
+{
+	struct iio_recorder *rec = d;
+	const struct iio_block *block;
+	size_t len;
+	int err = 0;
+
+	while (rec->bytes_left) {
+		block = iio_stream_get_next_block(rec->stream);
+		err = iio_err(block);
+		if (err)
+			break;
+
+		len = (uintptr_t) iio_block_end(block)
+			- (uintptr_t) iio_block_start(block);
+		if (len > rec->bytes_left)
+			len = (size_t) rec->bytes_left;
+
+		err = iio_recorder_push(rec, iio_block_start(block), len);
+		if (err)
+			break;
+
+		if (rec->bytes_left != UINT64_MAX)
+			rec->bytes_left -= len;
+	}
+
+	if (rec->fill)
+		iio_recorder_submit(rec);
+
+	iio_mutex_lock(rec->lock);
+
+	/* Errors caused by iio_recorder_destroy() cancelling the buffer are
+	 * not reported. */
+	if (err && !rec->stop && !rec->err)
+		rec->err = err;
+
+	rec->capture_done = true;
+	iio_cond_signal(rec->cond);
+	iio_mutex_unlock(rec->lock);
+
+	return err;
+}
+
+static int iio_recorder_set_path(struct iio_recorder *rec, const char *path)
+{
+	size_t len = strlen(path), ext_len = sizeof(SIGMF_DATA_EXT) - 1;
+
+	rec->stem = iio_strdup(path);
+	if (!rec->stem)
+		return -ENOMEM;
+
+	/* Keep the SigMF extension at the end of the rotated files' names */
+	if (len > ext_len && !strcmp(path + len - ext_len, SIGMF_DATA_EXT)) {
+		rec->stem[len - ext_len] = '\0';
+		rec->ext = SIGMF_DATA_EXT;
+	} else {
+		rec->ext = "";
+	}
+
+	return 0;
+}
+
+struct iio_recorder *
+iio_buffer_create_recorder(struct iio_buffer *buf, size_t nb_blocks,
+			   size_t samples_count,
+			   const struct iio_recorder_params *params)
+{
+	const struct iio_attr *attr;
+	struct iio_recorder *rec;
+	size_t block_size;
+	unsigned int i;
+	int err;
+
+	if (!nb_blocks || !samples_count || !params || !params->path
+	    || iio_device_is_tx(buf->dev))
+		return iio_ptr(-EINVAL);
+
+	rec = zalloc(sizeof(*rec));
+	if (!rec)
+		return iio_ptr(-ENOMEM);
+
+	rec->buf = buf;
+	rec->fd = -1;
+	rec->flags = params->flags;
+	rec->sample_rate = params->sample_rate;
+	rec->sample_size = iio_device_get_sample_size(buf->dev, buf->mask);
+	if (!rec->sample_size) {
+		err = -EINVAL;
+		goto err_free_rec;
+	}
+
+	if (params->samples && params->samples < UINT64_MAX / rec->sample_size)
+		rec->bytes_left = params->samples * rec->sample_size;
+	else
+		rec->bytes_left = UINT64_MAX;
+
+	if (rec->sample_rate <= 0.0 && (rec->flags & IIO_RECORDER_SIGMF)) {
+		attr = iio_device_find_attr(buf->dev, "sampling_frequency");
+		if (!attr || iio_attr_read_double(attr, &rec->sample_rate) < 0)
+			dev_warn(buf->dev, "Unable to read the sample rate\n");
+	}
+
+	err = iio_recorder_set_path(rec, params->path);
+	if (err)
+		goto err_free_rec;
+
+	/* Write in large chunks, each holding at least one block. Chunks hold
+	 * a whole number of samples, so that rotated files never start in
+	 * the middle of one. */
+	block_size = samples_count * rec->sample_size;
+	rec->chunk_size = round_up(block_size > IIO_RECORDER_CHUNK_SIZE
+				   ? block_size : IIO_RECORDER_CHUNK_SIZE,
+				   lcm(rec->sample_size, IIO_RECORDER_ALIGN));
+
+	if (params->file_size)
+		rec->file_size = round_up(params->file_size, rec->chunk_size);
+
+	for (i = 0; i < 2; i++) {
+		err = -posix_memalign((void **) &rec->chunks[i],
+				      IIO_RECORDER_ALIGN, rec->chunk_size);
+		if (err) {
+			rec->chunks[i] = NULL;
+			goto err_free_chunks;
+		}
+	}
+
+	rec->lock = iio_mutex_create();
+	err = iio_err(rec->lock);
+	if (err)
+		goto err_free_chunks;
+
+	rec->cond = iio_cond_create();
+	err = iio_err(rec->cond);
+	if (err)
+		goto err_destroy_lock;
+
+	rec->stream = iio_buffer_create_stream(buf, nb_blocks, samples_count);
+	err = iio_err(rec->stream);
+	if (err)
+		goto err_destroy_cond;
+
+	rec->start_time = iio_read_counter_us();
+
+	rec->writer_thrd = iio_thrd_create(iio_recorder_writer, rec,
+					   "iio-recorder-writer");
+	err = iio_err(rec->writer_thrd);
+	if (err)
+		goto err_destroy_stream;
+
+	rec->capture_thrd = iio_thrd_create(iio_recorder_capture, rec,
+					    "iio-recorder");
+	err = iio_err(rec->capture_thrd);
+	if (err)
+		goto err_stop_writer;
+
+	return rec;
+
+err_stop_writer:
+	iio_mutex_lock(rec->lock);
+	rec->stop = true;
+	rec->capture_done = true;
+	iio_cond_signal(rec->cond);
+	iio_mutex_unlock(rec->lock);
+	iio_thrd_join_and_destroy(rec->writer_thrd);
+err_destroy_stream:
+	iio_stream_destroy(rec->stream);
+err_destroy_cond:
+	iio_cond_destroy(rec->cond);
+err_destroy_lock:
+	iio_mutex_destroy(rec->lock);
+err_free_chunks:
+	free(rec->chunks[0]);
+	free(rec->chunks[1]);
+	free(rec->stem);
+err_free_rec:
+	free(rec);
+	return iio_ptr(err);
+}
+
+void iio_recorder_destroy(struct iio_recorder *rec)
+{
+	iio_mutex_lock(rec->lock);
+	rec->stop = true;
+	iio_mutex_unlock(rec->lock);
+
+	/* Abort the pending transfer, so that the capture thread returns.
+	 * The writer thread then writes what is left, and returns too. */
+	iio_buffer_cancel(rec->buf);
+	iio_thrd_join_and_destroy(rec->capture_thrd);
+	iio_thrd_join_and_destroy(rec->writer_thrd);
+
+	iio_stream_destroy(rec->stream);
+	iio_cond_destroy(rec->cond);
+	iio_mutex_destroy(rec->lock);
+	free(rec->chunks[0]);
+	free(rec->chunks[1]);
+	free(rec->captures);
+	free(rec->stem);
+	free(rec);
+}
+
+int iio_recorder_get_stats(const struct iio_recorder *rec,
+			   struct iio_recorder_stats *stats)
+{
+	uint64_t end_time;
+	int err;
+
+	iio_mutex_lock(rec->lock);
+	*stats = rec->stats;
+	end_time = rec->end_time;
+	err = rec->err;
+	iio_mutex_unlock(rec->lock);
+
+	if (!end_time)
+		end_time = iio_read_counter_us();
+
+	stats->elapsed_us = end_time - rec->start_time;
+
+	return err;
+}
+
+#endif /* _WIN32 */
@@ -0,0 +1,383 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2024 Analog Devices, Inc.
+ */
+
+#include "iio-private.h"
+
+#include <errno.h>
+#include <iio/iio-debug.h>
+#include <iio/iio-lock.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct iio_relay {
+	struct iio_buffer *src, *dst;
+	struct iio_block **rx_blocks, **tx_blocks;
+	size_t nb_blocks;
+	bool zero_copy, dst_enabled;
+
+	ssize_t (*transform)(const struct iio_block *src,
+			     struct iio_block *dst, void *d);
+	void *d;
+
+	struct iio_thrd *thrd;
+
+	/* Protects the fields below */
+	struct iio_mutex *lock;
+	struct iio_relay_stats stats;
+	uint64_t start_time;
+	int err;
+};
+
+/* Blocking dequeue, which keeps waiting when the context's timeout expires.
+ * It only fails on error, or once the buffer has been cancelled. */
+static int iio_relay_dequeue(struct iio_block *block)
+{
+	int ret;
+
+	do {
+		ret = iio_block_dequeue(block, false);
+	} while (ret == -ETIMEDOUT);
+
+	return ret;
+}
+
+static int iio_relay_send(struct iio_relay *relay,
+			  struct iio_block *block, size_t bytes_used)
+{
+	int err;
+
+	err = iio_block_enqueue(block, bytes_used, false);
+	if (err)
+		return err;
+
+	if (!relay->dst_enabled) {
+		err = iio_buffer_enable(relay->dst);
+		if (err)
+			return err;
+
+		relay->dst_enabled = true;
+	}
+
+	iio_mutex_lock(relay->lock);
+	relay->stats.blocks++;
+	relay->stats.bytes += bytes_used;
+	iio_mutex_unlock(relay->lock);
+
+	return 0;
+}
+
+/* Each source block shares its DMABUF with one sink block. A block goes from
+ * the source to the sink and back, in the same order on both sides. */
+static int iio_relay_run_zero_copy(struct iio_relay *relay)
+{
+	size_t rx_next = 0, tx_next = 0, in_tx = 0, nb = relay->nb_blocks;
+	struct iio_block *rx_block;
+	size_t size;
+	int err;
+
+	for (;;) {
+		/* Give the blocks sent by the sink back to the source. Only
+		 * wait for the sink if the source has no block left. */
+		while (in_tx) {
+			if (in_tx < nb)
+				err = iio_block_dequeue(relay->tx_blocks[tx_next], true);
+			else
+				err = iio_relay_dequeue(relay->tx_blocks[tx_next]);
+			if (err == -EBUSY)
+				break;
+			if (err)
+				return err;
+
+			err = iio_block_enqueue(relay->rx_blocks[tx_next], 0, false);
+			if (err)
+				return err;
+
+			tx_next = (tx_next + 1) % nb;
+			in_tx--;
+		}
+
+		rx_block = relay->rx_blocks[rx_next];
+
+		err = iio_relay_dequeue(rx_block);
+		if (err)
+			return err;
+
+		size = (uintptr_t) iio_block_end(rx_block)
+			- (uintptr_t) iio_block_start(rx_block);
+
+		err = iio_relay_send(relay, relay->tx_blocks[rx_next], size);
+		if (err)
+			return err;
+
+		rx_next = (rx_next + 1) % nb;
+		in_tx++;
+	}
+}
+
+/* The source and sink have their own blocks. The source is never stalled:
+ * when the sink has no free block, the samples are dropped instead. */
+static int iio_relay_run_copy(struct iio_relay *relay)
+{
+	size_t rx_next = 0, tx_next = 0, tx_reclaim = 0, nb = relay->nb_blocks;
+	size_t tx_free = nb, size;
+	struct iio_block *rx_block, *tx_block;
+	ssize_t len;
+	int err;
+
+	for (;;) {
+		rx_block = relay->rx_blocks[rx_next];
+
+		err = iio_relay_dequeue(rx_block);
+		if (err)
+			return err;
+
+		while (tx_free < nb) {
+			err = iio_block_dequeue(relay->tx_blocks[tx_reclaim], true);
+			if (err == -EBUSY)
+				break;
+			if (err)
+				return err;
+
+			tx_reclaim = (tx_reclaim + 1) % nb;
+			tx_free++;
+		}
+
+		if (tx_free) {
+			tx_block = relay->tx_blocks[tx_next];
+			size = (uintptr_t) iio_block_end(tx_block)
+				- (uintptr_t) iio_block_start(tx_block);
+
+			if (relay->transform) {
+				len = relay->transform(rx_block, tx_block,
+						       relay->d);
+				if (len < 0)
+					return (int) len;
+				if ((size_t) len > size)
+					return -EINVAL;
+			} else {
+				memcpy(iio_block_start(tx_block),
+				       iio_block_start(rx_block), size);
+				len = (ssize_t) size;
+			}
+
+			if (len) {
+				err = iio_relay_send(relay, tx_block, len);
+				if (err)
+					return err;
+
+				tx_next = (tx_next + 1) % nb;
+				tx_free--;
+			}
+		} else {
+			iio_mutex_lock(relay->lock);
+			relay->stats.drops++;
+			iio_mutex_unlock(relay->lock);
+		}
+
+		err = iio_block_enqueue(rx_block, 0, false);
+		if (err)
+			return err;
+
+		rx_next = (rx_next + 1) % nb;
+	}
+}
+
+static int iio_relay_worker(void *d)
+{
+	struct iio_relay *relay = d;
+	int err;
+
+	if (relay->zero_copy)
+		err = iio_relay_run_zero_copy(relay);
+	else
+		err = iio_relay_run_copy(relay);
+
+	iio_mutex_lock(relay->lock);
+	relay->err = err;
+	iio_mutex_unlock(relay->lock);
+
+	return err;
+}
+
+static void iio_relay_free_blocks(struct iio_block **blocks, size_t nb)
+{
+	size_t i;
+
+	for (i = 0; i < nb; i++)
+		if (blocks[i])
+			iio_block_destroy(blocks[i]);
+}
+
+/* Try to back each sink block with the DMABUF of a source block */
+static bool iio_relay_share_blocks(struct iio_relay *relay, size_t size)
+{
+	size_t i;
+	int fd;
+
+	for (i = 0; i < relay->nb_blocks; i++) {
+		fd = iio_block_get_dmabuf_fd(relay->rx_blocks[i]);
+		if (fd < 0)
+			break;
+
+		relay->tx_blocks[i] = iio_buffer_create_block_from_dmabuf(relay->dst,
+									   fd, size);
+		if (iio_err(relay->tx_blocks[i])) {
+			relay->tx_blocks[i] = NULL;
+			break;
+		}
+	}
+
+	if (i == relay->nb_blocks)
+		return true;
+
+	iio_relay_free_blocks(relay->tx_blocks, i);
+	memset(relay->tx_blocks, 0, i * sizeof(*relay->tx_blocks));
+
+	return false;
+}
+
+struct iio_relay *
+iio_buffer_create_relay(struct iio_buffer *src, struct iio_buffer *dst,
+			size_t nb_blocks, size_t samples_count,
+			ssize_t (*transform)(const struct iio_block *src,
+					     struct iio_block *dst, void *d),
+			void *d)
+{
+	size_t i, rx_sample_size, tx_sample_size;
+	struct iio_relay *relay;
+	int err;
+
+	if (!nb_blocks || !samples_count
+	    || iio_device_is_tx(src->dev) || !iio_device_is_tx(dst->dev))
+		return iio_ptr(-EINVAL);
+
+	rx_sample_size = iio_device_get_sample_size(src->dev, src->mask);
+	tx_sample_size = iio_device_get_sample_size(dst->dev, dst->mask);
+
+	/* Without a transform, samples are moved as they are */
+	if (!transform && rx_sample_size != tx_sample_size)
+		return iio_ptr(-EINVAL);
+
+	relay = zalloc(sizeof(*relay));
+	if (!relay)
+		return iio_ptr(-ENOMEM);
+
+	relay->src = src;
+	relay->dst = dst;
+	relay->nb_blocks = nb_blocks;
+	relay->transform = transform;
+	relay->d = d;
+
+	relay->lock = iio_mutex_create();
+	err = iio_err(relay->lock);
+	if (err)
+		goto err_free_relay;
+
+	relay->rx_blocks = calloc(nb_blocks, sizeof(*relay->rx_blocks));
+	relay->tx_blocks = calloc(nb_blocks, sizeof(*relay->tx_blocks));
+	if (!relay->rx_blocks || !relay->tx_blocks) {
+		err = -ENOMEM;
+		goto err_free_arrays;
+	}
+
+	for (i = 0; i < nb_blocks; i++) {
+		relay->rx_blocks[i] = iio_buffer_create_block(src,
+				samples_count * rx_sample_size);
+		err = iio_err(relay->rx_blocks[i]);
+		if (err) {
+			relay->rx_blocks[i] = NULL;
+			goto err_free_blocks;
+		}
+	}
+
+	if (!transform)
+		relay->zero_copy = iio_relay_share_blocks(relay,
+				samples_count * rx_sample_size);
+
+	for (i = 0; !relay->zero_copy && i < nb_blocks; i++) {
+		relay->tx_blocks[i] = iio_buffer_create_block(dst,
+				samples_count * tx_sample_size);
+		err = iio_err(relay->tx_blocks[i]);
+		if (err) {
+			relay->tx_blocks[i] = NULL;
+			goto err_free_blocks;
+		}
+	}
+
+	relay->stats.zero_copy = relay->zero_copy;
+
+	for (i = 0; i < nb_blocks; i++) {
+		err = iio_block_enqueue(relay->rx_blocks[i], 0, false);
+		if (err) {
+			dev_perror(src->dev, err, "Unable to enqueue block");
+			goto err_free_blocks;
+		}
+	}
+
+	err = iio_buffer_enable(src);
+	if (err) {
+		dev_perror(src->dev, err, "Unable to enable buffer");
+		goto err_free_blocks;
+	}
+
+	relay->start_time = iio_read_counter_us();
+
+	relay->thrd = iio_thrd_create(iio_relay_worker, relay, "iio-relay");
+	err = iio_err(relay->thrd);
+	if (err)
+		goto err_disable_buffer;
+
+	return relay;
+
+err_disable_buffer:
+	iio_buffer_disable(src);
+err_free_blocks:
+	iio_relay_free_blocks(relay->tx_blocks, nb_blocks);
+	iio_relay_free_blocks(relay->rx_blocks, nb_blocks);
+err_free_arrays:
+	free(relay->tx_blocks);
+	free(relay->rx_blocks);
+	iio_mutex_destroy(relay->lock);
+err_free_relay:
+	free(relay);
+	return iio_ptr(err);
+}
+
+void iio_relay_destroy(struct iio_relay *relay)
+{
+	/* Abort any pending transfer, so that the worker returns */
+	iio_buffer_cancel(relay->src);
+	iio_buffer_cancel(relay->dst);
+	iio_thrd_join_and_destroy(relay->thrd);
+
+	iio_buffer_disable(relay->src);
+	if (relay->dst_enabled)
+		iio_buffer_disable(relay->dst);
+
+	iio_relay_free_blocks(relay->tx_blocks, relay->nb_blocks);
+	iio_relay_free_blocks(relay->rx_blocks, relay->nb_blocks);
+	free(relay->tx_blocks);
+	free(relay->rx_blocks);
+	iio_mutex_destroy(relay->lock);
+	free(relay);
+}
+
+int iio_relay_get_stats(const struct iio_relay *relay,
+			struct iio_relay_stats *stats)
+{
+	int err;
+
+	iio_mutex_lock(relay->lock);
+	*stats = relay->stats;
+	err = relay->err;
+	iio_mutex_unlock(relay->lock);
+
+	stats->elapsed_us = iio_read_counter_us() - relay->start_time;
+
+	return err;
+}
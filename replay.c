@@ -0,0 +1,885 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2024 Analog Devices, Inc.
+ */
+
+#include "iio-config.h"
+#include "iio-private.h"
+
+#include <errno.h>
+#include <iio/iio-backend.h>
+#include <iio/iio-debug.h>
+#include <iio/iio-lock.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * A replay directory holds:
+ * - context.xml: the description of the context, as generated by
+ *   iio_context_get_xml() or "iio_genxml -s";
+ * - attributes: optional snapshot of the attributes' values, one per line,
+ *   formatted as "<key> <value>", "\n" and "\\" being escaped in the values.
+ *   Keys are "<dev>/<attr>", "<dev>/debug/<attr>", "<dev>/buffer/<attr>" or
+ *   "<dev>/<in|out>/<channel>/<attr>";
+ * - <dev>.sigmf-data: samples captured from the input device, where <dev> is
+ *   the ID or the name of the device. The optional <dev>.sigmf-meta, written
+ *   by the recorder, gives the list of channels recorded and the sample rate.
+ *   Without it, the file must contain all the channels of the device.
+ */
+#define REPLAY_XML_FILE		"context.xml"
+#define REPLAY_ATTRS_FILE	"attributes"
+#define REPLAY_DATA_EXT		".sigmf-data"
+#define REPLAY_META_EXT		".sigmf-meta"
+
+#define REPLAY_KEY_MAX		512
+
+struct replay_attr {
+	char *key, *value;
+};
+
+struct replay_copy {
+	size_t src, dst, len;
+};
+
+struct iio_context_pdata {
+	char *dir;
+
+	/* Forced sample rate, or use the recorded one if 'realtime' is set */
+	double rate;
+	bool realtime;
+	unsigned int latency_us, jitter_us;
+
+	/* Protects the attributes */
+	struct iio_mutex *lock;
+	struct replay_attr *attrs;
+	size_t nb_attrs;
+};
+
+struct iio_buffer_pdata {
+	const struct iio_device *dev;
+	struct iio_context_pdata *ctx_pdata;
+
+	FILE *f;
+	size_t sample_size, file_sample_size;
+
+	/* Where to copy each channel from the file, when the recorded samples
+	 * do not have the layout of the buffer. */
+	struct replay_copy *copies;
+	unsigned int nb_copies;
+	char *scratch;
+	size_t scratch_size;
+
+	double rate;
+	uint64_t start_us, samples;
+	uint32_t seed;
+
+	struct iio_pacer *pacer;
+};
+
+static int replay_attr_cmp(const void *p1, const void *p2)
+{
+	const struct replay_attr *a1 = p1, *a2 = p2;
+
+	return strcmp(a1->key, a2->key);
+}
+
+static char * replay_read_file(const char *path)
+{
+	size_t len = 0, size = 4096, nb;
+	char *buf, *tmp;
+	FILE *f;
+
+	f = fopen(path, "rb");
+	if (!f)
+		return NULL;
+
+	buf = malloc(size);
+
+	while (buf) {
+		nb = fread(buf + len, 1, size - len - 1, f);
+		len += nb;
+
+		if (len < size - 1)
+			break;
+
+		size *= 2;
+		tmp = realloc(buf, size);
+		if (!tmp) {
+			free(buf);
+			buf = NULL;
+		} else {
+			buf = tmp;
+		}
+	}
+
+	if (buf && ferror(f)) {
+		free(buf);
+		buf = NULL;
+	}
+
+	if (buf)
+		buf[len] = '\0';
+
+	fclose(f);
+
+	return buf;
+}
+
+static void replay_unescape(char *str)
+{
+	char *dst = str;
+
+	for (; *str; str++) {
+		if (*str == '\\' && str[1]) {
+			str++;
+			*dst++ = *str == 'n' ? '\n' : *str;
+		} else {
+			*dst++ = *str;
+		}
+	}
+
+	*dst = '\0';
+}
+
+static int replay_load_attrs(struct iio_context_pdata *pdata,
+			     const struct iio_context_params *params)
+{
+	char path[PATH_MAX], *data, *line, *next, *value;
+	struct replay_attr *attrs;
+	size_t nb = 0, nb_lines = 0;
+	int err = 0;
+
+	iio_snprintf(path, sizeof(path), "%s/" REPLAY_ATTRS_FILE, pdata->dir);
+
+	data = replay_read_file(path);
+	if (!data) {
+		prm_warn(params, "No attributes snapshot in %s\n", pdata->dir);
+		return 0;
+	}
+
+	for (line = data; line; line = strchr(line + 1, '\n'))
+		nb_lines++;
+
+	attrs = calloc(nb_lines, sizeof(*attrs));
+	if (!attrs) {
+		free(data);
+		return -ENOMEM;
+	}
+
+	for (line = data; line; line = next) {
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = '\0';
+
+		value = strchr(line, ' ');
+		if (!value)
+			continue;
+
+		*value++ = '\0';
+		replay_unescape(value);
+
+		attrs[nb].key = iio_strdup(line);
+		attrs[nb].value = iio_strdup(value);
+		if (!attrs[nb].key || !attrs[nb].value) {
+			free(attrs[nb].key);
+			free(attrs[nb].value);
+			err = -ENOMEM;
+			break;
+		}
+
+		nb++;
+	}
+
+	free(data);
+
+	qsort(attrs, nb, sizeof(*attrs), replay_attr_cmp);
+
+	pdata->attrs = attrs;
+	pdata->nb_attrs = nb;
+
+	return err;
+}
+
+static int replay_attr_key(const struct iio_attr *attr, char *buf, size_t len)
+{
+	const struct iio_device *dev = iio_attr_get_device(attr);
+	const char *id = iio_device_get_id(dev);
+	ssize_t ret;
+
+	switch (attr->type) {
+	case IIO_ATTR_TYPE_CHANNEL:
+		ret = iio_snprintf(buf, len, "%s/%s/%s/%s", id,
+				   iio_channel_is_output(attr->iio.chn) ? "out" : "in",
+				   iio_channel_get_id(attr->iio.chn), attr->name);
+		break;
+	case IIO_ATTR_TYPE_DEBUG:
+		ret = iio_snprintf(buf, len, "%s/debug/%s", id, attr->name);
+		break;
+	case IIO_ATTR_TYPE_BUFFER:
+		ret = iio_snprintf(buf, len, "%s/buffer/%s", id, attr->name);
+		break;
+	default:
+		ret = iio_snprintf(buf, len, "%s/%s", id, attr->name);
+		break;
+	}
+
+	if (ret < 0)
+		return (int) ret;
+
+	return (size_t) ret < len ? 0 : -ENAMETOOLONG;
+}
+
+static struct replay_attr *
+replay_find_attr(struct iio_context_pdata *pdata, const char *key)
+{
+	struct replay_attr needle = { .key = (char *) key };
+
+	if (!pdata->nb_attrs)
+		return NULL;
+
+	return bsearch(&needle, pdata->attrs, pdata->nb_attrs,
+		       sizeof(*pdata->attrs), replay_attr_cmp);
+}
+
+static ssize_t replay_read_attr(const struct iio_attr *attr,
+				char *dst, size_t len)
+{
+	const struct iio_device *dev = iio_attr_get_device(attr);
+	struct iio_context_pdata *pdata = iio_context_get_pdata(dev->ctx);
+	struct replay_attr *entry;
+	char key[REPLAY_KEY_MAX];
+	ssize_t ret;
+
+	ret = replay_attr_key(attr, key, sizeof(key));
+	if (ret)
+		return ret;
+
+	iio_mutex_lock(pdata->lock);
+
+	entry = replay_find_attr(pdata, key);
+	if (entry) {
+		iio_strlcpy(dst, entry->value, len);
+		ret = (ssize_t) strlen(dst) + 1;
+	} else {
+		ret = -ENOENT;
+	}
+
+	iio_mutex_unlock(pdata->lock);
+
+	return ret;
+}
+
+/* Written values are kept, so that they can be read back */
+static ssize_t replay_write_attr(const struct iio_attr *attr,
+				 const char *src, size_t len)
+{
+	const struct iio_device *dev = iio_attr_get_device(attr);
+	struct iio_context_pdata *pdata = iio_context_get_pdata(dev->ctx);
+	struct replay_attr *entry, *attrs;
+	char key[REPLAY_KEY_MAX], *value, *key_dup;
+	size_t idx;
+	int err;
+
+	err = replay_attr_key(attr, key, sizeof(key));
+	if (err)
+		return err;
+
+	value = malloc(len + 1);
+	if (!value)
+		return -ENOMEM;
+
+	memcpy(value, src, len);
+	value[len] = '\0';
+
+	iio_mutex_lock(pdata->lock);
+
+	entry = replay_find_attr(pdata, key);
+	if (entry) {
+		free(entry->value);
+		entry->value = value;
+		goto out_unlock;
+	}
+
+	attrs = realloc(pdata->attrs, (pdata->nb_attrs + 1) * sizeof(*attrs));
+	if (attrs)
+		pdata->attrs = attrs;
+
+	key_dup = attrs ? iio_strdup(key) : NULL;
+	if (!key_dup) {
+		free(value);
+		err = -ENOMEM;
+		goto out_unlock;
+	}
+
+	/* Keep the array sorted */
+	for (idx = pdata->nb_attrs; idx; idx--) {
+		if (strcmp(attrs[idx - 1].key, key) < 0)
+			break;
+
+		attrs[idx] = attrs[idx - 1];
+	}
+
+	attrs[idx] = (struct replay_attr){ .key = key_dup, .value = value };
+	pdata->nb_attrs++;
+
+out_unlock:
+	iio_mutex_unlock(pdata->lock);
+
+	return err ? err : (ssize_t) len;
+}
+
+/* Offset of each enabled channel within a sample, following the layout
+ * rules of iio_device_get_sample_size(). Returns the size of a sample. */
+static size_t replay_get_layout(const struct iio_device *dev,
+				const struct iio_channels_mask *mask,
+				size_t *offsets)
+{
+	const struct iio_channel *chn, *prev = NULL;
+	size_t size = 0, length, largest = 1, offset = 0;
+	unsigned int i;
+
+	for (i = 0; i < dev->nb_channels; i++) {
+		chn = dev->channels[i];
+		length = chn->format.length / 8 * chn->format.repeat;
+
+		if (chn->index < 0)
+			break;
+		if (!iio_channels_mask_test_bit(mask, chn->number) || !length)
+			continue;
+
+		if (prev && chn->index == prev->index) {
+			offsets[i] = offset;
+			continue;
+		}
+
+		if (length > largest)
+			largest = length;
+
+		offset = size % length ? size + length - size % length : size;
+		offsets[i] = offset;
+		size = offset + length;
+		prev = chn;
+	}
+
+	if (size % largest)
+		size += largest - (size % largest);
+
+	return size;
+}
+
+/* Channels recorded in the file, from the "iio:channels" list written in the
+ * SigMF metadata by the recorder. */
+static int replay_parse_meta(struct iio_buffer_pdata *pdata, const char *meta,
+			     struct iio_channels_mask *mask)
+{
+	const struct iio_channel *chn;
+	const char *ptr, *end;
+	char id[256];
+	size_t len;
+
+	ptr = strstr(meta, "\"core:sample_rate\":");
+	if (ptr)
+		read_double(ptr + sizeof("\"core:sample_rate\":") - 1,
+			    &pdata->rate);
+
+	ptr = strstr(meta, "\"iio:channels\":");
+	end = ptr ? strchr(ptr, ']') : NULL;
+	if (!end)
+		return -EINVAL;
+
+	for (;;) {
+		ptr = strstr(ptr, "\"id\": \"");
+		if (!ptr || ptr > end)
+			break;
+
+		ptr += sizeof("\"id\": \"") - 1;
+		len = strcspn(ptr, "\"");
+		if (len >= sizeof(id))
+			return -EINVAL;
+
+		memcpy(id, ptr, len);
+		id[len] = '\0';
+		ptr += len;
+
+		chn = iio_device_find_channel(pdata->dev, id, false);
+		if (!chn || !chn->is_scan_element) {
+			dev_err(pdata->dev, "Unknown recorded channel %s\n", id);
+			return -EINVAL;
+		}
+
+		iio_channels_mask_set_bit(mask, chn->number);
+	}
+
+	return 0;
+}
+
+static int replay_open_samples(struct iio_buffer_pdata *pdata,
+			       const struct iio_channels_mask *mask)
+{
+	const struct iio_device *dev = pdata->dev;
+	const char *names[] = { dev->id, dev->name };
+	struct iio_channels_mask *file_mask;
+	size_t *src_offsets, *dst_offsets;
+	const struct iio_channel *chn, *prev = NULL;
+	char path[PATH_MAX], *meta = NULL;
+	unsigned int i;
+	bool same;
+	int err;
+
+	for (i = 0; !pdata->f && i < ARRAY_SIZE(names); i++) {
+		if (!names[i])
+			continue;
+
+		iio_snprintf(path, sizeof(path), "%s/%s" REPLAY_DATA_EXT,
+			     pdata->ctx_pdata->dir, names[i]);
+		pdata->f = fopen(path, "rb");
+		if (!pdata->f)
+			continue;
+
+		iio_snprintf(path, sizeof(path), "%s/%s" REPLAY_META_EXT,
+			     pdata->ctx_pdata->dir, names[i]);
+		meta = replay_read_file(path);
+	}
+
+	if (!pdata->f) {
+		dev_err(dev, "No recorded samples in %s\n",
+			pdata->ctx_pdata->dir);
+		return -ENOENT;
+	}
+
+	file_mask = iio_create_channels_mask(dev->nb_channels);
+	src_offsets = calloc(dev->nb_channels, sizeof(*src_offsets));
+	dst_offsets = calloc(dev->nb_channels, sizeof(*dst_offsets));
+	pdata->copies = calloc(dev->nb_channels, sizeof(*pdata->copies));
+	if (!file_mask || !src_offsets || !dst_offsets || !pdata->copies) {
+		err = -ENOMEM;
+		goto out_free;
+	}
+
+	if (meta) {
+		err = replay_parse_meta(pdata, meta, file_mask);
+		if (err) {
+			dev_perror(dev, err, "Unable to parse %s", path);
+			goto out_free;
+		}
+	} else {
+		for (i = 0; i < dev->nb_channels; i++)
+			if (dev->channels[i]->is_scan_element)
+				iio_channels_mask_set_bit(file_mask,
+							  dev->channels[i]->number);
+	}
+
+	pdata->file_sample_size = replay_get_layout(dev, file_mask, src_offsets);
+	pdata->sample_size = replay_get_layout(dev, mask, dst_offsets);
+	same = pdata->file_sample_size == pdata->sample_size;
+
+	for (i = 0; i < dev->nb_channels; i++) {
+		chn = dev->channels[i];
+		if (!iio_channels_mask_test_bit(mask, chn->number))
+			continue;
+
+		if (!iio_channels_mask_test_bit(file_mask, chn->number)) {
+			chn_err(chn, "Channel was not recorded\n");
+			err = -EINVAL;
+			goto out_free;
+		}
+
+		/* Channels sharing an index share their data */
+		if (prev && chn->index == prev->index)
+			continue;
+
+		pdata->copies[pdata->nb_copies++] = (struct replay_copy){
+			.src = src_offsets[i],
+			.dst = dst_offsets[i],
+			.len = chn->format.length / 8 * chn->format.repeat,
+		};
+
+		same &= src_offsets[i] == dst_offsets[i];
+		prev = chn;
+	}
+
+	/* Same layout: samples are read straight into the blocks */
+	if (same)
+		pdata->nb_copies = 0;
+
+	err = 0;
+
+out_free:
+	free(dst_offsets);
+	free(src_offsets);
+	if (file_mask)
+		iio_channels_mask_destroy(file_mask);
+	free(meta);
+	return err;
+}
+
+static struct iio_buffer_pdata *
+replay_create_buffer(const struct iio_device *dev, unsigned int idx,
+		     struct iio_channels_mask *mask)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	const struct iio_attr *attr;
+	struct iio_buffer_pdata *pdata;
+	int err;
+
+	pdata = zalloc(sizeof(*pdata));
+	if (!pdata)
+		return iio_ptr(-ENOMEM);
+
+	pdata->dev = dev;
+	pdata->ctx_pdata = ctx_pdata;
+	pdata->seed = 0x2545f491 + idx;
+
+	if (iio_device_is_tx(dev)) {
+		pdata->sample_size = iio_device_get_sample_size(dev, mask);
+	} else {
+		err = replay_open_samples(pdata, mask);
+		if (err)
+			goto err_free_pdata;
+	}
+
+	if (ctx_pdata->rate > 0.0) {
+		pdata->rate = ctx_pdata->rate;
+	} else if (!ctx_pdata->realtime) {
+		pdata->rate = 0.0;
+	} else if (pdata->rate <= 0.0) {
+		attr = iio_device_find_attr(dev, "sampling_frequency");
+		if (!attr || iio_attr_read_double(attr, &pdata->rate) < 0) {
+			dev_warn(dev, "Unknown sample rate, replaying at full speed\n");
+			pdata->rate = 0.0;
+		}
+	}
+
+	pdata->pacer = iio_pacer_create();
+	err = iio_err(pdata->pacer);
+	if (err)
+		goto err_free_pdata;
+
+	return pdata;
+
+err_free_pdata:
+	if (pdata->f)
+		fclose(pdata->f);
+	free(pdata->copies);
+	free(pdata);
+	return iio_ptr(err);
+}
+
+static void replay_free_buffer(struct iio_buffer_pdata *pdata)
+{
+	iio_pacer_destroy(pdata->pacer);
+	if (pdata->f)
+		fclose(pdata->f);
+	free(pdata->scratch);
+	free(pdata->copies);
+	free(pdata);
+}
+
+static int replay_enable_buffer(struct iio_buffer_pdata *pdata,
+				size_t nb_samples, bool enable, bool cyclic)
+{
+	/* The replay clock starts when the buffer is enabled */
+	pdata->start_us = 0;
+	pdata->samples = 0;
+
+	return 0;
+}
+
+static void replay_cancel_buffer(struct iio_buffer_pdata *pdata)
+{
+	iio_pacer_cancel(pdata->pacer);
+}
+
+/* xorshift32; deterministic, so that runs can be reproduced */
+static uint32_t replay_random(struct iio_buffer_pdata *pdata)
+{
+	uint32_t x = pdata->seed;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	pdata->seed = x;
+
+	return x;
+}
+
+/* A block is complete once its last sample would have been captured (or
+ * sent) by the hardware, plus the configured latency and jitter. */
+static int replay_pace(struct iio_buffer_pdata *pdata, size_t nb)
+{
+	struct iio_context_pdata *ctx_pdata = pdata->ctx_pdata;
+	uint64_t deadline, now = iio_read_counter_us();
+
+	if (!pdata->start_us)
+		pdata->start_us = now;
+
+	pdata->samples += nb;
+
+	if (pdata->rate > 0.0) {
+		deadline = pdata->start_us
+			+ (uint64_t) ((double) pdata->samples * 1e6 / pdata->rate);
+	} else {
+		deadline = now;
+	}
+
+	deadline += ctx_pdata->latency_us;
+	if (ctx_pdata->jitter_us)
+		deadline += replay_random(pdata) % (ctx_pdata->jitter_us + 1);
+
+	return iio_pacer_wait(pdata->pacer, deadline);
+}
+
+/* Read samples from the file, starting over once its end is reached */
+static int replay_read_samples(struct iio_buffer_pdata *pdata,
+			       char *dst, size_t nb)
+{
+	size_t ret, size = pdata->file_sample_size;
+	bool rewound = false;
+
+	while (nb) {
+		ret = fread(dst, size, nb, pdata->f);
+		dst += ret * size;
+		nb -= ret;
+
+		if (!nb)
+			break;
+		if (ferror(pdata->f))
+			return -EIO;
+
+		/* The file does not hold a single complete sample */
+		if (!ret && rewound)
+			return -ENODATA;
+
+		rewind(pdata->f);
+		rewound = !ret;
+	}
+
+	return 0;
+}
+
+static ssize_t replay_readbuf(struct iio_buffer_pdata *pdata,
+			      void *dst, size_t len)
+{
+	size_t i, j, nb = len / pdata->sample_size;
+	const struct replay_copy *copy;
+	char *src, *ptr = dst;
+	int err;
+
+	if (pdata->nb_copies) {
+		if (pdata->scratch_size < nb * pdata->file_sample_size) {
+			free(pdata->scratch);
+			pdata->scratch_size = nb * pdata->file_sample_size;
+			pdata->scratch = malloc(pdata->scratch_size);
+			if (!pdata->scratch) {
+				pdata->scratch_size = 0;
+				return -ENOMEM;
+			}
+		}
+
+		src = pdata->scratch;
+	} else {
+		src = dst;
+	}
+
+	err = replay_read_samples(pdata, src, nb);
+	if (err)
+		return err;
+
+	for (i = 0; pdata->nb_copies && i < nb; i++) {
+		for (j = 0; j < pdata->nb_copies; j++) {
+			copy = &pdata->copies[j];
+			memcpy(ptr + copy->dst, src + copy->src, copy->len);
+		}
+
+		src += pdata->file_sample_size;
+		ptr += pdata->sample_size;
+	}
+
+	err = replay_pace(pdata, nb);
+	if (err)
+		return err;
+
+	return (ssize_t) len;
+}
+
+/* Samples sent to output devices are discarded */
+static ssize_t replay_writebuf(struct iio_buffer_pdata *pdata,
+			       const void *src, size_t len)
+{
+	int err;
+
+	err = replay_pace(pdata, len / pdata->sample_size);
+	if (err)
+		return err;
+
+	return (ssize_t) len;
+}
+
+static int replay_parse_options(struct iio_context_pdata *pdata,
+				const struct iio_context_params *params,
+				char *opts)
+{
+	char *next, *value, *end;
+	unsigned long val;
+	int err;
+
+	for (; opts; opts = next) {
+		next = strchr(opts, ',');
+		if (next)
+			*next++ = '\0';
+
+		value = strchr(opts, '=');
+		if (value)
+			*value++ = '\0';
+
+		if (!strcmp(opts, "realtime")) {
+			if (value)
+				goto err_invalid;
+
+			pdata->realtime = true;
+			continue;
+		}
+
+		if (strcmp(opts, "rate") && strcmp(opts, "latency")
+		    && strcmp(opts, "jitter")) {
+			prm_err(params, "Unknown replay option \'%s\'\n", opts);
+			return -EINVAL;
+		}
+
+		if (!value)
+			goto err_invalid;
+
+		if (!strcmp(opts, "rate")) {
+			err = read_double(value, &pdata->rate);
+			if (err || pdata->rate < 0.0)
+				goto err_invalid;
+
+			continue;
+		}
+
+		errno = 0;
+		val = strtoul(value, &end, 10);
+		if (end == value || *end || errno || val > UINT32_MAX)
+			goto err_invalid;
+
+		if (!strcmp(opts, "latency"))
+			pdata->latency_us = (unsigned int) val;
+		else
+			pdata->jitter_us = (unsigned int) val;
+	}
+
+	return 0;
+
+err_invalid:
+	prm_err(params, "Invalid value for replay option \'%s\'\n", opts);
+	return -EINVAL;
+}
+
+static void replay_release_pdata(struct iio_context_pdata *pdata)
+{
+	size_t i;
+
+	for (i = 0; i < pdata->nb_attrs; i++) {
+		free(pdata->attrs[i].key);
+		free(pdata->attrs[i].value);
+	}
+
+	free(pdata->attrs);
+	if (pdata->lock)
+		iio_mutex_destroy(pdata->lock);
+	free(pdata->dir);
+}
+
+/* The pdata itself is freed along with the context */
+static void replay_shutdown(struct iio_context *ctx)
+{
+	replay_release_pdata(iio_context_get_pdata(ctx));
+}
+
+static struct iio_context *
+replay_create_context(const struct iio_context_params *params,
+		      const char *args)
+{
+	struct iio_context_pdata *pdata;
+	struct iio_context *ctx;
+	char uri[PATH_MAX + sizeof("xml:/" REPLAY_XML_FILE)], *opts;
+	int err;
+
+	pdata = zalloc(sizeof(*pdata));
+	if (!pdata)
+		return iio_ptr(-ENOMEM);
+
+	pdata->dir = iio_strdup(args);
+	if (!pdata->dir) {
+		err = -ENOMEM;
+		goto err_free_pdata;
+	}
+
+	opts = strchr(pdata->dir, ',');
+	if (opts)
+		*opts++ = '\0';
+
+	if (!pdata->dir[0] || strlen(pdata->dir) >= PATH_MAX) {
+		prm_err(params, "Invalid replay directory\n");
+		err = -EINVAL;
+		goto err_free_pdata;
+	}
+
+	err = replay_parse_options(pdata, params, opts);
+	if (err)
+		goto err_free_pdata;
+
+	pdata->lock = iio_mutex_create();
+	err = iio_err(pdata->lock);
+	if (err) {
+		pdata->lock = NULL;
+		goto err_free_pdata;
+	}
+
+	err = replay_load_attrs(pdata, params);
+	if (err)
+		goto err_free_pdata;
+
+	iio_snprintf(uri, sizeof(uri), "xml:%s/" REPLAY_XML_FILE, pdata->dir);
+
+	ctx = iio_create_context_from_xml(params, uri, &iio_replay_backend,
+					  "(replay)", NULL, NULL, 0);
+	err = iio_err(ctx);
+	if (err) {
+		prm_perror(params, err, "Unable to load %s", uri + 4);
+		goto err_free_pdata;
+	}
+
+	iio_context_set_pdata(ctx, pdata);
+
+	return ctx;
+
+err_free_pdata:
+	replay_release_pdata(pdata);
+	free(pdata);
+	return iio_ptr(err);
+}
+
+static const struct iio_backend_ops replay_ops = {
+	.create = replay_create_context,
+	.read_attr = replay_read_attr,
+	.write_attr = replay_write_attr,
+	.shutdown = replay_shutdown,
+	.create_buffer = replay_create_buffer,
+	.free_buffer = replay_free_buffer,
+	.enable_buffer = replay_enable_buffer,
+	.cancel_buffer = replay_cancel_buffer,
+	.readbuf = replay_readbuf,
+	.writebuf = replay_writebuf,
+};
+
+const struct iio_backend iio_replay_backend = {
+	.api_version = IIO_BACKEND_API_V1,
+	.name = "replay",
+	.uri_prefix = "replay:",
+	.ops = &replay_ops,
+};
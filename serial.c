@@ -19,11 +19,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#ifdef _WIN32
-#include <Windows.h>
-#else
-#include <time.h>
-#endif
+
+/* Max. time a read waits before checking for a shutdown request */
+#define SERIAL_SHUTDOWN_CHECK_MS 100
 
 struct iio_context_pdata {
 	struct sp_port *port;
@@ -152,25 +150,12 @@ static ssize_t serial_write_data(struct iiod_client_pdata *io_data,
 	return ret;
 }
 
-void sleep_one_ms(void)
-{
-#ifdef _WIN32
-	Sleep(1);
-#else
-	const struct timespec ts = {
-		/* One millisecond */
-		.tv_nsec = 1 * 1000 * 1000,
-	};
-
-	nanosleep(&ts, NULL);
-#endif
-}
-
 static ssize_t serial_read_data(struct iiod_client_pdata *io_data,
 				char *buf, size_t len, unsigned int timeout_ms)
 {
 	struct iio_context_pdata *pdata = (struct iio_context_pdata *) io_data;
 	long long time_left_ms = (long long)timeout_ms;
+	unsigned int wait_ms;
 	enum sp_return sp_ret;
 	ssize_t ret = 0;
 
@@ -178,13 +163,18 @@ static ssize_t serial_read_data(struct iiod_client_pdata *io_data,
 		if (timeout_ms && time_left_ms <= 0)
 			break;
 
-		sp_ret = sp_nonblocking_read(pdata->port, buf, len);
+		/* Sleep until some data arrives; wake up regularly to check
+		 * whether the context is being shut down. */
+		wait_ms = SERIAL_SHUTDOWN_CHECK_MS;
+		if (timeout_ms && time_left_ms < wait_ms)
+			wait_ms = (unsigned int) time_left_ms;
+
+		sp_ret = sp_blocking_read_next(pdata->port, buf, len, wait_ms);
 		ret = (ssize_t) libserialport_to_errno(sp_ret);
 		if (ret || pdata->shutdown)
 			break;
 
-		sleep_one_ms();
-		time_left_ms--;
+		time_left_ms -= wait_ms;
 	}
 
 	if (ret == 0) {
@@ -281,6 +271,20 @@ serial_create_block(struct iio_buffer_pdata *buf, size_t size, void **data)
 	return iiod_client_create_block(buf->pdata, size, data);
 }
 
+static struct iio_block_pdata *
+serial_create_block_from_memory(struct iio_buffer_pdata *buf,
+				void *ptr, size_t size)
+{
+	return iiod_client_create_block_from_memory(buf->pdata, ptr, size);
+}
+
+static void
+serial_set_block_allocator(struct iio_buffer_pdata *buf,
+			   struct iio_block_allocator *alloc)
+{
+	iiod_client_set_block_allocator(buf->pdata, alloc);
+}
+
 static struct iio_event_stream_pdata *
 serial_open_events_fd(const struct iio_device *dev)
 {
@@ -307,12 +311,16 @@ static const struct iio_backend_ops serial_ops = {
 
 	.create_block = serial_create_block,
 	.free_block = iiod_client_free_block,
+	.set_block_allocator = serial_set_block_allocator,
+	.create_block_from_memory = serial_create_block_from_memory,
 	.enqueue_block = iiod_client_enqueue_block,
 	.dequeue_block = iiod_client_dequeue_block,
 
 	.open_ev = serial_open_events_fd,
 	.close_ev = iiod_client_close_event_stream,
 	.read_ev = iiod_client_read_event,
+	.read_ev_many = iiod_client_read_events,
+	.get_ev_overflows = iiod_client_get_event_overflows,
 };
 
 __api_export_if(WITH_SERIAL_BACKEND_DYNAMIC)
@@ -411,9 +419,10 @@ static struct iio_context * serial_create_context(
 	pdata->port = port;
 	pdata->params = *params;
 
-	pdata->iiod_client = iiod_client_new(params,
-					     (struct iiod_client_pdata *) pdata,
-					     &serial_iiod_client_ops);
+	pdata->iiod_client = iiod_client_new_flags(params,
+						   (struct iiod_client_pdata *) pdata,
+						   &serial_iiod_client_ops,
+						   IIOD_CLIENT_READ_PARTIAL);
 	ret = iio_err(pdata->iiod_client);
 	if (ret)
 		goto err_free_pdata;
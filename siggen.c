@@ -0,0 +1,729 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2024 Analog Devices, Inc.
+ */
+
+#include "iio-config.h"
+#include "iio-private.h"
+
+#include <errno.h>
+#include <iio/iio-backend.h>
+#include <iio/iio-debug.h>
+#include <iio/iio-lock.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The context holds three input devices, "ramp", "sine" and "noise", and one
+ * output device, "sink", each with the same channels. On the ramp, channel N
+ * carries the sample counter plus N; the sink checks that what it receives
+ * follows such a ramp, and counts the discontinuities in its "errors"
+ * attribute. The "sampling_frequency" attribute of each device sets the pace
+ * of the transfers, 0 meaning as fast as possible.
+ */
+#define SIGGEN_MAX_CHANNELS	64
+#define SIGGEN_PI		3.14159265358979323846
+
+enum siggen_signal {
+	SIGGEN_RAMP,
+	SIGGEN_SINE,
+	SIGGEN_NOISE,
+	SIGGEN_SINK,
+};
+
+static const char * const siggen_names[] = {
+	[SIGGEN_RAMP] = "ramp",
+	[SIGGEN_SINE] = "sine",
+	[SIGGEN_NOISE] = "noise",
+	[SIGGEN_SINK] = "sink",
+};
+
+struct iio_context_pdata {
+	unsigned int nb_channels;
+	unsigned int period;
+	double rate;
+	struct iio_data_format fmt;
+};
+
+struct iio_device_pdata {
+	enum siggen_signal signal;
+
+	/* Protects the fields below */
+	struct iio_mutex *lock;
+	double rate;
+	uint64_t samples, errors;
+	unsigned int nb_buffers;
+};
+
+struct iio_buffer_pdata {
+	const struct iio_device *dev;
+	struct iio_device_pdata *dev_pdata;
+	unsigned int period;
+
+	/* Index of each enabled channel */
+	unsigned int indexes[SIGGEN_MAX_CHANNELS];
+	unsigned int nb_enabled;
+	size_t length, sample_size;
+
+	uint64_t counter, seed;
+	void *table;
+
+	/* Ramp expected by the sink */
+	bool synced;
+	uint64_t expected;
+
+	double rate;
+	uint64_t start_us, samples;
+
+	struct iio_pacer *pacer;
+};
+
+/* Only used to fill the sine tables; avoids a dependency on libm */
+static void siggen_sincos(double x, double *s, double *c)
+{
+	double term = x, sum_s = 0.0, sum_c = 0.0, cterm = 1.0;
+	unsigned int i;
+
+	for (i = 1; i < 30; i += 2) {
+		sum_s += term;
+		sum_c += cterm;
+		term *= -x * x / ((i + 1) * (i + 2));
+		cterm *= -x * x / (i * (i + 1));
+	}
+
+	*s = sum_s;
+	*c = sum_c;
+}
+
+#define SIGGEN_FUNCS(bits)						\
+static void siggen_ramp##bits(struct iio_buffer_pdata *pdata,		\
+			      void *dst, size_t nb)			\
+{									\
+	uint##bits##_t *ptr = dst;					\
+	uint64_t n = pdata->counter;					\
+	unsigned int k;							\
+	size_t i;							\
+									\
+	for (i = 0; i < nb; i++, n++)					\
+		for (k = 0; k < pdata->nb_enabled; k++)			\
+			*ptr++ = (uint##bits##_t) (n + pdata->indexes[k]); \
+}									\
+									\
+static void siggen_sine##bits(struct iio_buffer_pdata *pdata,		\
+			      void *dst, size_t nb)			\
+{									\
+	const uint##bits##_t *table = pdata->table;			\
+	uint##bits##_t *ptr = dst;					\
+	uint64_t n = pdata->counter;					\
+	unsigned int k, phase;						\
+	size_t i;							\
+									\
+	/* Consecutive channels are a quarter period apart */		\
+	for (i = 0; i < nb; i++, n++) {					\
+		for (k = 0; k < pdata->nb_enabled; k++) {		\
+			phase = pdata->indexes[k] * (pdata->period / 4); \
+			*ptr++ = table[(n + phase) % pdata->period];	\
+		}							\
+	}								\
+}									\
+									\
+static uint64_t siggen_check##bits(struct iio_buffer_pdata *pdata,	\
+				   const void *src, size_t nb)		\
+{									\
+	const uint##bits##_t *ptr = src;				\
+	uint64_t errors = 0;						\
+	unsigned int k;							\
+	bool ok;							\
+	size_t i;							\
+									\
+	for (i = 0; i < nb; i++, pdata->expected++) {			\
+		ok = true;						\
+									\
+		for (k = 0; k < pdata->nb_enabled; k++, ptr++) {	\
+			if (!pdata->synced) {				\
+				pdata->expected = *ptr - pdata->indexes[k]; \
+				pdata->synced = true;			\
+			}						\
+									\
+			if (*ptr != (uint##bits##_t) (pdata->expected	\
+						      + pdata->indexes[k])) { \
+				pdata->expected = *ptr - pdata->indexes[k]; \
+				ok = false;				\
+			}						\
+		}							\
+									\
+		errors += !ok;						\
+	}								\
+									\
+	return errors;							\
+}									\
+									\
+static void siggen_fill_sine##bits(struct iio_buffer_pdata *pdata,	\
+				   const struct iio_data_format *fmt)	\
+{									\
+	uint##bits##_t *table = pdata->table;				\
+	double s, c, step_s, step_c, tmp, amp;				\
+	unsigned int i;							\
+									\
+	/* Half of the full scale */					\
+	amp = (double) ((uint64_t) 1 << (bits - 2));			\
+	siggen_sincos(2.0 * SIGGEN_PI / pdata->period, &step_s, &step_c); \
+	s = 0.0;							\
+	c = 1.0;							\
+									\
+	for (i = 0; i < pdata->period; i++) {				\
+		if (fmt->is_signed)					\
+			table[i] = (uint##bits##_t) (int64_t) (amp * s); \
+		else							\
+			table[i] = (uint##bits##_t) (uint64_t) (2.0 * amp + amp * s); \
+									\
+		tmp = s * step_c + c * step_s;				\
+		c = c * step_c - s * step_s;				\
+		s = tmp;						\
+	}								\
+}
+
+SIGGEN_FUNCS(8)
+SIGGEN_FUNCS(16)
+SIGGEN_FUNCS(32)
+SIGGEN_FUNCS(64)
+
+static void siggen_noise(struct iio_buffer_pdata *pdata, void *dst, size_t len)
+{
+	unsigned char *ptr = dst;
+	uint64_t x = pdata->seed, val;
+	size_t nb;
+
+	/* xorshift64* */
+	for (; len; len -= nb, ptr += nb) {
+		x ^= x >> 12;
+		x ^= x << 25;
+		x ^= x >> 27;
+		val = x * 0x2545f4914f6cdd1dull;
+
+		nb = len < sizeof(val) ? len : sizeof(val);
+		memcpy(ptr, &val, nb);
+	}
+
+	pdata->seed = x;
+}
+
+static void siggen_generate(struct iio_buffer_pdata *pdata,
+			    void *dst, size_t nb)
+{
+	switch (pdata->dev_pdata->signal) {
+	case SIGGEN_RAMP:
+		switch (pdata->length) {
+		case 1:
+			siggen_ramp8(pdata, dst, nb);
+			break;
+		case 2:
+			siggen_ramp16(pdata, dst, nb);
+			break;
+		case 4:
+			siggen_ramp32(pdata, dst, nb);
+			break;
+		default:
+			siggen_ramp64(pdata, dst, nb);
+			break;
+		}
+		break;
+	case SIGGEN_SINE:
+		switch (pdata->length) {
+		case 1:
+			siggen_sine8(pdata, dst, nb);
+			break;
+		case 2:
+			siggen_sine16(pdata, dst, nb);
+			break;
+		case 4:
+			siggen_sine32(pdata, dst, nb);
+			break;
+		default:
+			siggen_sine64(pdata, dst, nb);
+			break;
+		}
+		break;
+	default:
+		siggen_noise(pdata, dst, nb * pdata->sample_size);
+		break;
+	}
+
+	pdata->counter += nb;
+}
+
+static uint64_t siggen_check(struct iio_buffer_pdata *pdata,
+			     const void *src, size_t nb)
+{
+	switch (pdata->length) {
+	case 1:
+		return siggen_check8(pdata, src, nb);
+	case 2:
+		return siggen_check16(pdata, src, nb);
+	case 4:
+		return siggen_check32(pdata, src, nb);
+	default:
+		return siggen_check64(pdata, src, nb);
+	}
+}
+
+static ssize_t siggen_read_attr(const struct iio_attr *attr,
+				char *dst, size_t len)
+{
+	const struct iio_device *dev = iio_attr_get_device(attr);
+	struct iio_device_pdata *pdata = iio_device_get_pdata(dev);
+	uint64_t val;
+
+	if (!strcmp(attr->name, "sampling_frequency")) {
+		iio_mutex_lock(pdata->lock);
+		write_double(dst, len, pdata->rate);
+		iio_mutex_unlock(pdata->lock);
+
+		return (ssize_t) strlen(dst) + 1;
+	}
+
+	iio_mutex_lock(pdata->lock);
+	val = !strcmp(attr->name, "errors") ? pdata->errors : pdata->samples;
+	iio_mutex_unlock(pdata->lock);
+
+	return iio_snprintf(dst, len, "%llu", (unsigned long long) val) + 1;
+}
+
+static ssize_t siggen_write_attr(const struct iio_attr *attr,
+				 const char *src, size_t len)
+{
+	const struct iio_device *dev = iio_attr_get_device(attr);
+	struct iio_device_pdata *pdata = iio_device_get_pdata(dev);
+	double rate;
+	int err;
+
+	if (!strcmp(attr->name, "sampling_frequency")) {
+		err = read_double(src, &rate);
+		if (err || rate < 0.0)
+			return -EINVAL;
+
+		iio_mutex_lock(pdata->lock);
+		pdata->rate = rate;
+		iio_mutex_unlock(pdata->lock);
+
+		return (ssize_t) len;
+	}
+
+	/* Writing the statistics resets them */
+	iio_mutex_lock(pdata->lock);
+	pdata->samples = 0;
+	pdata->errors = 0;
+	iio_mutex_unlock(pdata->lock);
+
+	return (ssize_t) len;
+}
+
+static struct iio_buffer_pdata *
+siggen_create_buffer(const struct iio_device *dev, unsigned int idx,
+		     struct iio_channels_mask *mask)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_buffer_pdata *pdata;
+	const struct iio_channel *chn;
+	unsigned int i;
+	int err;
+
+	pdata = zalloc(sizeof(*pdata));
+	if (!pdata)
+		return iio_ptr(-ENOMEM);
+
+	pdata->dev = dev;
+	pdata->dev_pdata = iio_device_get_pdata(dev);
+	pdata->period = ctx_pdata->period;
+	pdata->length = ctx_pdata->fmt.length / 8;
+
+	for (i = 0; i < dev->nb_channels; i++) {
+		chn = dev->channels[i];
+		if (iio_channels_mask_test_bit(mask, chn->number))
+			pdata->indexes[pdata->nb_enabled++] = (unsigned int) chn->index;
+	}
+
+	pdata->sample_size = pdata->nb_enabled * pdata->length;
+
+	iio_mutex_lock(pdata->dev_pdata->lock);
+	pdata->seed = 0x9e3779b97f4a7c15ull * ++pdata->dev_pdata->nb_buffers;
+	iio_mutex_unlock(pdata->dev_pdata->lock);
+
+	if (pdata->dev_pdata->signal == SIGGEN_SINE) {
+		pdata->table = malloc(pdata->period * pdata->length);
+		if (!pdata->table) {
+			err = -ENOMEM;
+			goto err_free_pdata;
+		}
+
+		switch (pdata->length) {
+		case 1:
+			siggen_fill_sine8(pdata, &ctx_pdata->fmt);
+			break;
+		case 2:
+			siggen_fill_sine16(pdata, &ctx_pdata->fmt);
+			break;
+		case 4:
+			siggen_fill_sine32(pdata, &ctx_pdata->fmt);
+			break;
+		default:
+			siggen_fill_sine64(pdata, &ctx_pdata->fmt);
+			break;
+		}
+	}
+
+	pdata->pacer = iio_pacer_create();
+	err = iio_err(pdata->pacer);
+	if (err)
+		goto err_free_pdata;
+
+	return pdata;
+
+err_free_pdata:
+	free(pdata->table);
+	free(pdata);
+	return iio_ptr(err);
+}
+
+static void siggen_free_buffer(struct iio_buffer_pdata *pdata)
+{
+	iio_pacer_destroy(pdata->pacer);
+	free(pdata->table);
+	free(pdata);
+}
+
+static int siggen_enable_buffer(struct iio_buffer_pdata *pdata,
+				size_t nb_samples, bool enable, bool cyclic)
+{
+	/* The clock starts when the buffer is enabled */
+	pdata->start_us = 0;
+
+	return 0;
+}
+
+static void siggen_cancel_buffer(struct iio_buffer_pdata *pdata)
+{
+	iio_pacer_cancel(pdata->pacer);
+}
+
+/* Complete the transfer once its last sample is due at the device's rate */
+static int siggen_pace(struct iio_buffer_pdata *pdata, size_t nb)
+{
+	struct iio_device_pdata *dev_pdata = pdata->dev_pdata;
+	uint64_t now = iio_read_counter_us();
+	double rate;
+
+	iio_mutex_lock(dev_pdata->lock);
+	rate = dev_pdata->rate;
+	dev_pdata->samples += nb;
+	iio_mutex_unlock(dev_pdata->lock);
+
+	/* No rate: only check for cancellation */
+	if (rate <= 0.0)
+		return iio_pacer_wait(pdata->pacer, 0);
+
+	/* Start over when the rate changes */
+	if (!pdata->start_us || rate != pdata->rate) {
+		pdata->start_us = now;
+		pdata->samples = 0;
+		pdata->rate = rate;
+	}
+
+	pdata->samples += nb;
+
+	return iio_pacer_wait(pdata->pacer, pdata->start_us
+			   + (uint64_t) ((double) pdata->samples * 1e6 / rate));
+}
+
+static ssize_t siggen_readbuf(struct iio_buffer_pdata *pdata,
+			      void *dst, size_t len)
+{
+	size_t nb = len / pdata->sample_size;
+	int err;
+
+	siggen_generate(pdata, dst, nb);
+
+	err = siggen_pace(pdata, nb);
+	if (err)
+		return err;
+
+	return (ssize_t) len;
+}
+
+static ssize_t siggen_writebuf(struct iio_buffer_pdata *pdata,
+			       const void *src, size_t len)
+{
+	size_t nb = len / pdata->sample_size;
+	uint64_t errors;
+	int err;
+
+	errors = siggen_check(pdata, src, nb);
+	if (errors) {
+		iio_mutex_lock(pdata->dev_pdata->lock);
+		pdata->dev_pdata->errors += errors;
+		iio_mutex_unlock(pdata->dev_pdata->lock);
+	}
+
+	err = siggen_pace(pdata, nb);
+	if (err)
+		return err;
+
+	return (ssize_t) len;
+}
+
+static int siggen_parse_format(struct iio_data_format *fmt, const char *str)
+{
+	const union {
+		uint16_t u16;
+		uint8_t u8;
+	} endian = { .u16 = 1 };
+	unsigned long bits;
+	char *end;
+
+	if (*str != 's' && *str != 'u')
+		return -EINVAL;
+
+	errno = 0;
+	bits = strtoul(str + 1, &end, 10);
+	if (end == str + 1 || *end || errno)
+		return -EINVAL;
+
+	if (bits != 8 && bits != 16 && bits != 32 && bits != 64)
+		return -EINVAL;
+
+	/* Samples are generated in the CPU's byte order */
+	*fmt = (struct iio_data_format){
+		.length = (unsigned int) bits,
+		.bits = (unsigned int) bits,
+		.is_signed = *str == 's',
+		.is_fully_defined = true,
+		.is_be = !endian.u8,
+		.repeat = 1,
+	};
+
+	return 0;
+}
+
+static int siggen_parse_options(struct iio_context_pdata *pdata,
+				const struct iio_context_params *params,
+				char *opts)
+{
+	char *next, *value, *end;
+	unsigned long val;
+	int err;
+
+	for (; opts && *opts; opts = next) {
+		next = strchr(opts, ',');
+		if (next)
+			*next++ = '\0';
+
+		value = strchr(opts, '=');
+		if (!value) {
+			prm_err(params, "Invalid siggen option \'%s\'\n", opts);
+			return -EINVAL;
+		}
+
+		*value++ = '\0';
+
+		if (!strcmp(opts, "format")) {
+			err = siggen_parse_format(&pdata->fmt, value);
+			if (err)
+				goto err_invalid;
+		} else if (!strcmp(opts, "rate")) {
+			err = read_double(value, &pdata->rate);
+			if (err || pdata->rate < 0.0)
+				goto err_invalid;
+		} else if (!strcmp(opts, "channels") || !strcmp(opts, "period")) {
+			errno = 0;
+			val = strtoul(value, &end, 10);
+			if (end == value || *end || errno)
+				goto err_invalid;
+
+			if (opts[0] == 'c') {
+				if (!val || val > SIGGEN_MAX_CHANNELS)
+					goto err_invalid;
+
+				pdata->nb_channels = (unsigned int) val;
+			} else {
+				if (val < 4 || val > 1 << 24)
+					goto err_invalid;
+
+				pdata->period = (unsigned int) val;
+			}
+		} else {
+			prm_err(params, "Unknown siggen option \'%s\'\n", opts);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+
+err_invalid:
+	prm_err(params, "Invalid value for siggen option \'%s\'\n", opts);
+	return -EINVAL;
+}
+
+static int siggen_add_device(struct iio_context *ctx,
+			     enum siggen_signal signal, unsigned int idx)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(ctx);
+	struct iio_device_pdata *pdata;
+	struct iio_channel *chn;
+	struct iio_device *dev;
+	bool output = signal == SIGGEN_SINK;
+	char id[32];
+	unsigned int i;
+	int err;
+
+	iio_snprintf(id, sizeof(id), "iio:device%u", idx);
+
+	dev = iio_context_add_device(ctx, id, siggen_names[signal], NULL);
+	if (!dev)
+		return -ENOMEM;
+
+	pdata = zalloc(sizeof(*pdata));
+	if (!pdata)
+		return -ENOMEM;
+
+	pdata->signal = signal;
+	pdata->rate = ctx_pdata->rate;
+
+	pdata->lock = iio_mutex_create();
+	err = iio_err(pdata->lock);
+	if (err) {
+		free(pdata);
+		return err;
+	}
+
+	iio_device_set_pdata(dev, pdata);
+
+	for (i = 0; i < ctx_pdata->nb_channels; i++) {
+		iio_snprintf(id, sizeof(id), "voltage%u", i);
+
+		chn = iio_device_add_channel(dev, (long) i, id, NULL, output,
+					     true, &ctx_pdata->fmt);
+		if (!chn)
+			return -ENOMEM;
+
+		iio_channel_set_scale_offset_known(chn);
+	}
+
+	err = iio_device_add_attr(dev, "sampling_frequency",
+				  IIO_ATTR_TYPE_DEVICE);
+	if (!err && output)
+		err = iio_device_add_attr(dev, "samples", IIO_ATTR_TYPE_DEVICE);
+	if (!err && output)
+		err = iio_device_add_attr(dev, "errors", IIO_ATTR_TYPE_DEVICE);
+
+	return err;
+}
+
+static void siggen_shutdown(struct iio_context *ctx)
+{
+	struct iio_device_pdata *pdata;
+	unsigned int i;
+
+	for (i = 0; i < ctx->nb_devices; i++) {
+		pdata = iio_device_get_pdata(ctx->devices[i]);
+		if (!pdata)
+			continue;
+
+		iio_mutex_destroy(pdata->lock);
+		free(pdata);
+	}
+}
+
+static struct iio_context *
+siggen_create_context(const struct iio_context_params *params,
+		      const char *args)
+{
+	struct iio_context_pdata *pdata;
+	struct iio_context *ctx;
+	char *opts, *uri;
+	unsigned int i;
+	int err;
+
+	pdata = zalloc(sizeof(*pdata));
+	if (!pdata)
+		return iio_ptr(-ENOMEM);
+
+	pdata->nb_channels = 4;
+	pdata->period = 1024;
+	siggen_parse_format(&pdata->fmt, "s16");
+
+	opts = iio_strdup(args);
+	if (!opts) {
+		free(pdata);
+		return iio_ptr(-ENOMEM);
+	}
+
+	err = siggen_parse_options(pdata, params, opts);
+	free(opts);
+	if (err) {
+		free(pdata);
+		return iio_ptr(err);
+	}
+
+	ctx = iio_context_create_from_backend(params, &iio_siggen_backend,
+					      "Synthetic signal generator",
+					      0, 0, NULL);
+	err = iio_err(ctx);
+	if (err) {
+		free(pdata);
+		return ctx;
+	}
+
+	/* Freed along with the context */
+	iio_context_set_pdata(ctx, pdata);
+
+	for (i = 0; i < ARRAY_SIZE(siggen_names); i++) {
+		err = siggen_add_device(ctx, (enum siggen_signal) i, i);
+		if (err)
+			goto err_context_destroy;
+	}
+
+	uri = malloc(sizeof("siggen:") + strlen(args));
+	if (!uri) {
+		err = -ENOMEM;
+		goto err_context_destroy;
+	}
+
+	iio_snprintf(uri, sizeof("siggen:") + strlen(args), "siggen:%s", args);
+	err = iio_context_add_attr(ctx, "uri", uri);
+	free(uri);
+	if (err < 0)
+		goto err_context_destroy;
+
+	err = iio_context_init(ctx);
+	if (err < 0)
+		goto err_context_destroy;
+
+	return ctx;
+
+err_context_destroy:
+	iio_context_destroy(ctx);
+	return iio_ptr(err);
+}
+
+static const struct iio_backend_ops siggen_ops = {
+	.create = siggen_create_context,
+	.read_attr = siggen_read_attr,
+	.write_attr = siggen_write_attr,
+	.shutdown = siggen_shutdown,
+	.create_buffer = siggen_create_buffer,
+	.free_buffer = siggen_free_buffer,
+	.enable_buffer = siggen_enable_buffer,
+	.cancel_buffer = siggen_cancel_buffer,
+	.readbuf = siggen_readbuf,
+	.writebuf = siggen_writebuf,
+};
+
+const struct iio_backend iio_siggen_backend = {
+	.api_version = IIO_BACKEND_API_V1,
+	.name = "siggen",
+	.uri_prefix = "siggen:",
+	.ops = &siggen_ops,
+};
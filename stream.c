@@ -10,8 +10,46 @@
 
 #include <errno.h>
 #include <iio/iio-debug.h>
+#include <iio/iio-lock.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+
+/* Number of blocks between two tuning decisions */
+#define IIO_STREAM_TUNE_WINDOW		64
+/* Number of latency measurements kept to compute the percentiles */
+#define IIO_STREAM_TUNE_HISTORY		256
+/* Number of calm windows required before shrinking the blocks */
+#define IIO_STREAM_TUNE_CALM		4
+
+/* Number of blocks of a tuned stream: bounds and initial value */
+#define IIO_STREAM_MIN_BLOCKS		2
+#define IIO_STREAM_MAX_BLOCKS		16
+#define IIO_STREAM_INIT_BLOCKS		4
+
+struct iio_stream_tuner {
+	struct iio_mutex *lock;
+
+	uint64_t target_us, block_us;
+	double sample_rate;
+
+	/* Bounds of the block size. Sizes at or below the floor caused the
+	 * application to fall behind, and are not tried again. */
+	size_t min_samples, max_samples, floor_samples;
+
+	/* Expected completion time of the blocks, from the last one that the
+	 * application had to wait for */
+	uint64_t anchor_us, nb_since_anchor;
+
+	uint64_t lateness[IIO_STREAM_TUNE_WINDOW];
+	unsigned int nb_lateness, calm_windows;
+	bool retune;
+
+	/* Protected by the lock */
+	uint64_t history[IIO_STREAM_TUNE_HISTORY];
+	unsigned int history_len, history_pos;
+	struct iio_stream_latency_stats stats;
+};
 
 struct iio_stream {
 	struct iio_buffer *buffer;
@@ -19,14 +57,58 @@ struct iio_stream {
 	size_t nb_blocks;
 	bool started, buf_enabled, all_enqueued;
 	unsigned int curr;
+
+	/* Only set for low-latency streams */
+	struct iio_stream_tuner *tuner;
 };
 
+static void iio_stream_free_blocks(struct iio_stream *stream)
+{
+	size_t i;
+
+	for (i = 0; i < stream->nb_blocks; i++)
+		if (stream->blocks[i])
+			iio_block_destroy(stream->blocks[i]);
+	free(stream->blocks);
+
+	stream->blocks = NULL;
+	stream->nb_blocks = 0;
+}
+
+static int iio_stream_alloc_blocks(struct iio_stream *stream,
+				   size_t nb_blocks, size_t samples_count)
+{
+	struct iio_buffer *buffer = stream->buffer;
+	size_t i, sample_size, buf_size;
+	int err;
+
+	stream->blocks = calloc(nb_blocks, sizeof(*stream->blocks));
+	if (!stream->blocks)
+		return -ENOMEM;
+
+	stream->nb_blocks = nb_blocks;
+
+	sample_size = iio_device_get_sample_size(buffer->dev, buffer->mask);
+	buf_size = samples_count * sample_size;
+
+	for (i = 0; i < nb_blocks; i++) {
+		stream->blocks[i] = iio_buffer_create_block(buffer, buf_size);
+		err = iio_err(stream->blocks[i]);
+		if (err) {
+			stream->blocks[i] = NULL;
+			iio_stream_free_blocks(stream);
+			return err;
+		}
+	}
+
+	return 0;
+}
+
 struct iio_stream *
 iio_buffer_create_stream(struct iio_buffer *buffer, size_t nb_blocks,
 			 size_t samples_count)
 {
 	struct iio_stream *stream;
-	size_t i, sample_size, buf_size;
 	int err;
 
 	if (!nb_blocks || !samples_count)
@@ -36,58 +118,310 @@ iio_buffer_create_stream(struct iio_buffer *buffer, size_t nb_blocks,
 	if (!stream)
 		return iio_ptr(-ENOMEM);
 
-	stream->blocks = calloc(nb_blocks, sizeof(*stream->blocks));
-	if (!stream->blocks) {
-		err = -ENOMEM;
-		goto err_free_stream;
+	stream->buffer = buffer;
+
+	err = iio_stream_alloc_blocks(stream, nb_blocks, samples_count);
+	if (err) {
+		free(stream);
+		return iio_ptr(err);
 	}
 
-	sample_size = iio_device_get_sample_size(buffer->dev, buffer->mask);
-	buf_size = samples_count * sample_size;
+	return stream;
+}
 
-	for (i = 0; i < nb_blocks; i++) {
-		stream->blocks[i] = iio_buffer_create_block(buffer, buf_size);
-		err = iio_err(stream->blocks[i]);
-		if (err) {
-			stream->blocks[i] = NULL;
-			goto err_free_stream_blocks;
+static uint64_t iio_stream_block_us(const struct iio_stream_tuner *tuner,
+				    size_t samples_count)
+{
+	return (uint64_t) ((double) samples_count * 1000000.0
+			   / tuner->sample_rate);
+}
+
+struct iio_stream *
+iio_buffer_create_low_latency_stream(struct iio_buffer *buffer,
+				     uint64_t latency_us, double sample_rate)
+{
+	const struct iio_attr *attr;
+	struct iio_stream_tuner *tuner;
+	struct iio_stream *stream;
+	size_t samples_count;
+	int err;
+
+	if (!latency_us || iio_device_is_tx(buffer->dev))
+		return iio_ptr(-EINVAL);
+
+	if (sample_rate <= 0.0) {
+		attr = iio_device_find_attr(buffer->dev, "sampling_frequency");
+		if (!attr || iio_attr_read_double(attr, &sample_rate) < 0
+		    || sample_rate <= 0.0) {
+			dev_err(buffer->dev, "Unable to read the sample rate\n");
+			return iio_ptr(-EINVAL);
 		}
 	}
 
-	stream->buffer = buffer;
-	stream->nb_blocks = nb_blocks;
+	tuner = zalloc(sizeof(*tuner));
+	if (!tuner)
+		return iio_ptr(-ENOMEM);
+
+	tuner->lock = iio_mutex_create();
+	err = iio_err(tuner->lock);
+	if (err)
+		goto err_free_tuner;
+
+	tuner->target_us = latency_us;
+	tuner->sample_rate = sample_rate;
+
+	/* A sample waits in the kernel until its block is full, then until
+	 * it is dequeued: keep the blocks at most half the latency target. */
+	tuner->max_samples = (size_t) (sample_rate * (double) latency_us
+				       / 2000000.0);
+	if (!tuner->max_samples)
+		tuner->max_samples = 1;
+
+	tuner->min_samples = tuner->max_samples / 16;
+	if (!tuner->min_samples)
+		tuner->min_samples = 1;
+
+	samples_count = tuner->max_samples / 2;
+	if (samples_count < tuner->min_samples)
+		samples_count = tuner->min_samples;
+
+	stream = iio_buffer_create_stream(buffer, IIO_STREAM_INIT_BLOCKS,
+					  samples_count);
+	err = iio_err(stream);
+	if (err)
+		goto err_destroy_mutex;
+
+	tuner->block_us = iio_stream_block_us(tuner, samples_count);
+	tuner->stats.nb_blocks = IIO_STREAM_INIT_BLOCKS;
+	tuner->stats.samples_count = samples_count;
+	tuner->stats.block_duration_us = tuner->block_us;
+
+	stream->tuner = tuner;
 
 	return stream;
 
-err_free_stream_blocks:
-	for (i = 0; i < nb_blocks; i++)
-		if (stream->blocks[i])
-			iio_block_destroy(stream->blocks[i]);
-	free(stream->blocks);
-err_free_stream:
-	free(stream);
+err_destroy_mutex:
+	iio_mutex_destroy(tuner->lock);
+err_free_tuner:
+	free(tuner);
 	return iio_ptr(err);
 }
 
 void iio_stream_destroy(struct iio_stream *stream)
 {
-	size_t i;
+	iio_stream_free_blocks(stream);
+
+	if (stream->tuner) {
+		iio_mutex_destroy(stream->tuner->lock);
+		free(stream->tuner);
+	}
 
-	for (i = 0; i < stream->nb_blocks; i++)
-		if (stream->blocks[i])
-			iio_block_destroy(stream->blocks[i]);
-	free(stream->blocks);
 	free(stream);
 }
 
+static int iio_stream_cmp_u64(const void *p1, const void *p2)
+{
+	uint64_t a = *(const uint64_t *) p1, b = *(const uint64_t *) p2;
+
+	return (a > b) - (a < b);
+}
+
+/* Called at the end of each window. Grow the queue or the blocks when the
+ * application fell behind, and shrink the blocks, then the queue, when it
+ * kept up for long enough. */
+static void iio_stream_tune(struct iio_stream *stream)
+{
+	struct iio_stream_tuner *tuner = stream->tuner;
+	size_t nb_blocks = tuner->stats.nb_blocks;
+	size_t samples_count = tuner->stats.samples_count;
+	uint64_t median, max, headroom;
+
+	qsort(tuner->lateness, tuner->nb_lateness, sizeof(*tuner->lateness),
+	      iio_stream_cmp_u64);
+
+	median = tuner->lateness[tuner->nb_lateness / 2];
+	max = tuner->lateness[tuner->nb_lateness - 1];
+	tuner->nb_lateness = 0;
+
+	/* Past that lateness, the kernel runs out of blocks */
+	headroom = (nb_blocks - 1) * tuner->block_us;
+
+	if (max * 2 > headroom) {
+		tuner->calm_windows = 0;
+
+		if (median * 2 > tuner->block_us
+		    && samples_count * 2 <= tuner->max_samples) {
+			/* Steadily late: the per-block overhead is too high */
+			tuner->floor_samples = samples_count;
+			samples_count *= 2;
+		} else if (nb_blocks < IIO_STREAM_MAX_BLOCKS) {
+			/* Occasionally late: absorb the jitter */
+			nb_blocks *= 2;
+		} else if (samples_count * 2 <= tuner->max_samples) {
+			tuner->floor_samples = samples_count;
+			samples_count *= 2;
+		}
+	} else if (max * 4 < tuner->block_us
+		   && ++tuner->calm_windows >= IIO_STREAM_TUNE_CALM) {
+		tuner->calm_windows = 0;
+
+		if (samples_count / 2 >= tuner->min_samples
+		    && samples_count / 2 > tuner->floor_samples)
+			samples_count /= 2;
+		else if (nb_blocks / 2 >= IIO_STREAM_MIN_BLOCKS)
+			nb_blocks /= 2;
+	}
+
+	if (nb_blocks > IIO_STREAM_MAX_BLOCKS)
+		nb_blocks = IIO_STREAM_MAX_BLOCKS;
+	if (nb_blocks < IIO_STREAM_MIN_BLOCKS)
+		nb_blocks = IIO_STREAM_MIN_BLOCKS;
+
+	tuner->retune = nb_blocks != tuner->stats.nb_blocks
+		|| samples_count != tuner->stats.samples_count;
+
+	if (tuner->retune) {
+		iio_mutex_lock(tuner->lock);
+		tuner->stats.nb_blocks = nb_blocks;
+		tuner->stats.samples_count = samples_count;
+		iio_mutex_unlock(tuner->lock);
+	}
+}
+
+/* Record the lateness of the block just dequeued, i.e. the time elapsed since
+ * the kernel filled it. */
+static void iio_stream_measure(struct iio_stream *stream, uint64_t start)
+{
+	struct iio_stream_tuner *tuner = stream->tuner;
+	uint64_t now = iio_read_counter_us(), expected, lateness = 0;
+
+	tuner->nb_since_anchor++;
+	expected = tuner->anchor_us + tuner->nb_since_anchor * tuner->block_us;
+
+	if (!tuner->anchor_us || now - start > tuner->block_us / 8
+	    || now < expected) {
+		/* The block has just been filled */
+		tuner->anchor_us = now;
+		tuner->nb_since_anchor = 0;
+	} else {
+		lateness = now - expected;
+	}
+
+	tuner->lateness[tuner->nb_lateness++] = lateness;
+
+	iio_mutex_lock(tuner->lock);
+
+	/* The oldest sample of the block waited for the whole block */
+	tuner->history[tuner->history_pos] = tuner->block_us + lateness;
+	tuner->history_pos = (tuner->history_pos + 1) % IIO_STREAM_TUNE_HISTORY;
+	if (tuner->history_len < IIO_STREAM_TUNE_HISTORY)
+		tuner->history_len++;
+
+	if (lateness > tuner->block_us)
+		tuner->stats.late_blocks++;
+
+	iio_mutex_unlock(tuner->lock);
+
+	if (tuner->nb_lateness == IIO_STREAM_TUNE_WINDOW)
+		iio_stream_tune(stream);
+}
+
+/* Recreate the blocks with the parameters picked by the tuner. The samples
+ * captured in the meantime are lost. */
+static int iio_stream_retune(struct iio_stream *stream)
+{
+	struct iio_stream_tuner *tuner = stream->tuner;
+	int err;
+
+	tuner->retune = false;
+
+	if (stream->buf_enabled) {
+		err = iio_buffer_disable(stream->buffer);
+		if (err)
+			return err;
+	}
+
+	iio_stream_free_blocks(stream);
+
+	stream->started = false;
+	stream->buf_enabled = false;
+	stream->all_enqueued = false;
+	stream->curr = 0;
+
+	err = iio_stream_alloc_blocks(stream, tuner->stats.nb_blocks,
+				      tuner->stats.samples_count);
+	if (err) {
+		/* Try again on the next call */
+		tuner->retune = true;
+		return err;
+	}
+
+	tuner->block_us = iio_stream_block_us(tuner,
+					      tuner->stats.samples_count);
+	tuner->anchor_us = 0;
+	tuner->nb_since_anchor = 0;
+
+	iio_mutex_lock(tuner->lock);
+	tuner->stats.block_duration_us = tuner->block_us;
+	tuner->stats.retunes++;
+	tuner->history_len = 0;
+	tuner->history_pos = 0;
+	iio_mutex_unlock(tuner->lock);
+
+	dev_dbg(stream->buffer->dev, "Stream retuned: %zu blocks of %zu samples\n",
+		tuner->stats.nb_blocks, tuner->stats.samples_count);
+
+	return 0;
+}
+
+int iio_stream_get_latency_stats(const struct iio_stream *stream,
+				 struct iio_stream_latency_stats *stats)
+{
+	struct iio_stream_tuner *tuner = stream->tuner;
+	uint64_t history[IIO_STREAM_TUNE_HISTORY];
+	unsigned int len;
+
+	if (!tuner)
+		return -EINVAL;
+
+	iio_mutex_lock(tuner->lock);
+	*stats = tuner->stats;
+	len = tuner->history_len;
+	memcpy(history, tuner->history, len * sizeof(*history));
+	iio_mutex_unlock(tuner->lock);
+
+	if (!len) {
+		stats->p50_us = stats->p90_us = stats->p99_us = stats->max_us = 0;
+		return 0;
+	}
+
+	qsort(history, len, sizeof(*history), iio_stream_cmp_u64);
+
+	stats->p50_us = history[len * 50 / 100];
+	stats->p90_us = history[len * 90 / 100];
+	stats->p99_us = history[len * 99 / 100];
+	stats->max_us = history[len - 1];
+
+	return 0;
+}
+
 const struct iio_block *
 iio_stream_get_next_block(struct iio_stream *stream)
 {
 	const struct iio_device *dev = stream->buffer->dev;
 	bool is_tx = iio_device_is_tx(dev);
+	uint64_t start = 0;
 	unsigned int i;
 	int err;
 
+	if (stream->tuner && stream->tuner->retune) {
+		err = iio_stream_retune(stream);
+		if (err) {
+			dev_perror(dev, err, "Unable to retune stream");
+			return iio_ptr(err);
+		}
+	}
+
 	if (!stream->started) {
 		for (i = 1; !is_tx && i < stream->nb_blocks; i++) {
 			err = iio_block_enqueue(stream->blocks[i], 0, false);
@@ -125,11 +459,17 @@ iio_stream_get_next_block(struct iio_stream *stream)
 
 	stream->all_enqueued |= stream->curr == 0;
 	if (stream->all_enqueued) {
+		if (stream->tuner)
+			start = iio_read_counter_us();
+
 		err = iio_block_dequeue(stream->blocks[stream->curr], false);
 		if (err < 0) {
 			dev_perror(dev, err, "Unable to dequeue block");
 			return iio_ptr(err);
 		}
+
+		if (stream->tuner)
+			iio_stream_measure(stream, start);
 	}
 
 	return stream->blocks[stream->curr];
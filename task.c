@@ -32,6 +32,13 @@ struct iio_task {
 	int (*fn)(void *, void *);
 	void *firstarg;
 
+	/* Batch mode */
+	void (*batch_fn)(void *, void **, int *, unsigned int);
+	unsigned int batch_max;
+	struct iio_task_token **batch;
+	void **batch_elms;
+	int *batch_rets;
+
 	struct iio_task_token *list;
 	bool running, stop;
 };
@@ -43,10 +50,47 @@ static void iio_task_token_destroy(struct iio_task_token *token)
 	free(token);
 }
 
+static void iio_task_complete(struct iio_task_token *entry, int ret)
+{
+	bool autoclear;
+
+	entry->ret = ret;
+
+	iio_mutex_lock(entry->done_lock);
+	entry->done = true;
+	autoclear = entry->autoclear;
+	iio_cond_signal(entry->done_cond);
+	iio_mutex_unlock(entry->done_lock);
+
+	if (autoclear)
+		iio_task_token_destroy(entry);
+}
+
+static void iio_task_process_batch(struct iio_task *task)
+{
+	unsigned int i, nb;
+
+	for (nb = 0; task->list && nb < task->batch_max; nb++) {
+		task->batch[nb] = task->list;
+		task->batch_elms[nb] = task->list->elm;
+		task->batch_rets[nb] = 0;
+		task->list = task->list->next;
+	}
+
+	iio_mutex_unlock(task->lock);
+
+	task->batch_fn(task->firstarg, task->batch_elms, task->batch_rets, nb);
+
+	for (i = 0; i < nb; i++)
+		iio_task_complete(task->batch[i], task->batch_rets[i]);
+
+	iio_mutex_lock(task->lock);
+}
+
 static void iio_task_process(struct iio_task *task)
 {
 	struct iio_task_token *entry;
-	bool autoclear;
+	int ret;
 
 	/* Signal that we're idle */
 	iio_cond_signal(task->cond);
@@ -63,20 +107,17 @@ static void iio_task_process(struct iio_task *task)
 	if (task->stop)
 		return;
 
+	if (task->batch_fn) {
+		iio_task_process_batch(task);
+		return;
+	}
+
 	entry = task->list;
 	task->list = entry->next;
 	iio_mutex_unlock(task->lock);
 
-	entry->ret = task->fn(task->firstarg, entry->elm);
-
-	iio_mutex_lock(entry->done_lock);
-	entry->done = true;
-	autoclear = entry->autoclear;
-	iio_cond_signal(entry->done_cond);
-	iio_mutex_unlock(entry->done_lock);
-
-	if (autoclear)
-		iio_task_token_destroy(entry);
+	ret = task->fn(task->firstarg, entry->elm);
+	iio_task_complete(entry, ret);
 
 	iio_mutex_lock(task->lock);
 }
@@ -95,8 +136,10 @@ static int iio_task_run(void *d)
 	return 0;
 }
 
-struct iio_task * iio_task_create(int (*fn)(void *, void *),
-				  void *firstarg, const char *name)
+static struct iio_task *
+iio_task_do_create(int (*fn)(void *, void *),
+		   void (*batch_fn)(void *, void **, int *, unsigned int),
+		   unsigned int batch_max, void *firstarg, const char *name)
 {
 	struct iio_task *task;
 	int err = -ENOMEM;
@@ -105,10 +148,18 @@ struct iio_task * iio_task_create(int (*fn)(void *, void *),
 	if (!task)
 		return iio_ptr(-ENOMEM);
 
+	if (batch_fn) {
+		task->batch = calloc(batch_max, sizeof(*task->batch));
+		task->batch_elms = calloc(batch_max, sizeof(*task->batch_elms));
+		task->batch_rets = calloc(batch_max, sizeof(*task->batch_rets));
+		if (!task->batch || !task->batch_elms || !task->batch_rets)
+			goto err_free_batch;
+	}
+
 	task->lock = iio_mutex_create();
 	err = iio_err(task->lock);
 	if (err)
-		goto err_free_task;
+		goto err_free_batch;
 
 	task->cond = iio_cond_create();
 	err = iio_err(task->cond);
@@ -116,6 +167,8 @@ struct iio_task * iio_task_create(int (*fn)(void *, void *),
 		goto err_free_lock;
 
 	task->fn = fn;
+	task->batch_fn = batch_fn;
+	task->batch_max = batch_max;
 	task->firstarg = firstarg;
 
 	if (!NO_THREADS) {
@@ -131,11 +184,30 @@ err_free_cond:
 	iio_cond_destroy(task->cond);
 err_free_lock:
 	iio_mutex_destroy(task->lock);
-err_free_task:
+err_free_batch:
+	free(task->batch_rets);
+	free(task->batch_elms);
+	free(task->batch);
 	free(task);
 	return iio_ptr(err);
 }
 
+struct iio_task * iio_task_create(int (*fn)(void *, void *),
+				  void *firstarg, const char *name)
+{
+	return iio_task_do_create(fn, NULL, 0, firstarg, name);
+}
+
+struct iio_task *
+iio_task_create_batch(void (*fn)(void *, void **, int *, unsigned int),
+		      unsigned int max, void *firstarg, const char *name)
+{
+	if (!fn || !max)
+		return iio_ptr(-EINVAL);
+
+	return iio_task_do_create(NULL, fn, max, firstarg, name);
+}
+
 static struct iio_task_token *
 iio_task_do_enqueue(struct iio_task *task, void *elm, bool autoclear)
 {
@@ -267,6 +339,9 @@ int iio_task_destroy(struct iio_task *task)
 
 	iio_cond_destroy(task->cond);
 	iio_mutex_destroy(task->lock);
+	free(task->batch_rets);
+	free(task->batch_elms);
+	free(task->batch);
 	free(task);
 
 	return ret;
@@ -25,6 +25,17 @@
 /* Endpoint for non-streaming operations */
 #define EP_OPS		1
 
+/*
+ * If the size of the data to transfer is too big, the
+ * IOCTL_USBFS_SUBMITURB ioctl (called by libusb) might fail with
+ * errno set to ENOMEM, as the kernel might use contiguous allocation
+ * for the URB if the driver doesn't support scatter-gather.
+ * To prevent that, we use URBs of 1 MiB maximum, and keep up to
+ * USB_MAX_URBS of them in flight for big transfers.
+ */
+#define USB_MAX_URB_SIZE	(1 * 1024 * 1024)
+#define USB_MAX_URBS		8
+
 #define IIO_INTERFACE_NAME	"IIO"
 
 struct iio_usb_ep_couple {
@@ -41,7 +52,8 @@ struct iiod_client_pdata {
 
 	struct iio_mutex *lock;
 	bool cancelled;
-	struct libusb_transfer *transfer;
+	struct libusb_transfer *transfers[USB_MAX_URBS];
+	unsigned int nb_transfers;
 
 	struct iio_context_pdata *ctx_pdata;
 };
@@ -57,6 +69,9 @@ struct iio_context_pdata {
 	struct iio_usb_ep_couple *io_endpoints;
 	uint16_t nb_ep_couples;
 
+	/* Number of pipes each RX buffer is spread over */
+	unsigned int nb_stripes;
+
 	struct iiod_client_pdata io_ctx;
 };
 
@@ -64,6 +79,10 @@ struct iio_buffer_pdata {
 	struct iiod_client_pdata io_ctx;
 	const struct iio_device *dev;
 	struct iiod_client_buffer_pdata *pdata;
+
+	/* Additional pipes the blocks are spread over */
+	struct iiod_client_pdata *stripes;
+	unsigned int nb_stripes;
 };
 
 static const unsigned int libusb_to_errno_codes[] = {
@@ -222,21 +241,10 @@ static int usb_reserve_ep_unlocked(const struct iio_device *dev,
 	return -EBUSY;
 }
 
-static void usb_free_ep_unlocked(const struct iio_device *dev)
+static void usb_free_ep_unlocked(struct iio_usb_ep_couple *ep)
 {
-	const struct iio_context *ctx = iio_device_get_context(dev);
-	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
-	unsigned int i;
-
-	for (i = 0; i < pdata->nb_ep_couples; i++) {
-		struct iio_usb_ep_couple *ep = &pdata->io_endpoints[i];
-
-		if (ep->dev == dev) {
-			ep->in_use = false;
-			ep->dev = NULL;
-			return;
-		}
-	}
+	ep->in_use = false;
+	ep->dev = NULL;
 }
 
 static const struct iiod_client_ops usb_iiod_client_ops = {
@@ -376,10 +384,14 @@ static int iio_usb_match_device(struct libusb_device *dev,
 
 static void usb_cancel(struct iiod_client_pdata *io_ctx)
 {
+	unsigned int i;
+
 	iio_mutex_lock(io_ctx->lock);
 
-	if (io_ctx->transfer && !io_ctx->cancelled)
-		libusb_cancel_transfer(io_ctx->transfer);
+	if (!io_ctx->cancelled) {
+		for (i = 0; i < io_ctx->nb_transfers; i++)
+			libusb_cancel_transfer(io_ctx->transfers[i]);
+	}
 	io_ctx->cancelled = true;
 
 	iio_mutex_unlock(io_ctx->lock);
@@ -387,6 +399,11 @@ static void usb_cancel(struct iiod_client_pdata *io_ctx)
 
 static void usb_cancel_buffer(struct iio_buffer_pdata *pdata)
 {
+	unsigned int i;
+
+	for (i = 0; i < pdata->nb_stripes; i++)
+		usb_cancel(&pdata->stripes[i]);
+
 	usb_cancel(&pdata->io_ctx);
 }
 
@@ -402,71 +419,149 @@ usb_writebuf(struct iio_buffer_pdata *pdata, const void *src, size_t len)
 	return iiod_client_writebuf(pdata->pdata, src, len);
 }
 
-static struct iio_buffer_pdata *
-usb_create_buffer(const struct iio_device *dev, unsigned int idx,
-		  struct iio_channels_mask *mask)
+/* Reserve an endpoint couple, open its pipe and create an IIOD client on it.
+ * Must be called with the endpoint lock held. */
+static int usb_open_buffer_pipe(const struct iio_device *dev,
+				struct iiod_client_pdata *io_ctx)
 {
 	const struct iio_context *ctx = iio_device_get_context(dev);
 	const struct iio_context_params *params = iio_context_get_params(ctx);
 	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(ctx);
-	struct iio_buffer_pdata *buf;
 	int ret;
 
-	buf = zalloc(sizeof(*buf));
-	if (!buf)
-		return iio_ptr(-ENOMEM);
-
-	ret = usb_io_context_init(&buf->io_ctx);
+	ret = usb_io_context_init(io_ctx);
 	if (ret)
-		goto err_free_buf;
-
-	iio_mutex_lock(ctx_pdata->ep_lock);
+		return ret;
 
-	buf->dev = dev;
-	buf->io_ctx.cancelled = false;
-	buf->io_ctx.ctx_pdata = ctx_pdata;
+	io_ctx->cancelled = false;
+	io_ctx->ctx_pdata = ctx_pdata;
 
-	ret = usb_reserve_ep_unlocked(dev, &buf->io_ctx);
+	ret = usb_reserve_ep_unlocked(dev, io_ctx);
 	if (ret)
-		goto err_unlock;
+		goto err_io_context_exit;
 
-	ret = usb_open_pipe(ctx_pdata, buf->io_ctx.ep->pipe_id);
+	ret = usb_open_pipe(ctx_pdata, io_ctx->ep->pipe_id);
 	if (ret) {
 		dev_perror(dev, ret, "Failed to open pipe");
 		goto err_free_ep;
 	}
 
-	buf->io_ctx.iiod_client = iiod_client_new(params, &buf->io_ctx,
-						  &usb_iiod_client_ops);
-	ret = iio_err(buf->io_ctx.iiod_client);
+	io_ctx->iiod_client = iiod_client_new(params, io_ctx,
+					      &usb_iiod_client_ops);
+	ret = iio_err(io_ctx->iiod_client);
 	if (ret) {
 		dev_perror(dev, ret, "Failed to created iiod-client");
 		goto err_close_pipe;
 	}
 
+	return 0;
+
+err_close_pipe:
+	usb_close_pipe(ctx_pdata, io_ctx->ep->pipe_id);
+err_free_ep:
+	usb_free_ep_unlocked(io_ctx->ep);
+err_io_context_exit:
+	usb_io_context_exit(io_ctx);
+	return ret;
+}
+
+static void usb_close_buffer_pipe(struct iiod_client_pdata *io_ctx)
+{
+	struct iio_context_pdata *ctx_pdata = io_ctx->ctx_pdata;
+
+	iio_mutex_lock(ctx_pdata->ep_lock);
+	usb_close_pipe(ctx_pdata, io_ctx->ep->pipe_id);
+	usb_free_ep_unlocked(io_ctx->ep);
+	iio_mutex_unlock(ctx_pdata->ep_lock);
+
+	iiod_client_destroy(io_ctx->iiod_client);
+
+	usb_io_context_exit(io_ctx);
+}
+
+/* Spread the buffer's blocks over as many additional pipes as requested and
+ * available. Must be called with the endpoint lock held. */
+static void usb_add_buffer_stripes(struct iio_buffer_pdata *buf)
+{
+	struct iio_context_pdata *ctx_pdata = buf->io_ctx.ctx_pdata;
+	struct iiod_client_pdata *io_ctx;
+	unsigned int i;
+	int ret;
+
+	if (ctx_pdata->nb_stripes <= 1)
+		return;
+
+	buf->stripes = calloc(ctx_pdata->nb_stripes - 1, sizeof(*buf->stripes));
+	if (!buf->stripes)
+		return;
+
+	for (i = 0; i < ctx_pdata->nb_stripes - 1; i++) {
+		io_ctx = &buf->stripes[i];
+
+		ret = usb_open_buffer_pipe(buf->dev, io_ctx);
+		if (ret)
+			break;
+
+		ret = iiod_client_buffer_add_stripe(buf->pdata,
+						    io_ctx->iiod_client);
+		if (ret) {
+			iio_mutex_unlock(ctx_pdata->ep_lock);
+			usb_close_buffer_pipe(io_ctx);
+			iio_mutex_lock(ctx_pdata->ep_lock);
+			break;
+		}
+
+		buf->nb_stripes++;
+	}
+
+	if (buf->nb_stripes)
+		dev_dbg(buf->dev, "Buffer spread over %u pipes\n",
+			buf->nb_stripes + 1);
+}
+
+static struct iio_buffer_pdata *
+usb_create_buffer(const struct iio_device *dev, unsigned int idx,
+		  struct iio_channels_mask *mask)
+{
+	const struct iio_context *ctx = iio_device_get_context(dev);
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(ctx);
+	struct iio_buffer_pdata *buf;
+	int ret;
+
+	buf = zalloc(sizeof(*buf));
+	if (!buf)
+		return iio_ptr(-ENOMEM);
+
+	buf->dev = dev;
+
+	iio_mutex_lock(ctx_pdata->ep_lock);
+
+	ret = usb_open_buffer_pipe(dev, &buf->io_ctx);
+	if (ret)
+		goto err_unlock;
+
 	buf->pdata = iiod_client_create_buffer(buf->io_ctx.iiod_client,
 					       ctx_pdata->io_ctx.iiod_client,
 					       dev, idx, mask);
 	ret = iio_err(buf->pdata);
 	if (ret) {
 		dev_perror(dev, ret, "Unable to create iiod-client buffer");
-		goto err_free_iiod_client;
+		goto err_close_pipe;
 	}
 
+	usb_add_buffer_stripes(buf);
+
 	iio_mutex_unlock(ctx_pdata->ep_lock);
 
 	return buf;
 
-err_free_iiod_client:
-	iiod_client_destroy(buf->io_ctx.iiod_client);
 err_close_pipe:
-	usb_close_pipe(ctx_pdata, buf->io_ctx.ep->pipe_id);
-err_free_ep:
-	usb_free_ep_unlocked(dev);
+	iio_mutex_unlock(ctx_pdata->ep_lock);
+	usb_close_buffer_pipe(&buf->io_ctx);
+	free(buf);
+	return iio_ptr(ret);
 err_unlock:
 	iio_mutex_unlock(ctx_pdata->ep_lock);
-	usb_io_context_exit(&buf->io_ctx);
-err_free_buf:
 	free(buf);
 
 	return iio_ptr(ret);
@@ -474,19 +569,16 @@ err_free_buf:
 
 static void usb_free_buffer(struct iio_buffer_pdata *buf)
 {
-	const struct iio_context *ctx = iio_device_get_context(buf->dev);
-	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(ctx);
+	unsigned int i;
 
 	iiod_client_free_buffer(buf->pdata);
 
-	iio_mutex_lock(ctx_pdata->ep_lock);
-	usb_close_pipe(ctx_pdata, buf->io_ctx.ep->pipe_id);
-	usb_free_ep_unlocked(buf->dev);
-	iio_mutex_unlock(ctx_pdata->ep_lock);
+	for (i = 0; i < buf->nb_stripes; i++)
+		usb_close_buffer_pipe(&buf->stripes[i]);
 
-	iiod_client_destroy(buf->io_ctx.iiod_client);
+	usb_close_buffer_pipe(&buf->io_ctx);
 
-	usb_io_context_exit(&buf->io_ctx);
+	free(buf->stripes);
 	free(buf);
 }
 
@@ -502,6 +594,20 @@ usb_create_block(struct iio_buffer_pdata *pdata, size_t size, void **data)
 	return iiod_client_create_block(pdata->pdata, size, data);
 }
 
+static struct iio_block_pdata *
+usb_create_block_from_memory(struct iio_buffer_pdata *pdata,
+			     void *ptr, size_t size)
+{
+	return iiod_client_create_block_from_memory(pdata->pdata, ptr, size);
+}
+
+static void
+usb_set_block_allocator(struct iio_buffer_pdata *pdata,
+			struct iio_block_allocator *alloc)
+{
+	iiod_client_set_block_allocator(pdata->pdata, alloc);
+}
+
 static struct iio_event_stream_pdata *
 usb_open_events_fd(const struct iio_device *dev)
 {
@@ -531,12 +637,16 @@ static const struct iio_backend_ops usb_ops = {
 
 	.create_block = usb_create_block,
 	.free_block = iiod_client_free_block,
+	.set_block_allocator = usb_set_block_allocator,
+	.create_block_from_memory = usb_create_block_from_memory,
 	.enqueue_block = iiod_client_enqueue_block,
 	.dequeue_block = iiod_client_dequeue_block,
 
 	.open_ev = usb_open_events_fd,
 	.close_ev = iiod_client_close_event_stream,
 	.read_ev = iiod_client_read_event,
+	.read_ev_many = iiod_client_read_events,
+	.get_ev_overflows = iiod_client_get_event_overflows,
 };
 
 __api_export_if(WITH_USB_BACKEND_DYNAMIC)
@@ -548,10 +658,58 @@ const struct iio_backend iio_usb_backend = {
 	.default_timeout_ms = 5000,
 };
 
+struct usb_sync_transfer {
+	struct libusb_transfer *transfers[USB_MAX_URBS];
+	unsigned int nb, pending;
+	int completed;
+
+	/* The callbacks may run in any thread handling libusb events */
+	struct iio_mutex *lock;
+};
+
 static void LIBUSB_CALL sync_transfer_cb(struct libusb_transfer *transfer)
 {
-	int *completed = transfer->user_data;
-	*completed = 1;
+	struct usb_sync_transfer *sync = transfer->user_data;
+	struct iio_mutex *lock = sync->lock;
+	unsigned int i;
+
+	iio_mutex_lock(lock);
+
+	/* A short or failed transfer ends the data stream: cancel the
+	 * following ones, which would otherwise receive the next message. */
+	if (transfer->status != LIBUSB_TRANSFER_COMPLETED
+	    || transfer->actual_length < transfer->length) {
+		for (i = 0; sync->transfers[i] != transfer; i++);
+
+		for (i++; i < sync->nb; i++)
+			libusb_cancel_transfer(sync->transfers[i]);
+	}
+
+	/* Once completed is set, the waiter may return and 'sync' go out of
+	 * scope: it must not be accessed anymore. The waiter takes the lock
+	 * before returning, so it waits for the unlock below. */
+	if (!--sync->pending)
+		sync->completed = 1;
+
+	iio_mutex_unlock(lock);
+}
+
+static int usb_transfer_status_to_errno(enum libusb_transfer_status status)
+{
+	switch (status) {
+	case LIBUSB_TRANSFER_COMPLETED:
+		return 0;
+	case LIBUSB_TRANSFER_TIMED_OUT:
+		return -ETIMEDOUT;
+	case LIBUSB_TRANSFER_STALL:
+		return -EPIPE;
+	case LIBUSB_TRANSFER_NO_DEVICE:
+		return -ENODEV;
+	case LIBUSB_TRANSFER_CANCELLED:
+		return -EBADF;
+	default:
+		return -EIO;
+	}
 }
 
 static int usb_sync_transfer(struct iio_context_pdata *pdata,
@@ -559,21 +717,21 @@ static int usb_sync_transfer(struct iio_context_pdata *pdata,
 			     unsigned int ep_type, char *data, size_t len,
 			     int *transferred, unsigned int timeout_ms)
 {
+	struct usb_sync_transfer sync = { .lock = io_ctx->lock };
+	struct libusb_transfer *transfer;
+	unsigned int i, nb;
 	unsigned char ep;
-	struct libusb_transfer *transfer = NULL;
-	int completed = 0;
-	int ret;
+	size_t chunk;
+	int ret = 0, err = 0;
 
-	/*
-	 * If the size of the data to transfer is too big, the
-	 * IOCTL_USBFS_SUBMITURB ioctl (called by libusb) might fail with
-	 * errno set to ENOMEM, as the kernel might use contiguous allocation
-	 * for the URB if the driver doesn't support scatter-gather.
-	 * To prevent that, we support URBs of 1 MiB maximum. The iiod-client
-	 * code will handle this properly and ask for a new transfer.
-	 */
-	if (len > 1 * 1024 * 1024)
-		len = 1 * 1024 * 1024;
+	/* Anything above the max. number of URBs in flight will be requested
+	 * by the iiod-client code in a new transfer. */
+	if (len > USB_MAX_URBS * USB_MAX_URB_SIZE)
+		len = USB_MAX_URBS * USB_MAX_URB_SIZE;
+
+	nb = (unsigned int)((len + USB_MAX_URB_SIZE - 1) / USB_MAX_URB_SIZE);
+	if (!nb)
+		nb = 1;
 
 	if (ep_type == LIBUSB_ENDPOINT_IN)
 		ep = io_ctx->ep->addr_in;
@@ -583,8 +741,8 @@ static int usb_sync_transfer(struct iio_context_pdata *pdata,
 	/*
 	 * For cancellation support the check whether the buffer has already been
 	 * cancelled and the allocation as well as the assignment of the new
-	 * transfer needs to happen in one atomic step. Otherwise it is possible
-	 * that the cancellation is missed and transfer is not aborted.
+	 * transfers needs to happen in one atomic step. Otherwise it is possible
+	 * that the cancellation is missed and transfers are not aborted.
 	 */
 	iio_mutex_lock(io_ctx->lock);
 	if (io_ctx->cancelled) {
@@ -592,71 +750,110 @@ static int usb_sync_transfer(struct iio_context_pdata *pdata,
 		goto unlock;
 	}
 
-	transfer = libusb_alloc_transfer(0);
-	if (!transfer) {
-		ret = -ENOMEM;
-		goto unlock;
+	for (i = 0; i < nb; i++) {
+		sync.transfers[i] = libusb_alloc_transfer(0);
+		if (!sync.transfers[i]) {
+			ret = -ENOMEM;
+			goto err_free_transfers;
+		}
 	}
 
-	transfer->user_data = &completed;
+	/* Queue all the URBs at once, so that the bus never idles between
+	 * two of them. The lock is held, so the callbacks of the first URBs
+	 * cannot complete before all of them are submitted. */
+	for (i = 0; i < nb; i++) {
+		chunk = len > USB_MAX_URB_SIZE ? USB_MAX_URB_SIZE : len;
 
-	libusb_fill_bulk_transfer(transfer, pdata->hdl, ep,
-			(unsigned char *) data, (int) len, sync_transfer_cb,
-			&completed, timeout_ms);
-	transfer->type = LIBUSB_TRANSFER_TYPE_BULK;
+		libusb_fill_bulk_transfer(sync.transfers[i], pdata->hdl, ep,
+				(unsigned char *) data, (int) chunk,
+				sync_transfer_cb, &sync, timeout_ms);
+		sync.transfers[i]->type = LIBUSB_TRANSFER_TYPE_BULK;
 
-	ret = libusb_submit_transfer(transfer);
-	if (ret) {
-		ret = -(int) libusb_to_errno(ret);
-		libusb_free_transfer(transfer);
-		goto unlock;
+		ret = libusb_submit_transfer(sync.transfers[i]);
+		if (ret) {
+			err = -(int) libusb_to_errno(ret);
+			break;
+		}
+
+		sync.nb++;
+		sync.pending++;
+		data += chunk;
+		len -= chunk;
 	}
 
-	io_ctx->transfer = transfer;
-unlock:
+	/* If a submission failed, wait for the URBs already in flight */
+	if (err) {
+		for (i = 0; i < sync.nb; i++)
+			libusb_cancel_transfer(sync.transfers[i]);
+	}
+
+	if (!sync.nb) {
+		ret = err;
+		goto err_free_transfers;
+	}
+
+	for (i = 0; i < sync.nb; i++)
+		io_ctx->transfers[i] = sync.transfers[i];
+	io_ctx->nb_transfers = sync.nb;
 	iio_mutex_unlock(io_ctx->lock);
-	if (ret)
-		return ret;
 
-	while (!completed) {
-		ret = libusb_handle_events_completed(pdata->ctx, &completed);
+	while (!sync.completed) {
+		ret = libusb_handle_events_completed(pdata->ctx, &sync.completed);
 		if (ret < 0) {
 			if (ret == LIBUSB_ERROR_INTERRUPTED)
 				continue;
-			libusb_cancel_transfer(transfer);
+			for (i = 0; i < sync.nb; i++)
+				libusb_cancel_transfer(sync.transfers[i]);
 			continue;
 		}
 	}
 
-	switch (transfer->status) {
-	case LIBUSB_TRANSFER_COMPLETED:
-		*transferred = transfer->actual_length;
-		ret = 0;
-		break;
-	case LIBUSB_TRANSFER_TIMED_OUT:
-		ret = -ETIMEDOUT;
-		break;
-	case LIBUSB_TRANSFER_STALL:
-		ret = -EPIPE;
-		break;
-	case LIBUSB_TRANSFER_NO_DEVICE:
-		ret = -ENODEV;
-		break;
-	case LIBUSB_TRANSFER_CANCELLED:
-		ret = -EBADF;
-		break;
-	default:
-		ret = -EIO;
-		break;
-	}
-
-	/* Same as above. This needs to be atomic in regards to usb_cancel(). */
+	/* Same as above. This needs to be atomic in regards to usb_cancel().
+	 * Taking the lock also waits for the last callback to release it. */
 	iio_mutex_lock(io_ctx->lock);
-	io_ctx->transfer = NULL;
+	io_ctx->nb_transfers = 0;
 	iio_mutex_unlock(io_ctx->lock);
 
-	libusb_free_transfer(transfer);
+	*transferred = 0;
+
+	for (i = 0; i < sync.nb; i++) {
+		transfer = sync.transfers[i];
 
+		*transferred += transfer->actual_length;
+
+		ret = usb_transfer_status_to_errno(transfer->status);
+		if (ret) {
+			/* Report the data transferred until the error, if any */
+			if (*transferred)
+				ret = 0;
+			break;
+		}
+
+		if (transfer->actual_length < transfer->length)
+			break;
+	}
+
+	/* Data that arrived after a short transfer would be lost */
+	for (i++; i < sync.nb; i++) {
+		if (sync.transfers[i]->actual_length) {
+			ret = -EIO;
+			break;
+		}
+	}
+
+	if (err && !*transferred)
+		ret = err;
+
+	for (i = 0; i < nb; i++)
+		libusb_free_transfer(sync.transfers[i]);
+
+	return ret;
+
+err_free_transfers:
+	for (i = 0; i < nb; i++)
+		libusb_free_transfer(sync.transfers[i]);
+unlock:
+	iio_mutex_unlock(io_ctx->lock);
 	return ret;
 }
 
@@ -826,7 +1023,8 @@ usb_create_context_with_attrs(libusb_device *usb_dev,
 
 static struct iio_context * usb_create_context(const struct iio_context_params *params,
 					       unsigned int bus,
-					       uint16_t address, uint16_t intrfc)
+					       uint16_t address, uint16_t intrfc,
+					       unsigned int nb_stripes)
 {
 	libusb_context *usb_ctx;
 	libusb_device_handle *hdl = NULL;
@@ -846,6 +1044,8 @@ static struct iio_context * usb_create_context(const struct iio_context_params *
 		goto err_set_errno;
 	}
 
+	pdata->nb_stripes = nb_stripes;
+
 	pdata->ep_lock = iio_mutex_create();
 	ret = iio_err(pdata->ep_lock);
 	if (ret) {
@@ -1030,16 +1230,26 @@ static struct iio_context *
 usb_create_context_from_args(const struct iio_context_params *params,
 			     const char *args)
 {
-	long bus, address, intrfc;
+	long bus, address, intrfc, nb_stripes = 1;
 	char *end;
-	const char *ptr = args;
+	const char *ptr = args, *stripes = strchr(args, ',');
 	/* keep MSVS happy by setting these to NULL */
 	struct iio_scan *scan_ctx = NULL;
 	bool scan;
 	int err = -EINVAL;
 
+	/* An optional ",N" suffix sets the number of pipes over which the
+	 * blocks of each RX buffer are spread */
+	if (stripes) {
+		errno = 0;
+		nb_stripes = strtol(stripes + 1, &end, 10);
+		if (end == stripes + 1 || *end != '\0' || errno == ERANGE
+		    || nb_stripes < 1 || nb_stripes > IIOD_CLIENT_MAX_STRIPES + 1)
+			goto err_bad_uri;
+	}
+
 	/* if uri is just "usb:" that means search for the first one */
-	scan = !*ptr;
+	scan = !*ptr || ptr == stripes;
 	if (scan) {
 		scan_ctx = iio_scan(params, "usb");
 		if (iio_err(scan_ctx)) {
@@ -1073,7 +1283,7 @@ usb_create_context_from_args(const struct iio_context_params *params,
 	if (ptr == end || errno == ERANGE || address < 0 || address > UINT8_MAX)
 		goto err_bad_uri;
 
-	if (*end == '\0') {
+	if (*end == '\0' || *end == ',') {
 		intrfc = 0;
 	} else if (*end == '.') {
 		ptr = (const char *) ((uintptr_t) end + 1);
@@ -1082,7 +1292,7 @@ usb_create_context_from_args(const struct iio_context_params *params,
 
 		errno = 0;
 		intrfc = strtol(ptr, &end, 10);
-		if (ptr == end || *end != '\0' || errno == ERANGE || intrfc < 0 || intrfc > UINT8_MAX)
+		if (ptr == end || (*end != '\0' && *end != ',') || errno == ERANGE || intrfc < 0 || intrfc > UINT8_MAX)
 			goto err_bad_uri;
 	} else {
 		goto err_bad_uri;
@@ -1092,7 +1302,8 @@ usb_create_context_from_args(const struct iio_context_params *params,
 		iio_scan_destroy(scan_ctx);
 
 	return usb_create_context(params, (unsigned int) bus,
-			(uint16_t) address, (uint16_t) intrfc);
+			(uint16_t) address, (uint16_t) intrfc,
+			(unsigned int) nb_stripes);
 
 err_bad_uri:
 	if (scan)
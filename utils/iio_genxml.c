@@ -6,6 +6,7 @@
  * Author: Paul Cercueil <paul.cercueil@analog.com>
  * */
 
+#include <errno.h>
 #include <getopt.h>
 #include <iio/iio.h>
 #include <stdio.h>
@@ -20,6 +21,7 @@
 #endif
 
 static const struct option options[] = {
+	{"snapshot", required_argument, 0, 's'},
 	{0, 0, 0, 0},
 };
 
@@ -27,25 +29,120 @@ static const char *options_descriptions[] = {
 	("\t[-x <xml_file>]\n"
 		"\t\t\t\t[-u <uri>]\n"
 		"\t\t\t\t[-n <hostname>]"),
+	"Write the context and the values of its attributes to the given"
+		"\n\t\t\tdirectory, to be used with the replay backend.",
 };
 
+#define MY_OPTS "s:"
+
+/* Same escaping as expected by the replay backend */
+static void print_value(FILE *f, const char *value)
+{
+	for (; *value; value++) {
+		if (*value == '\\')
+			fputs("\\\\", f);
+		else if (*value == '\n')
+			fputs("\\n", f);
+		else
+			fputc(*value, f);
+	}
+
+	fputc('\n', f);
+}
+
+static void print_attr(FILE *f, const struct iio_attr *attr,
+		       const char *prefix)
+{
+	char buf[8192];
+	ssize_t ret;
+
+	ret = iio_attr_read_raw(attr, buf, sizeof(buf));
+	if (ret < 0)
+		return;
+
+	fprintf(f, "%s%s ", prefix, iio_attr_get_name(attr));
+	print_value(f, buf);
+}
+
+static int write_snapshot(const struct iio_context *ctx, const char *xml,
+			  const char *dir)
+{
+	const struct iio_device *dev;
+	const struct iio_channel *chn;
+	unsigned int i, j, k;
+	char path[4096], prefix[512];
+	const char *id;
+	FILE *f;
+	int ret;
+
+	snprintf(path, sizeof(path), "%s/context.xml", dir);
+	f = fopen(path, "w");
+	if (!f)
+		goto err_perror;
+
+	fputs(xml, f);
+	ret = fclose(f);
+	if (ret)
+		goto err_perror;
+
+	snprintf(path, sizeof(path), "%s/attributes", dir);
+	f = fopen(path, "w");
+	if (!f)
+		goto err_perror;
+
+	for (i = 0; i < iio_context_get_devices_count(ctx); i++) {
+		dev = iio_context_get_device(ctx, i);
+		id = iio_device_get_id(dev);
+
+		snprintf(prefix, sizeof(prefix), "%s/", id);
+		for (j = 0; j < iio_device_get_attrs_count(dev); j++)
+			print_attr(f, iio_device_get_attr(dev, j), prefix);
+
+		snprintf(prefix, sizeof(prefix), "%s/debug/", id);
+		for (j = 0; j < iio_device_get_debug_attrs_count(dev); j++)
+			print_attr(f, iio_device_get_debug_attr(dev, j), prefix);
+
+		for (j = 0; j < iio_device_get_channels_count(dev); j++) {
+			chn = iio_device_get_channel(dev, j);
+
+			snprintf(prefix, sizeof(prefix), "%s/%s/%s/", id,
+				 iio_channel_is_output(chn) ? "out" : "in",
+				 iio_channel_get_id(chn));
+
+			for (k = 0; k < iio_channel_get_attrs_count(chn); k++)
+				print_attr(f, iio_channel_get_attr(chn, k), prefix);
+		}
+	}
+
+	ret = fclose(f);
+	if (ret)
+		goto err_perror;
+
+	return 0;
+
+err_perror:
+	fprintf(stderr, "Unable to write %s: %s\n", path, strerror(errno));
+	return -1;
+}
+
 int main(int argc, char **argv)
 {
 	char **argw, *uri, *xml;
+	const char *snapshot_dir = NULL;
 	struct iio_context *ctx;
 	struct option *opts;
 	size_t buf_len;
 	int c, ret = EXIT_FAILURE;
 
 	argw = dup_argv(MY_NAME, argc, argv);
-	ctx = handle_common_opts(MY_NAME, argc, argw, "",
+	ctx = handle_common_opts(MY_NAME, argc, argw, MY_OPTS,
 				 options, options_descriptions, &ret);
 	opts = add_common_options(options);
 	if (!opts) {
 		fprintf(stderr, "Failed to add common options\n");
 		return EXIT_FAILURE;
 	}
-	while ((c = getopt_long(argc, argv, "+" COMMON_OPTIONS,  /* Flawfinder: ignore */
+	while ((c = getopt_long(argc, argv, "+" COMMON_OPTIONS MY_OPTS,  /* Flawfinder: ignore */
 					opts, NULL)) != -1) {
 		switch (c) {
 		/* All these are handled in the common */
@@ -60,6 +157,9 @@ int main(int argc, char **argv)
 					&& argv[optind][0] != '-')
 				optind++;
 			break;
+		case 's':
+			snapshot_dir = optarg;
+			break;
 		case '?':
 			printf("Unknown argument '%c'\n", c);
 			return EXIT_FAILURE;
@@ -77,6 +177,16 @@ int main(int argc, char **argv)
 		return ret;
 
 	xml = iio_context_get_xml(ctx);
+
+	if (snapshot_dir) {
+		ret = write_snapshot(ctx, xml, snapshot_dir);
+		iio_context_destroy(ctx);
+		free(xml);
+		free_argw(argc, argw);
+
+		return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
 	printf("XML generated:\n\n%s\n\n", xml);
 
 	buf_len = strlen(xml) + 5;
@@ -21,6 +21,10 @@
 #include <fcntl.h>
 #include <io.h>
 #else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 #endif
 
@@ -29,6 +33,7 @@
 #define MY_NAME "iio_rwdev"
 
 #define SAMPLES_PER_READ 256
+#define PLAYBACK_BLOCKS  4
 #define DEFAULT_FREQ_HZ  100
 #define REFILL_PER_BENCHMARK 10
 
@@ -41,6 +46,10 @@ static const struct option options[] = {
 	  {"write", no_argument, 0, 'w'},
 	  {"cyclic", no_argument, 0, 'c'},
 	  {"benchmark", no_argument, 0, 'B'},
+	  {"output", required_argument, 0, 'o'},
+	  {"file-size", required_argument, 0, 'F'},
+	  {"input", required_argument, 0, 'i'},
+	  {"pace", no_argument, 0, 'P'},
 	  {0, 0, 0, 0},
 };
 
@@ -56,6 +65,12 @@ static const char *options_descriptions[] = {
 	"Use cyclic buffer mode.",
 	"Benchmark throughput."
 		"\n\t\t\tStatistics will be printed on the standard input.",
+	"Record the samples to the given file, with O_DIRECT."
+		"\n\t\t\tA SigMF metadata file is written along with it.",
+	"Start a new file every N MiB when recording. Default is 0 (one file).",
+	"Play the samples from the given file, mapped in memory."
+		"\n\t\t\tWith -c, the file is played in a loop.",
+	"Pace the playback to the sample rate of the device.",
 };
 
 static struct iio_context *ctx;
@@ -196,7 +211,302 @@ static ssize_t transfer_sample(const struct iio_channel *chn,
 	return (ssize_t) nb;
 }
 
-#define MY_OPTS "t:b:s:T:r:wcB"
+/* Write the samples to disk using a iio_recorder, until the requested number
+ * of samples was recorded or the program is interrupted. */
+static void record_to_file(struct iio_device *dev, const char *path,
+			   unsigned int buffer_size, unsigned int file_size_mib)
+{
+	struct iio_recorder_params params = {
+		.path = path,
+		.file_size = (uint64_t) file_size_mib * 1024 * 1024,
+		.samples = num_samples,
+		.flags = IIO_RECORDER_DIRECT_IO | IIO_RECORDER_SIGMF,
+	};
+	struct iio_recorder_stats stats = { 0 };
+	struct iio_recorder *rec;
+	uint64_t drops = 0;
+	int ret;
+
+	rec = iio_buffer_create_recorder(buffer, 4, buffer_size, &params);
+	ret = iio_err(rec);
+	if (ret) {
+		dev_perror(dev, ret, "Unable to create recorder");
+		return;
+	}
+
+	while (app_running) {
+#ifdef _WIN32
+		Sleep(100);
+#else
+		struct timespec wait = { .tv_nsec = 100 * 1000 * 1000 };
+
+		nanosleep(&wait, NULL);
+#endif
+
+		ret = iio_recorder_get_stats(rec, &stats);
+		if (ret) {
+			dev_perror(dev, ret, "Recording failed");
+			break;
+		}
+
+		if (stats.drops != drops) {
+			fprintf(stderr, "Dropped %" PRIu64 " blocks\n",
+				stats.drops - drops);
+			drops = stats.drops;
+		}
+
+		if (stats.done) {
+			exit_code = EXIT_SUCCESS;
+			break;
+		}
+	}
+
+	iio_recorder_destroy(rec);
+
+	if (drops)
+		fprintf(stderr, "%" PRIu64 " blocks recorded, %" PRIu64
+			" blocks dropped\n", stats.blocks, drops);
+}
+
+#ifndef _WIN32
+
+static void sleep_us(uint64_t us)
+{
+	struct timespec wait = {
+		.tv_sec = (time_t) (us / 1000000),
+		.tv_nsec = (long) (us % 1000000) * 1000,
+	};
+
+	nanosleep(&wait, NULL);
+}
+
+/* Play the samples of a file mapped in memory. The blocks point straight into
+ * the mapping if a block can be created from the first slice; otherwise, the
+ * samples are copied into a fixed set of regular blocks. */
+static void play_file(struct iio_device *dev, const char *path,
+		      size_t block_size, size_t sample_size,
+		      bool loop, bool pace)
+{
+	struct iio_block *blocks[PLAYBACK_BLOCKS] = { NULL };
+	size_t size, off = 0, len, ahead, page_mask;
+	uint64_t played_us = 0, pending_us = 0, playout_end = 0, now;
+	uint64_t underruns = 0, bytes_left = UINT64_MAX;
+	unsigned int i, queued = 0, next = 0;
+	const struct iio_attr *attr;
+	bool enabled = false, zero_copy = true;
+	double rate = 0.0;
+	struct stat st;
+	char *map;
+	int fd, ret;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		perror("Unable to open input file");
+		goto out_close;
+	}
+
+	/* Only play whole samples */
+	size = (size_t) st.st_size / sample_size * sample_size;
+	if (!size) {
+		fprintf(stderr, "Input file is too small\n");
+		goto out_close;
+	}
+
+	map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		perror("Unable to map input file");
+		goto out_close;
+	}
+
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	posix_madvise(map, size, POSIX_MADV_SEQUENTIAL);
+	page_mask = ~((size_t) sysconf(_SC_PAGESIZE) - 1);
+
+	attr = iio_device_find_attr(dev, "sampling_frequency");
+	if (!attr || iio_attr_read_double(attr, &rate) < 0 || rate <= 0.0) {
+		if (pace) {
+			fprintf(stderr, "Unable to read the sample rate\n");
+			goto out_unmap;
+		}
+
+		rate = 0.0;
+	}
+
+	if (num_samples)
+		bytes_left = (uint64_t) num_samples * sample_size;
+
+	if (block_size > size)
+		block_size = size;
+
+	/* A file that fits in one block is played by the hardware */
+	if (loop && block_size == size) {
+		blocks[0] = iio_buffer_create_block_from_memory(buffer, map, size);
+		if (iio_err(blocks[0])) {
+			blocks[0] = iio_buffer_create_block(buffer, size);
+			ret = iio_err(blocks[0]);
+			if (ret) {
+				blocks[0] = NULL;
+				dev_perror(dev, ret, "Unable to create block");
+				goto out_unmap;
+			}
+
+			memcpy(iio_block_start(blocks[0]), map, size);
+		}
+
+		ret = iio_block_enqueue(blocks[0], size, true);
+		if (!ret)
+			ret = iio_buffer_enable(buffer);
+		if (ret) {
+			dev_perror(dev, ret, "Unable to start cyclic playback");
+			goto out_destroy_blocks;
+		}
+
+		while (app_running)
+			sleep_us(100000);
+
+		goto out_destroy_blocks;
+	}
+
+	while (app_running && bytes_left) {
+		len = size - off < block_size ? size - off : block_size;
+		if (len > bytes_left)
+			len = (size_t) bytes_left;
+
+		if (queued == PLAYBACK_BLOCKS) {
+			ret = iio_block_dequeue(blocks[next], false);
+			if (ret) {
+				if (app_running)
+					dev_perror(dev, ret, "Unable to dequeue block");
+				break;
+			}
+
+			queued--;
+		}
+
+		if (zero_copy && blocks[next]) {
+			iio_block_destroy(blocks[next]);
+			blocks[next] = NULL;
+		}
+
+		if (zero_copy) {
+			blocks[next] = iio_buffer_create_block_from_memory(buffer,
+									   map + off, len);
+			if (iio_err(blocks[next])) {
+				/* Fall back to copying, from the first block */
+				blocks[next] = NULL;
+				if (off || queued) {
+					dev_err(dev, "Unable to create block\n");
+					break;
+				}
+
+				zero_copy = false;
+			}
+		}
+
+		if (!blocks[next]) {
+			blocks[next] = iio_buffer_create_block(buffer, block_size);
+			ret = iio_err(blocks[next]);
+			if (ret) {
+				blocks[next] = NULL;
+				dev_perror(dev, ret, "Unable to create block");
+				break;
+			}
+		}
+
+		if (!zero_copy)
+			memcpy(iio_block_start(blocks[next]), map + off, len);
+
+		/* Have the kernel read ahead of the blocks in flight */
+		ahead = off + PLAYBACK_BLOCKS * block_size;
+		if (loop && ahead >= size)
+			ahead -= size;
+		if (ahead < size)
+			posix_madvise(map + (ahead & page_mask), block_size,
+				      POSIX_MADV_WILLNEED);
+
+		if (rate > 0.0) {
+			played_us = (uint64_t) ((double) (len / sample_size)
+						* 1000000.0 / rate);
+		}
+
+		if (rate > 0.0 && enabled) {
+			now = get_time_us();
+
+			/* Keep the queue full, but no further ahead */
+			if (pace && now < playout_end
+			    && playout_end - now > PLAYBACK_BLOCKS * played_us) {
+				sleep_us(playout_end - now
+					 - PLAYBACK_BLOCKS * played_us);
+				now = get_time_us();
+			}
+
+			/* All the samples queued were played already */
+			if (now > playout_end) {
+				underruns++;
+				playout_end = now;
+			}
+
+			playout_end += played_us;
+		} else {
+			pending_us += played_us;
+		}
+
+		ret = iio_block_enqueue(blocks[next], len, false);
+		if (ret) {
+			dev_perror(dev, ret, "Unable to enqueue block");
+			break;
+		}
+
+		queued++;
+		next = (next + 1) % PLAYBACK_BLOCKS;
+		bytes_left -= len;
+
+		off += len;
+		if (off == size) {
+			if (!loop)
+				bytes_left = 0;
+			off = 0;
+		}
+
+		/* Start the transfers once the queue is primed */
+		if (!enabled && (queued == PLAYBACK_BLOCKS || !bytes_left)) {
+			ret = iio_buffer_enable(buffer);
+			if (ret) {
+				dev_perror(dev, ret, "Unable to enable buffer");
+				break;
+			}
+
+			enabled = true;
+			playout_end = get_time_us() + pending_us;
+		}
+	}
+
+	/* Wait for the samples queued to be played */
+	for (; app_running && queued; queued--) {
+		iio_block_dequeue(blocks[next], false);
+		next = (next + 1) % PLAYBACK_BLOCKS;
+	}
+
+	if (app_running && !bytes_left)
+		exit_code = EXIT_SUCCESS;
+
+	if (underruns)
+		fprintf(stderr, "%" PRIu64 " underruns\n", underruns);
+
+out_destroy_blocks:
+	for (i = 0; i < PLAYBACK_BLOCKS; i++)
+		if (blocks[i])
+			iio_block_destroy(blocks[i]);
+out_unmap:
+	munmap(map, size);
+out_close:
+	if (fd >= 0)
+		close(fd);
+}
+
+#endif /* !_WIN32 */
+
+#define MY_OPTS "t:b:s:T:r:wcBo:F:i:P"
 
 int main(int argc, char **argv)
 {
@@ -211,6 +521,9 @@ int main(int argc, char **argv)
 	ssize_t sample_size, hw_sample_size;
 	bool hit, mib, is_write = false, cyclic_buffer = false,
 	     benchmark = false, do_write = false;
+	const char *output_file = NULL, *input_file = NULL;
+	unsigned int file_size_mib = 0;
+	bool pace = false;
 	struct iio_stream *stream;
 	const struct iio_block *block;
 	struct iio_channels_mask *mask;
@@ -285,6 +598,30 @@ int main(int argc, char **argv)
 		case 'w':
 			is_write = true;
 			break;
+		case 'o':
+			if (!optarg) {
+				fprintf(stderr, "Output requires an argument\n");
+				goto err_free_ctx;
+			}
+			output_file = optarg;
+			break;
+		case 'F':
+			if (!optarg) {
+				fprintf(stderr, "File size requires an argument\n");
+				goto err_free_ctx;
+			}
+			file_size_mib = sanitize_clamp("file size", optarg, 0, UINT_MAX);
+			break;
+		case 'i':
+			if (!optarg) {
+				fprintf(stderr, "Input requires an argument\n");
+				goto err_free_ctx;
+			}
+			input_file = optarg;
+			break;
+		case 'P':
+			pace = true;
+			break;
 		case '?':
 			printf("Unknown argument '%c'\n", c);
 			goto err_free_ctx;
@@ -311,6 +648,21 @@ int main(int argc, char **argv)
 		goto err_free_ctx;
 	}
 
+	if (output_file && (is_write || benchmark)) {
+		fprintf(stderr, "Recording to a file is only possible in RX mode.\n");
+		goto err_free_ctx;
+	}
+
+	if (input_file && (!is_write || benchmark)) {
+		fprintf(stderr, "Playing a file is only possible in TX mode.\n");
+		goto err_free_ctx;
+	}
+
+	if (pace && !input_file) {
+		fprintf(stderr, "Pacing can only be used when playing a file.\n");
+		goto err_free_ctx;
+	}
+
 	if (!ctx)
 		return ret;
 
@@ -435,9 +787,26 @@ int main(int argc, char **argv)
 		goto err_free_mask;
 	}
 
+	if (output_file) {
+		record_to_file(dev, output_file, buffer_size, file_size_mib);
+		goto err_destroy_buffer;
+	}
+
 	hw_mask = iio_buffer_get_channels_mask(buffer);
 	hw_sample_size = iio_device_get_sample_size(dev, hw_mask);
 
+	if (input_file) {
+		/* The file contains the samples of all the channels enabled
+		 * in hardware, as they are sent to the device. */
+#ifdef _WIN32
+		fprintf(stderr, "Playing a file is not supported on Windows.\n");
+#else
+		play_file(dev, input_file, buffer_size * hw_sample_size,
+			  hw_sample_size, cyclic_buffer, pace);
+#endif
+		goto err_destroy_buffer;
+	}
+
 	stream = iio_buffer_create_stream(buffer, 4, buffer_size);
 	ret = iio_err(stream);
 	if (ret) {
@@ -104,6 +104,7 @@ static const struct option options[] = {
 	{"duration", required_argument, 0, 'd'},
 	{"threads", required_argument, 0, 't'},
 	{"verbose", no_argument, 0, 'v'},
+	{"check", no_argument, 0, 'c'},
 	{0, 0, 0, 0},
 };
 
@@ -117,6 +118,7 @@ static const char *options_descriptions[] = {
 	"Time to wait (in s) between stopping all threads",
 	"Number of Threads",
 	"Increase verbosity (-vv and -vvv for more)",
+	"Check that the first enabled channel carries a continuous ramp, as produced by the siggen backend",
 };
 
 static bool app_running = true;
@@ -203,8 +205,9 @@ struct info {
 	int uri_index, device_index, arg_index;
 	unsigned int buffer_size, timeout;
 	unsigned int num_threads;
+	bool check;
 	pthread_t *tid;
-	unsigned int *starts, *buffers, *refills;
+	unsigned int *starts, *buffers, *refills, *errors;
 	pthread_t *threads;
 	struct timeval **start;
 };
@@ -215,6 +218,49 @@ static void thread_err(int id, ssize_t ret, char * what)
 		prm_perror(NULL, (int)ret, "%d: %s", id, what);
 }
 
+/* Count the samples of the channel that do not follow the previous one */
+static unsigned int check_ramp(const struct iio_channel *ch,
+			       const struct iio_block *block, size_t step,
+			       uint64_t *expected, bool *synced)
+{
+	const struct iio_data_format *fmt = iio_channel_get_data_format(ch);
+	uint64_t val, mask = fmt->bits < 64 ? (1ull << fmt->bits) - 1 : ~0ull;
+	unsigned int errors = 0;
+	uint8_t v8;
+	uint16_t v16;
+	uint32_t v32;
+	char *ptr;
+
+	for (ptr = iio_block_first(block, ch); ptr < (char *) iio_block_end(block);
+	     ptr += step) {
+		switch (fmt->length) {
+		case 8:
+			iio_channel_convert(ch, &v8, ptr);
+			val = v8;
+			break;
+		case 16:
+			iio_channel_convert(ch, &v16, ptr);
+			val = v16;
+			break;
+		case 32:
+			iio_channel_convert(ch, &v32, ptr);
+			val = v32;
+			break;
+		default:
+			iio_channel_convert(ch, &val, ptr);
+			break;
+		}
+
+		if (*synced && ((val ^ *expected) & mask))
+			errors++;
+
+		*expected = val + 1;
+		*synced = true;
+	}
+
+	return errors;
+}
+
 static void *client_thread(void *data)
 {
 	struct info *info = data;
@@ -224,10 +270,13 @@ static void *client_thread(void *data)
 	const struct iio_block *block;
 	unsigned int i, nb_channels, duration;
 	const struct iio_device *dev;
-	const struct iio_channel *ch;
+	const struct iio_channel *ch, *check_ch;
 	struct iio_channels_mask *mask;
 	struct timeval start, end;
 	int id = -1, stamp, r_errno;
+	uint64_t expected;
+	size_t step;
+	bool synced;
 	ssize_t ret;
 
 	/* Find my ID */
@@ -305,13 +354,22 @@ static void *client_thread(void *data)
 				iio_device_enable_channel(dev, info->argv[i], false, mask);
 		}
 
+		check_ch = NULL;
+		for (i = 0; info->check && !check_ch && i < nb_channels; i++) {
+			ch = iio_device_get_channel(dev, i);
+			if (iio_channel_is_enabled(ch, mask))
+				check_ch = ch;
+		}
+
+		step = iio_device_get_sample_size(dev, mask);
+
 		if (info->verbose == VERYVERBOSE)
 			printf("%2d: Running\n", id);
 
 		i = 0;
 		while (threads_running || i == 0) {
 			info->buffers[id]++;
-			buffer = iio_device_create_buffer(dev, info->buffer_size, false);
+			buffer = iio_device_create_buffer(dev, 0, mask);
 			ret = iio_err(buffer);
 			if (ret) {
 				struct timespec wait;
@@ -330,6 +388,9 @@ static void *client_thread(void *data)
 				continue;
 			}
 
+			/* Every buffer starts a new ramp */
+			synced = false;
+
 			while (threads_running || i == 0) {
 				block = iio_stream_get_next_block(stream);
 				ret = iio_err(block);
@@ -342,6 +403,11 @@ static void *client_thread(void *data)
 				info->refills[id]++;
 				i = 1;
 
+				if (check_ch) {
+					info->errors[id] += check_ramp(check_ch, block, step,
+								       &expected, &synced);
+				}
+
 				/* depending on backend, do more */
 				if(info->back == IIO_USB && rand() % 3 == 0)
 					break;
@@ -405,6 +471,7 @@ int main(int argc, char **argv)
 	struct timeval start, end, s_loop;
 	void **ret;
 	size_t min_samples;
+	unsigned int discontinuities = 0;
 
 #ifndef _WIN32
 	set_handler(SIGHUP, &quit_all);
@@ -427,7 +494,9 @@ int main(int argc, char **argv)
 	if(!min_samples)
 		min_samples = 128;
 
-	while ((c = getopt_long(argc, argv, "hvu:b:s:t:T:",
+	info.check = false;
+
+	while ((c = getopt_long(argc, argv, "hvcu:b:s:t:T:",
 					options, &option_index)) != -1) {
 		switch (c) {
 		case 'h':
@@ -460,6 +529,10 @@ int main(int argc, char **argv)
 				info.arg_index++;
 			info.verbose++;
 			break;
+		case 'c':
+			info.arg_index++;
+			info.check = true;
+			break;
 		case '?':
 			return EXIT_FAILURE;
 		}
@@ -544,11 +617,12 @@ int main(int argc, char **argv)
 	info.starts = calloc(info.num_threads, sizeof(unsigned int));
 	info.buffers = calloc(info.num_threads, sizeof(unsigned int));
 	info.refills = calloc(info.num_threads, sizeof(unsigned int));
+	info.errors = calloc(info.num_threads, sizeof(unsigned int));
 	info.start = calloc(info.num_threads, sizeof(struct timeval *));
 
 	ret = (void *)calloc(info.num_threads, sizeof(void *));
 
-	if (!ret || !info.start || !info.refills || !info.buffers || !info.starts ||
+	if (!ret || !info.start || !info.refills || !info.errors || !info.buffers || !info.starts ||
 			!info.tid || !info.threads) {
 		fprintf(stderr, "Memory allocation failure\n");
 		return 0;
@@ -639,12 +713,13 @@ int main(int argc, char **argv)
 		}
 
 		/* Calculate some stats about the threads */
-		unsigned int a =0, b = 0;
+		unsigned int a =0, b = 0, e = 0;
 		c = 0;
 		for (i = 0; i < info.num_threads; i++) {
 			a+= info.starts[i];
 			b+= info.buffers[i];
 			c+= info.refills[i];
+			e+= info.errors[i];
 			if (!app_running || info.verbose >= VERBOSE)
 				printf("%2u: Ran : %u times, opening %u buffers, doing %u refills\n",
 						i, info.starts[i], info.buffers[i], info.refills[i]);
@@ -689,7 +764,10 @@ int main(int argc, char **argv)
 					a, (double)a * 1000 / duration,
 					b, (double)b * 1000 / duration,
 					c, (double)c * 1000 / duration);
+			if (info.check)
+				printf(" Ramp discontinuities : %u\n", e);
 		}
+		discontinuities = e;
 		/* gather and sort things, so we can print out a histogram */
 		struct timeval *sort;
 		sort = calloc(info.num_threads * NUM_TIMESTAMPS, sizeof(struct timeval));
@@ -774,9 +852,10 @@ int main(int argc, char **argv)
 	free(info.starts);
 	free(info.buffers);
 	free(info.refills);
+	free(info.errors);
 	for (i = 0; i < info.num_threads; i++)
 		free(info.start[i]);
 	free(info.start);
 	free(ret);
-	return 0;
+	return discontinuities ? EXIT_FAILURE : 0;
 }
@@ -63,9 +63,34 @@ static int add_attr_to_device(struct iio_device *dev, xmlNode *n, enum iio_attr_
 	return iio_device_add_attr(dev, name, type);
 }
 
+static int setup_scale_offset(const char *name, const char *content,
+			      struct iio_data_format *fmt, bool *with_offset)
+{
+	char *end;
+	double value;
+
+	errno = 0;
+	value = strtod(content, &end);
+	if (end == content || errno == ERANGE) {
+		if (!strcmp(name, "scale"))
+			fmt->with_scale = false;
+		return -EINVAL;
+	}
+
+	if (!strcmp(name, "scale")) {
+		fmt->with_scale = true;
+		fmt->scale = value;
+	} else {
+		*with_offset = true;
+		fmt->offset = value;
+	}
+
+	return 0;
+}
+
 static int setup_scan_element(const struct iio_device *dev,
 			      xmlNode *n, long *index,
-			      struct iio_data_format *fmt)
+			      struct iio_data_format *fmt, bool *with_offset)
 {
 	xmlAttr *attr;
 	int err;
@@ -117,19 +142,10 @@ static int setup_scan_element(const struct iio_device *dev,
 			fmt->is_signed = (s == 's' || s == 'S');
 			fmt->is_fully_defined = (s == 'S' || s == 'U' ||
 				fmt->bits == fmt->length);
-		} else if (!strcmp(name, "scale")) {
-			char *end;
-			float value;
-
-			errno = 0;
-			value = strtof(content, &end);
-			if (end == content || errno == ERANGE) {
-				fmt->with_scale = false;
-				return -EINVAL;
-			}
-
-			fmt->with_scale = true;
-			fmt->scale = value;
+		} else if (!strcmp(name, "scale") || !strcmp(name, "offset")) {
+			err = setup_scale_offset(name, content, fmt, with_offset);
+			if (err < 0)
+				return err;
 		} else {
 			dev_dbg(dev, "Unknown attribute \'%s\' in <scan-element>\n",
 				name);
@@ -146,7 +162,7 @@ static int create_channel(struct iio_device *dev, xmlNode *node)
 	int err = -ENOMEM;
 	char *name_ptr = NULL, *id_ptr = NULL;
 	bool output = false;
-	bool scan_element = false;
+	bool scan_element = false, with_offset = false;
 	long index = -ENOENT;
 	struct iio_data_format format = { 0 };
 	xmlNode *n;
@@ -167,6 +183,14 @@ static int create_channel(struct iio_device *dev, xmlNode *node)
 				output = true;
 			else if (strcmp(content, "input"))
 				dev_dbg(dev, "Unknown channel type %s\n", content);
+		} else if (!strcmp(name, "scale") || !strcmp(name, "offset")) {
+			/* Only set for channels that are not scan elements */
+			int ret = setup_scale_offset(name, content, &format,
+						     &with_offset);
+			if (ret < 0) {
+				err = ret;
+				goto err_free_name_id;
+			}
 		} else {
 			dev_dbg(dev, "Unknown attribute \'%s\' in <channel>\n",
 				name);
@@ -182,7 +206,8 @@ static int create_channel(struct iio_device *dev, xmlNode *node)
 	for (n = node->children; n; n = n->next) {
 		if (!strcmp((char *) n->name, "scan-element")) {
 			scan_element = true;
-			err = setup_scan_element(dev, n, &index, &format);
+			err = setup_scan_element(dev, n, &index, &format,
+						 &with_offset);
 			if (err < 0)
 				goto err_free_name_id;
 
@@ -197,6 +222,10 @@ static int create_channel(struct iio_device *dev, xmlNode *node)
 		goto err_free_name_id;
 	}
 
+	/* The offset is only provided along with up-to-date values */
+	if (with_offset)
+		iio_channel_set_scale_offset_known(chn);
+
 	free(name_ptr);
 	free(id_ptr);
 